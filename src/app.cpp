@@ -1,5 +1,12 @@
 #include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <functional>
+#include <iterator>
+#include <limits>
 #include <memory>
+#include <mutex>
+#include <optional>
 #include <sstream>
 #include <string>
 #include <regex>
@@ -13,13 +20,21 @@
 #include <inja.hpp>
 #include <httplib.h>
 #include <nlohmann/json.hpp>
+#include <openssl/crypto.h>
 #include <spdlog/spdlog.h>
 
 #include "app.hpp"
 #include "auth.hpp"
+#include "compression.hpp"
 #include "config.hpp"
 #include "error.hpp"
 #include "http_client.hpp"
+#include "importer.hpp"
+#include "json_writer.hpp"
+#include "metrics.hpp"
+#include "server_queue.hpp"
+#include "statics.hpp"
+#include "trace.hpp"
 #include "url.hpp"
 #include "utils.hpp"
 #include "weekly.hpp"
@@ -51,6 +66,90 @@
     _ASSIGN_OR_RESPOND_ERROR(_CONCAT_NAMES(assign_or_return_tmp, __COUNTER__), \
                             var, val, res)
 
+// Whether the If-None-Match header value matches the ETag. Weak
+// comparison is used, as it should be for GET.
+bool etagMatches(std::string_view if_none_match, std::string_view etag)
+{
+    auto opaque = [](std::string_view tag)
+    {
+        if(tag.starts_with("W/"))
+        {
+            tag.remove_prefix(2);
+        }
+        return tag;
+    };
+    size_t begin = 0;
+    while(begin < if_none_match.size())
+    {
+        size_t comma = if_none_match.find(',', begin);
+        if(comma == std::string_view::npos)
+        {
+            comma = if_none_match.size();
+        }
+        std::string_view tag = if_none_match.substr(begin, comma - begin);
+        begin = comma + 1;
+        while(!tag.empty() && tag.front() == ' ')
+        {
+            tag.remove_prefix(1);
+        }
+        while(!tag.empty() && tag.back() == ' ')
+        {
+            tag.remove_suffix(1);
+        }
+        if(tag == "*" || opaque(tag) == opaque(etag))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+// The number of weeklies on a page of the archive, by default and at
+// most.
+constexpr int ARCHIVE_PAGE_SIZE = 20;
+constexpr int ARCHIVE_MAX_PAGE_SIZE = 100;
+
+// The number of weeklies that the API reads from the database at a
+// time.
+constexpr int64_t API_BATCH_SIZE = 64;
+// The same for the pages of weeklies.
+constexpr int PAGE_BATCH_SIZE = 16;
+// Number of imported weeklies to write in each transaction.
+constexpr size_t IMPORT_BATCH_SIZE = 1000;
+
+// Parse the “limit” parameter of a page of the archive. Limits larger
+// than max_limit are reduced to it.
+E<int> archivePageSize(const httplib::Request& req,
+                       int max_limit = ARCHIVE_MAX_PAGE_SIZE)
+{
+    if(!req.has_param("limit"))
+    {
+        return ARCHIVE_PAGE_SIZE;
+    }
+    std::string value = req.get_param_value("limit");
+    int limit = 0;
+    auto [end, ec] = std::from_chars(value.data(), value.data() + value.size(),
+                                     limit);
+    if(ec != std::errc() || end != value.data() + value.size() || limit <= 0)
+    {
+        return std::unexpected(httpError(400, "Invalid limit"));
+    }
+    return std::min(limit, max_limit);
+}
+
+std::string archiveURL(const std::string& username, const Time& before,
+                       int limit)
+{
+    std::string url = std::format(
+        "/weekly/{}?before={:%F}", username,
+        std::chrono::floor<std::chrono::days>(before));
+    if(limit != ARCHIVE_PAGE_SIZE)
+    {
+        url += std::format("&limit={}", limit);
+    }
+    return url;
+}
+
 std::unordered_map<std::string, std::string> parseCookies(std::string_view value)
 {
     std::unordered_map<std::string, std::string> cookies;
@@ -118,6 +217,183 @@ void setTokenCookies(const Tokens& tokens, httplib::Response& res)
     }
 }
 
+ContentEncoding acceptedEncoding(const httplib::Request& req)
+{
+    // Keep it simple, and do not compress partial content.
+    if(req.has_header("Range"))
+    {
+        return ContentEncoding::IDENTITY;
+    }
+    return negotiateEncoding(req.get_header_value("Accept-Encoding"));
+}
+
+void setContentEncoding(httplib::Response& res, ContentEncoding encoding)
+{
+    if(encoding != ContentEncoding::IDENTITY)
+    {
+        res.set_header("Content-Encoding", std::string(encodingName(encoding)));
+    }
+    res.set_header("Vary", "Accept-Encoding");
+}
+
+// Set the body of the response, in the variant that the client
+// accepts.
+void setContent(const httplib::Request& req, httplib::Response& res,
+                const CompressedBody& body, const std::string& type)
+{
+    ContentEncoding encoding = acceptedEncoding(req);
+    res.set_content(body.get(encoding), type);
+    setContentEncoding(res, encoding);
+}
+
+// Set the body of the response, compressed if the client accepts it
+// and it is worth it.
+void setContent(const httplib::Request& req, httplib::Response& res,
+                const std::string& body, const std::string& type)
+{
+    ContentEncoding encoding = acceptedEncoding(req);
+    if(encoding != ContentEncoding::IDENTITY &&
+       body.size() >= MIN_COMPRESS_SIZE && isCompressible(type))
+    {
+        E<std::string> compressed = compress(body, encoding,
+                                             CompressionEffort::FAST);
+        if(compressed.has_value() && compressed->size() < body.size())
+        {
+            res.set_content(*compressed, type);
+            setContentEncoding(res, encoding);
+            return;
+        }
+    }
+    res.set_content(body, type);
+    setContentEncoding(res, ContentEncoding::IDENTITY);
+}
+
+// Times a request, and logs it with its trace if it is slow. This is
+// done when the observation is destroyed, which is after the body is
+// sent if it is streamed.
+class RequestObservation
+{
+public:
+    RequestObservation(Histogram& latency,
+                       std::chrono::nanoseconds slow_threshold,
+                       const httplib::Request& req, std::string route)
+            : latency(latency), begin(std::chrono::steady_clock::now()),
+              trace(slow_threshold), method(req.method), path(req.path),
+              route(std::move(route)) {}
+    ~RequestObservation()
+    {
+        latency.observe(std::chrono::steady_clock::now() - begin);
+        if(trace.finish())
+        {
+            nlohmann::json log = trace.toJSON();
+            log["method"] = method;
+            log["route"] = route;
+            log["path"] = path;
+            log["status"] = status;
+            // The path could be anything, and this must not throw.
+            spdlog::warn("Slow request: {}", log.dump(
+                -1, ' ', false, nlohmann::json::error_handler_t::replace));
+        }
+    }
+    RequestObservation(const RequestObservation&) = delete;
+    RequestObservation& operator=(const RequestObservation&) = delete;
+
+    int status = -1;
+
+private:
+    Histogram& latency;
+    std::chrono::steady_clock::time_point begin;
+    RequestTrace trace;
+    std::string method;
+    std::string path;
+    std::string route;
+};
+
+// The observation of the request being handled by the current thread.
+// A streamed body is produced after the handler returns, on the same
+// thread, so streamContent() keeps this until the body is done.
+thread_local std::shared_ptr<RequestObservation> current_observation;
+
+// Produce the next part of a streamed body, or nullopt after the last
+// part.
+using NextPart = std::function<E<std::optional<std::string>>()>;
+
+// Stream the body part by part, compressed if the client accepts it.
+// The parts are produced after the handler returns, when the headers
+// are already sent, so errors can only cut the response short. The
+// request is observed until the response drops the producer.
+void streamContent(const httplib::Request& req, httplib::Response& res,
+                   const std::string& type, NextPart next_part)
+{
+    ContentEncoding encoding = isCompressible(type) ? acceptedEncoding(req) :
+        ContentEncoding::IDENTITY;
+    E<std::unique_ptr<StreamCompressor>> compressor =
+        StreamCompressor::create(encoding);
+    if(!compressor.has_value())
+    {
+        res.status = 500;
+        res.set_content(errorMsg(compressor.error()), "text/plain");
+        return;
+    }
+    setContentEncoding(res, encoding);
+    res.set_chunked_content_provider(
+        type, [compressor = std::shared_ptr<StreamCompressor>(
+                   *std::move(compressor)),
+               next_part = std::move(next_part), type,
+               observation = current_observation]
+        (size_t, httplib::DataSink& sink)
+        {
+            E<std::optional<std::string>> part = next_part();
+            E<std::string> body;
+            if(!part.has_value())
+            {
+                body = std::unexpected(part.error());
+            }
+            else if(part->has_value())
+            {
+                body = compressor->write(**part);
+            }
+            else
+            {
+                body = compressor->finish();
+            }
+            if(!body.has_value())
+            {
+                spdlog::error("Failed to stream {}: {}", type,
+                              errorMsg(body.error()));
+                return false;
+            }
+            if(!body->empty() && !sink.write(body->data(), body->size()))
+            {
+                return false;
+            }
+            if(part->has_value())
+            {
+                return true;
+            }
+            sink.done();
+            return true;
+        });
+}
+
+// Write a weekly for the API. Html is the rendered content.
+void writeWeeklyJSON(JSONWriter& out, const WeeklyPost& p,
+                     const std::string& html)
+{
+    auto week_begin_day = std::chrono::floor<std::chrono::days>(p.week_begin);
+    out.beginObject()
+        .key("author").value(p.author)
+        .key("week_begin").value(std::format("{:%F}", week_begin_day))
+        .key("week_end").value(std::format(
+            "{:%F}", week_begin_day + std::chrono::days(6)))
+        .key("update_time").value(timeToRFC3339(p.update_time))
+        .key("language").value(p.language)
+        .key("format").value(WeeklyPost::formatName(p.format))
+        .key("markdown").value(p.raw_content)
+        .key("html").value(html)
+        .endObject();
+}
+
 void copyToHttplibReq(const HTTPRequest& src, httplib::Request& dest)
 {
     std::string type = "text/plain";
@@ -137,8 +413,65 @@ void copyToHttplibReq(const HTTPRequest& src, httplib::Request& dest)
     }
 }
 
+E<UserInfo> App::getUser(const Tokens& tokens) const
+{
+    Span span("App::getUser");
+    if(session_cache == nullptr)
+    {
+        return auth->getUser(tokens);
+    }
+    if(std::optional<UserInfo> user =
+       session_cache->get(sha256(tokens.access_token));
+       user.has_value())
+    {
+        return *std::move(user);
+    }
+    ASSIGN_OR_RETURN(UserInfo user, auth->getUser(tokens));
+    cacheUser(tokens, user);
+    return user;
+}
+
+void App::cacheUser(const Tokens& tokens, const UserInfo& user) const
+{
+    if(session_cache == nullptr)
+    {
+        return;
+    }
+    Time expiration = Clock::now() +
+        std::chrono::seconds(config.session_cache_ttl);
+    if(tokens.expiration.has_value())
+    {
+        expiration = std::min(expiration, *tokens.expiration);
+    }
+    session_cache->put(sha256(tokens.access_token), user, 1, expiration);
+}
+
+std::string App::renderWeekly(const WeeklyPost& post) const
+{
+    Span span("App::renderWeekly");
+    E<std::string> html = render_cache == nullptr ? post.render() :
+        render_cache->render(post);
+    if(!html.has_value())
+    {
+        return errorMsg(html.error());
+    }
+    return *std::move(html);
+}
+
+E<std::string> App::renderTemplate(const std::string& name,
+                                   const nlohmann::json& data) const
+{
+    Span span("App::renderTemplate");
+    if(templates == nullptr)
+    {
+        return std::unexpected(runtimeError("Templates are not loaded"));
+    }
+    return templates->render(name, data);
+}
+
 E<App::SessionValidation> App::validateSession(const httplib::Request& req) const
 {
+    Span span("App::validateSession");
     if(!req.has_header("Cookie"))
     {
         spdlog::debug("Request has no cookie.");
@@ -152,7 +485,7 @@ E<App::SessionValidation> App::validateSession(const httplib::Request& req) cons
         spdlog::debug("Cookie has access token.");
         Tokens tokens;
         tokens.access_token = it->second;
-        E<UserInfo> user = auth->getUser(tokens);
+        E<UserInfo> user = getUser(tokens);
         if(user.has_value())
         {
             return SessionValidation::valid(*std::move(user));
@@ -165,28 +498,14 @@ E<App::SessionValidation> App::validateSession(const httplib::Request& req) cons
         spdlog::debug("Cookie has refresh token.");
         // Try to refresh the tokens.
         ASSIGN_OR_RETURN(Tokens tokens, auth->refreshTokens(it->second));
-        ASSIGN_OR_RETURN(UserInfo user, auth->getUser(tokens));
+        ASSIGN_OR_RETURN(UserInfo user, getUser(tokens));
         return SessionValidation::refreshed(std::move(user), std::move(tokens));
     }
     return SessionValidation::invalid();
 }
 
-nlohmann::json weeklyToJSON(const WeeklyPost& p, bool render=true)
+nlohmann::json weeklyToJSON(const WeeklyPost& p, std::string content)
 {
-    std::string content;
-    if(render)
-    {
-        content = *p.render().or_else(
-            [](const auto& e) -> E<std::string>
-            {
-                return errorMsg(e);
-            });
-    }
-    else
-    {
-        content = p.raw_content;
-    }
-
     auto week_begin_day = std::chrono::floor<std::chrono::days>(p.week_begin);
     std::chrono::year_month_day date(week_begin_day);
     int week = daysSinceNewYear(p.week_begin);
@@ -207,17 +526,66 @@ nlohmann::json weeklyToJSON(const WeeklyPost& p, bool render=true)
 
 App::App(const Configuration& conf, std::unique_ptr<AuthInterface> openid_auth,
          std::unique_ptr<DataSourceInterface> data_source)
-        : config(conf),
-          templates((std::filesystem::path(config.data_dir) / "templates" / "")
-                    .string()),
-          auth(std::move(openid_auth)), data(std::move(data_source))
+        : config(conf), auth(std::move(openid_auth)),
+          data(std::move(data_source))
 {
-    templates.add_callback("url_for", 2, [&](const inja::Arguments& args)
+    if(config.session_cache_size > 0)
     {
-        return urlFor(args.at(0)->get_ref<const std::string&>(),
-                      args.at(1)->get_ref<const std::string&>());
-    });
+        session_cache = std::make_unique<SessionCache>(
+            config.session_cache_size);
+    }
+    if(config.render_cache_bytes > 0)
+    {
+        render_cache = std::make_unique<RenderCache>(
+            config.render_cache_bytes);
+        data->addUpdateCallback(
+            [cache = render_cache.get()](const std::string& username,
+                                         const Time& week_begin)
+            {
+                cache->invalidate(username, week_begin);
+            });
+    }
+    if(config.page_cache_bytes > 0)
+    {
+        page_cache = std::make_unique<PageCache>(
+            config.page_cache_bytes,
+            std::chrono::seconds(config.page_cache_max_age));
+        data->addUpdateCallback(
+            [cache = page_cache.get()](const std::string& username,
+                                       const Time&)
+            {
+                cache->invalidate(username);
+            });
+    }
+}
 
+E<void> App::loadTemplates()
+{
+    ASSIGN_OR_RETURN(templates, Templates::load(
+        std::filesystem::path(config.data_dir) / "templates",
+        [this](inja::Environment& env)
+        {
+            env.add_callback("url_for", 2, [this](const inja::Arguments& args)
+            {
+                return urlFor(args.at(0)->get_ref<const std::string&>(),
+                              args.at(1)->get_ref<const std::string&>());
+            });
+        }));
+    if(config.template_hot_reload)
+    {
+        DO_OR_RETURN(templates->watch());
+    }
+    return {};
+}
+
+E<void> App::loadStatics()
+{
+    std::filesystem::path dir = std::filesystem::path(config.data_dir) /
+        "statics";
+    spdlog::info("Loading static files in {}...", dir.string());
+    ASSIGN_OR_RETURN(statics, StaticFiles::load(
+        dir, config.static_mmap_threshold));
+    return {};
 }
 
 std::string App::urlFor(const std::string& name, const std::string& arg) const
@@ -236,6 +604,16 @@ std::string App::urlFor(const std::string& name, const std::string& arg) const
     }
     if(name == "statics")
     {
+        // The URL changes with the content, so that it can be cached
+        // forever.
+        if(statics != nullptr)
+        {
+            if(const StaticFiles::File* file = statics->find(arg);
+               file != nullptr)
+            {
+                return std::format("/statics/{}/{}", file->hash, arg);
+            }
+        }
         return "/statics/" + arg;
     }
     if(name == "login")
@@ -322,12 +700,301 @@ void App::handleOpenIDRedirect(const httplib::Request& req,
     std::string code = req.get_param_value("code");
     spdlog::debug("OpenID server visited {} with code {}.", req.path, code);
     ASSIGN_OR_RESPOND_ERROR(Tokens tokens, auth->authenticate(code), res);
-    ASSIGN_OR_RESPOND_ERROR(UserInfo user, auth->getUser(tokens), res);
+    ASSIGN_OR_RESPOND_ERROR(UserInfo user, getUser(tokens), res);
 
     setTokenCookies(tokens, res);
     res.set_redirect(urlFor("index", ""), 301);
 }
 
+bool App::respondNotModified(
+    const httplib::Request& req, httplib::Response& res,
+    const std::string& page_key, const std::string& session_user,
+    Time last_modified) const
+{
+    Span span("App::respondNotModified");
+    if(templates == nullptr)
+    {
+        return false;
+    }
+    last_modified = std::max(last_modified, templates->lastModified());
+    // Pages link to the static files by their versions.
+    std::string statics_version;
+    if(statics != nullptr)
+    {
+        last_modified = std::max(last_modified, statics->lastModified());
+        statics_version = statics->version();
+    }
+    // The ETag is only compared, so it does not have to show the
+    // session user, or anything else in it.
+    std::string etag = std::format(
+        "W/\"{}\"", base64URLEncode(sha256(std::format(
+            "{}\n{}\n{}\n{}\n{}", page_key, timeToSeconds(last_modified),
+            templates->version(), statics_version, session_user))));
+    res.set_header("ETag", etag);
+    res.set_header("Last-Modified", timeToHTTPDate(last_modified));
+    // Pages differ by session, and should always be validated.
+    res.set_header("Cache-Control", "private, no-cache");
+    res.set_header("Vary", "Cookie");
+
+    bool not_modified = false;
+    if(req.has_header("If-None-Match"))
+    {
+        not_modified = etagMatches(req.get_header_value("If-None-Match"),
+                                   etag);
+    }
+    else if(req.has_header("If-Modified-Since"))
+    {
+        E<Time> since = httpDateToTime(
+            req.get_header_value("If-Modified-Since"));
+        not_modified = since.has_value() && last_modified <= *since;
+    }
+    if(not_modified)
+    {
+        res.status = 304;
+    }
+    return not_modified;
+}
+
+void App::handleStatic(const httplib::Request& req, httplib::Response& res,
+                       const std::string& path) const
+{
+    if(statics == nullptr)
+    {
+        res.status = 404;
+        return;
+    }
+    // The path is either “hash/name” from urlFor(), or just the
+    // name.
+    const StaticFiles::File* file = statics->find(path);
+    bool immutable = false;
+    if(file == nullptr)
+    {
+        size_t slash = path.find('/');
+        if(slash != std::string::npos)
+        {
+            file = statics->find(path.substr(slash + 1));
+            immutable = file != nullptr &&
+                file->hash == std::string_view(path).substr(0, slash);
+        }
+    }
+    if(file == nullptr)
+    {
+        res.status = 404;
+        return;
+    }
+
+    if(immutable)
+    {
+        res.set_header("Cache-Control", "public, max-age=31536000, immutable");
+    }
+    else
+    {
+        // An outdated or unversioned URL. Serve the current file,
+        // but make sure it is revalidated.
+        res.set_header("Cache-Control", "no-cache");
+    }
+    std::string etag = std::format("\"{}\"", file->hash);
+    res.set_header("ETag", etag);
+    res.set_header("Last-Modified", timeToHTTPDate(file->last_modified));
+    if(req.has_header("If-None-Match") &&
+       etagMatches(req.get_header_value("If-None-Match"), etag))
+    {
+        res.status = 304;
+        return;
+    }
+
+    if(file->body != nullptr)
+    {
+        setContent(req, res, *file->body, file->type);
+        return;
+    }
+    // Serve large files directly from the memory map, without
+    // copying them into the response.
+    std::string_view data = file->mapped.data();
+    res.set_content_provider(
+        data.size(), file->type,
+        [data](size_t offset, size_t length, httplib::DataSink& sink)
+        {
+            return sink.write(data.data() + offset, length);
+        });
+}
+
+E<std::string> App::olderWeekliesURL(const std::string& username,
+                                     const Time& before) const
+{
+    ASSIGN_OR_RETURN(bool has_older,
+                     data->hasWeekliesBefore(username, before));
+    if(!has_older)
+    {
+        return "";
+    }
+    return archiveURL(username, before, ARCHIVE_PAGE_SIZE);
+}
+
+// The data of a page of weeklies, other than the weeklies.
+nlohmann::json weekliesPageData(
+    const std::string& username, const std::string& session_user,
+    const std::string& this_url, const std::string& older_url)
+{
+    return {{ "username", username },
+            { "session_user", session_user },
+            { "this_url", this_url },
+            { "older_url", older_url },
+    };
+}
+
+E<std::string> App::renderUserWeeklies(
+    const std::string& username, const std::string& session_user,
+    const std::string& this_url, const Time& now)
+{
+    Span span("App::renderUserWeeklies");
+    ASSIGN_OR_RETURN(std::string older_url, olderWeekliesURL(
+        username, DataSourceInterface::oneYearBegin(now)));
+    ASSIGN_OR_RETURN(std::vector<WeeklyPost> weeklies,
+                     data->getWeekliesOneYear(username, now));
+    std::reverse(std::begin(weeklies), std::end(weeklies));
+    return renderWeekliesPage(weeklies, weekliesPageData(
+        username, session_user, this_url, older_url));
+}
+
+E<std::string> App::renderWeekliesPage(const std::vector<WeeklyPost>& weeklies,
+                                       nlohmann::json page) const
+{
+    nlohmann::json weeklies_json(nlohmann::json::value_t::array);
+    for(const WeeklyPost& p: weeklies)
+    {
+        weeklies_json.push_back(weeklyToJSON(p, renderWeekly(p)));
+    }
+    page["weeklies"] = std::move(weeklies_json);
+    return renderTemplate("weeklies.html", page);
+}
+
+void App::respondWeekliesPage(const httplib::Request& req,
+                              httplib::Response& res, NextWeeklies next,
+                              nlohmann::json&& page) const
+{
+    // The first batch is read before responding, so that e.g. an
+    // unknown user still gets an error status.
+    ASSIGN_OR_RESPOND_ERROR(std::vector<WeeklyPost> batch, next(page), res);
+    if(!config.stream_pages)
+    {
+        std::vector<WeeklyPost> weeklies;
+        while(!batch.empty())
+        {
+            std::move(std::begin(batch), std::end(batch),
+                      std::back_inserter(weeklies));
+            ASSIGN_OR_RESPOND_ERROR(batch, next(page), res);
+        }
+        ASSIGN_OR_RESPOND_ERROR(std::string result,
+                                renderWeekliesPage(weeklies, std::move(page)),
+                                res);
+        setContent(req, res, result, "text/html");
+        return;
+    }
+
+    // The page is sent in parts: weeklies_begin.html, then
+    // weekly_section.html for each weekly, and weeklies_end.html. The
+    // weeklies are read a batch at a time, and only the weekly being
+    // rendered is kept in memory as HTML.
+    struct Stream
+    {
+        NextWeeklies next;
+        nlohmann::json page;
+        std::vector<WeeklyPost> batch;
+        // The next weekly to send in the batch.
+        size_t index = 0;
+        // Whether next() has returned no weeklies.
+        bool exhausted = false;
+        bool begun = false;
+        bool ended = false;
+    };
+    auto stream = std::make_shared<Stream>();
+    stream->next = std::move(next);
+    stream->page = std::move(page);
+    stream->exhausted = batch.empty();
+    stream->batch = std::move(batch);
+    streamContent(
+        req, res, "text/html",
+        [this, stream]() -> E<std::optional<std::string>>
+        {
+            if(!stream->begun)
+            {
+                stream->begun = true;
+                return renderTemplate("weeklies_begin.html", stream->page);
+            }
+            while(stream->index == stream->batch.size() &&
+                  !stream->exhausted)
+            {
+                ASSIGN_OR_RETURN(stream->batch, stream->next(stream->page));
+                stream->index = 0;
+                stream->exhausted = stream->batch.empty();
+            }
+            if(stream->index < stream->batch.size())
+            {
+                const WeeklyPost& p = stream->batch[stream->index++];
+                // The weekly goes into the page data instead of a copy
+                // of it.
+                stream->page["p"] = weeklyToJSON(p, renderWeekly(p));
+                return renderTemplate("weekly_section.html", stream->page);
+            }
+            if(!stream->ended)
+            {
+                stream->ended = true;
+                stream->page.erase("p");
+                return renderTemplate("weeklies_end.html", stream->page);
+            }
+            return std::nullopt;
+        });
+}
+
+void App::handleUserWeekliesBefore(
+    const httplib::Request& req, httplib::Response& res,
+    const std::string& username, const std::string& session_user) const
+{
+    Span span("App::handleUserWeekliesBefore");
+    E<Time> before = strToDate(req.get_param_value("before"));
+    if(!before.has_value())
+    {
+        res.status = 400;
+        res.set_content(errorMsg(before.error()), "text/plain");
+        return;
+    }
+    ASSIGN_OR_RESPOND_ERROR(int limit, archivePageSize(req), res);
+    // Each batch seeks to where the last one ended.
+    auto next = [this, username, before = *before, remaining = limit, limit](
+        nlohmann::json& page) mutable -> E<std::vector<WeeklyPost>>
+    {
+        if(remaining == 0)
+        {
+            return {};
+        }
+        int batch = std::min(remaining, PAGE_BATCH_SIZE);
+        ASSIGN_OR_RETURN(std::vector<WeeklyPost> weeklies,
+                         data->getWeekliesBefore(username, before, batch));
+        if(static_cast<int>(weeklies.size()) < batch)
+        {
+            remaining = 0;
+            return weeklies;
+        }
+        remaining -= batch;
+        before = weeklies.back().week_begin;
+        if(remaining == 0)
+        {
+            // The page is full, and links to the next one if there is
+            // any.
+            ASSIGN_OR_RETURN(bool has_older,
+                             data->hasWeekliesBefore(username, before));
+            if(has_older)
+            {
+                page["older_url"] = archiveURL(username, before, limit);
+            }
+        }
+        return weeklies;
+    };
+    respondWeekliesPage(req, res, std::move(next), weekliesPageData(
+        username, session_user, req.target, ""));
+}
+
 void App::handleUserWeeklies(const httplib::Request& req, httplib::Response& res,
                              const std::string& username)
 {
@@ -337,23 +1004,194 @@ void App::handleUserWeeklies(const httplib::Request& req, httplib::Response& res
     {
         session_user = session->user.name;
     }
+    if(req.has_param("before"))
+    {
+        handleUserWeekliesBefore(req, res, username, session_user);
+        return;
+    }
 
-    ASSIGN_OR_RESPOND_ERROR(std::vector<WeeklyPost> weeklies,
-                            data->getWeekliesOneYear(username), res);
-    std::reverse(std::begin(weeklies), std::end(weeklies));
-    nlohmann::json weeklies_json(nlohmann::json::value_t::array);
-    for(const WeeklyPost& p: weeklies)
+    Time now = Clock::now();
+    Time week_begin = weekBegin(now);
+    Time year_begin = DataSourceInterface::oneYearBegin(now);
+    E<std::optional<Time>> last_update =
+        data->getLastUpdateTimeOneYear(username, now);
+    // The page links to the archive if there are weeklies older than
+    // the one-year window, so this is part of the page. Neither
+    // reads any weekly.
+    E<bool> has_older = data->hasWeekliesBefore(username, year_begin);
+    if(last_update.has_value() && has_older.has_value())
     {
-        weeklies_json.push_back(weeklyToJSON(p));
+        // The page also changes when a new week begins.
+        Time last_modified = std::max(last_update->value_or(Time()),
+                                      week_begin);
+        if(respondNotModified(
+               req, res, std::format("weeklies\n{}\n{}\n{}", username,
+                                     timeToSeconds(week_begin), *has_older),
+               session_user, last_modified))
+        {
+            return;
+        }
     }
-    nlohmann::json data{{ "weeklies", std::move(weeklies_json) },
-                        { "username", username },
-                        { "session_user", session_user },
-                        { "this_url", req.target },
+
+    if(session_user.empty() && page_cache != nullptr)
+    {
+        // The page does not depend on the request, so use the
+        // canonical URL of it instead of req.target.
+        std::string week = std::to_string(timeToSeconds(week_begin));
+        ASSIGN_OR_RESPOND_ERROR(
+            PageCache::Page page, page_cache->get(username, week, [&]()
+            {
+                return renderUserWeeklies(username, "",
+                                          urlFor("weekly", username), now);
+            }), res);
+        setContent(req, res, *page, "text/html");
+        return;
+    }
+
+    ASSIGN_OR_RESPOND_ERROR(std::string older_url,
+                            olderWeekliesURL(username, year_begin), res);
+    // The weeks of the year from new to old, a batch of weeks at a
+    // time. Each week has a weekly, which could be empty.
+    auto next = [this, username, year_begin,
+                 end = week_begin + std::chrono::weeks(1)](
+        nlohmann::json&) mutable -> E<std::vector<WeeklyPost>>
+    {
+        if(end <= year_begin)
+        {
+            return {};
+        }
+        Time begin = std::max(year_begin,
+                              end - std::chrono::weeks(PAGE_BATCH_SIZE));
+        ASSIGN_OR_RETURN(std::vector<WeeklyPost> weeklies,
+                         data->getWeeklies(username, begin, end));
+        std::reverse(std::begin(weeklies), std::end(weeklies));
+        end = begin;
+        return weeklies;
     };
-    std::string result = templates.render_file(
-        "weeklies.html", std::move(data));
-    res.set_content(result, "text/html");
+    respondWeekliesPage(req, res, std::move(next), weekliesPageData(
+        username, session_user, req.target, older_url));
+}
+
+void App::handleAPIWeeklies(const httplib::Request& req,
+                            httplib::Response& res,
+                            const std::string& username) const
+{
+    Span span("App::handleAPIWeeklies");
+    // Without before, start from the latest weekly.
+    Time before = Time::max();
+    if(req.has_param("before"))
+    {
+        E<Time> date = strToDate(req.get_param_value("before"));
+        if(!date.has_value())
+        {
+            res.status = 400;
+            res.set_content(errorMsg(date.error()), "text/plain");
+            return;
+        }
+        before = *date;
+    }
+    // Without limit, export all the weeklies.
+    std::optional<int64_t> limit;
+    if(req.has_param("limit"))
+    {
+        ASSIGN_OR_RESPOND_ERROR(limit, archivePageSize(
+            req, std::numeric_limits<int>::max()), res);
+    }
+    ASSIGN_OR_RESPOND_ERROR(std::optional<int64_t> uid,
+                            data->getUserID(username), res);
+    if(!uid.has_value())
+    {
+        res.status = 404;
+        res.set_content("User not found", "text/plain");
+        return;
+    }
+
+    // The weeklies are read and written in batches, from new to old,
+    // so that exports of any size take little memory. Each batch
+    // seeks to where the last one ended, so weeklies updated in
+    // between are neither repeated nor skipped.
+    struct Export
+    {
+        std::string username;
+        Time before;
+        std::optional<int64_t> remaining;
+        JSONWriter out;
+        bool done = false;
+    };
+    auto state = std::make_shared<Export>();
+    state->username = username;
+    state->before = before;
+    state->remaining = limit;
+    state->out.beginObject()
+        .key("username").value(username)
+        .key("weeklies").beginArray();
+    streamContent(
+        req, res, "application/json",
+        [this, state]() -> E<std::optional<std::string>>
+        {
+            if(state->done)
+            {
+                return std::nullopt;
+            }
+            int64_t batch = API_BATCH_SIZE;
+            if(state->remaining.has_value())
+            {
+                batch = std::min(batch, *state->remaining);
+            }
+            std::vector<WeeklyPost> weeklies;
+            if(batch > 0)
+            {
+                ASSIGN_OR_RETURN(weeklies, data->getWeekliesBefore(
+                    state->username, state->before, batch));
+            }
+            for(const WeeklyPost& p: weeklies)
+            {
+                writeWeeklyJSON(state->out, p, renderWeekly(p));
+            }
+            if(state->remaining.has_value())
+            {
+                *state->remaining -= weeklies.size();
+            }
+            if(static_cast<int64_t>(weeklies.size()) < batch || batch == 0)
+            {
+                state->out.endArray().endObject();
+                state->done = true;
+            }
+            else
+            {
+                state->before = weeklies.back().week_begin;
+            }
+            return state->out.take();
+        });
+}
+
+void App::handleAPIWeekly(const httplib::Request& req, httplib::Response& res,
+                          const std::string& username, const Time& date) const
+{
+    Span span("App::handleAPIWeekly");
+    ASSIGN_OR_RESPOND_ERROR(std::optional<int64_t> uid,
+                            data->getUserID(username), res);
+    if(!uid.has_value())
+    {
+        res.status = 404;
+        res.set_content("User not found", "text/plain");
+        return;
+    }
+    Time week_begin = weekBegin(date);
+    ASSIGN_OR_RESPOND_ERROR(
+        std::vector<WeeklyPost> weeklies,
+        data->getWeeklies(username, week_begin,
+                          week_begin + std::chrono::weeks(1)),
+        res);
+    if(weeklies.empty() || weeklies[0].raw_content.empty())
+    {
+        res.status = 404;
+        res.set_content("Weekly not found", "text/plain");
+        return;
+    }
+    JSONWriter out;
+    writeWeeklyJSON(out, weeklies[0], renderWeekly(weeklies[0]));
+    setContent(req, res, out.take(), "application/json");
 }
 
 void App::handleUserWeekly(const httplib::Request& req, httplib::Response& res,
@@ -366,6 +1204,19 @@ void App::handleUserWeekly(const httplib::Request& req, httplib::Response& res,
         session_user = session->user.name;
     }
 
+    if(E<std::optional<Time>> last_update = data->getLastUpdateTime(
+           username, date, date + std::chrono::days(1));
+       last_update.has_value() && last_update->has_value())
+    {
+        if(respondNotModified(
+               req, res, std::format("weekly\n{}\n{}", username,
+                                     timeToSeconds(date)),
+               session_user, **last_update))
+        {
+            return;
+        }
+    }
+
     ASSIGN_OR_RESPOND_ERROR(
         std::vector<WeeklyPost> weeklies,
         data->getWeeklies(username, date, date + std::chrono::days(1)),
@@ -376,14 +1227,16 @@ void App::handleUserWeekly(const httplib::Request& req, httplib::Response& res,
         return;
     }
 
-    nlohmann::json weekly_json = weeklyToJSON(std::move(weeklies)[0]);
+    nlohmann::json weekly_json = weeklyToJSON(weeklies[0],
+                                              renderWeekly(weeklies[0]));
     nlohmann::json data{{ "weekly", std::move(weekly_json) },
                         { "username", username },
                         { "session_user", session_user },
                         { "this_url", req.target },
     };
-    std::string result = templates.render_file("weekly.html", std::move(data));
-    res.set_content(result, "text/html");
+    ASSIGN_OR_RESPOND_ERROR(std::string result,
+                            renderTemplate("weekly.html", data), res);
+    setContent(req, res, result, "text/html");
 }
 
 void App::handleEditFrontEnd(
@@ -418,10 +1271,12 @@ void App::handleEditFrontEnd(
     ASSIGN_OR_RESPOND_ERROR(
         std::vector<WeeklyPost> weekly, data->getWeeklies(
             username, week_start, week_start + std::chrono::days(1)), res);
-    nlohmann::json data{{"weekly", weeklyToJSON(std::move(weekly)[0], false)},
+    nlohmann::json data{{"weekly", weeklyToJSON(weekly[0],
+                                                weekly[0].raw_content)},
                         {"session_user", session_user}};
-    std::string html = templates.render_file("edit.html", std::move(data));
-    res.set_content(html, "text/html");
+    ASSIGN_OR_RESPOND_ERROR(std::string html,
+                            renderTemplate("edit.html", data), res);
+    setContent(req, res, html, "text/html");
 }
 
 void App::handleEdit(
@@ -469,44 +1324,209 @@ void App::handleEdit(
     res.set_redirect(urlFor("index", ""));
 }
 
-void App::start()
+void App::handleImport(const httplib::Request& req, httplib::Response& res,
+                       const httplib::ContentReader& reader) const
 {
-    httplib::Server server;
-    std::string statics_dir = (std::filesystem::path(config.data_dir) /
-                               "statics").string();
-    spdlog::info("Mounting static dir at {}...", statics_dir);
-    auto ret = server.set_mount_point("/statics", statics_dir);
-    if (!ret)
+    Span span("App::handleImport");
+    if(config.import_token.empty())
     {
-        spdlog::error("Failed to mount statics");
+        res.status = 404;
+        res.set_content("Import is disabled", "text/plain");
+        return;
     }
+    std::string auth_header = req.get_header_value("Authorization");
+    std::string_view token(auth_header);
+    if(!token.starts_with("Bearer ") ||
+       token.substr(7).size() != config.import_token.size() ||
+       CRYPTO_memcmp(token.data() + 7, config.import_token.data(),
+                     config.import_token.size()) != 0)
+    {
+        res.status = 401;
+        res.set_header("WWW-Authenticate", "Bearer");
+        res.set_content("Invalid import token", "text/plain");
+        return;
+    }
+
+    WeeklyImporter importer(*data, IMPORT_BATCH_SIZE);
+    E<void> fed;
+    bool read = reader([&](const char* chunk, size_t size)
+    {
+        fed = importer.feed(std::string_view(chunk, size));
+        return fed.has_value();
+    });
+    if(!read && fed.has_value())
+    {
+        // Do not import the rest, which could be a truncated line.
+        res.status = 400;
+        res.set_content("Failed to read the request", "text/plain");
+        return;
+    }
+    ASSIGN_OR_RESPOND_ERROR(
+        ImportStats stats,
+        fed.has_value() ? importer.finish() :
+        E<ImportStats>(std::unexpected(std::move(fed).error())),
+        res);
+    spdlog::info("Imported {} weeklies in {:.3f}s.", stats.weeklies,
+                 stats.elapsed.count());
+    JSONWriter out;
+    out.beginObject();
+    out.key("weeklies").value(static_cast<int64_t>(stats.weeklies));
+    out.key("bytes").value(static_cast<int64_t>(stats.bytes));
+    out.endObject();
+    res.set_content(out.take(), "application/json");
+}
+
+void App::handleMetrics(httplib::Response& res) const
+{
+    std::string out;
+    Metrics::global().render(out);
+    appendMetric(out, "nsweekly_server_queued_connections", "gauge",
+                 "Connections waiting for a worker.",
+                 queue_stats.queued.load(std::memory_order_relaxed));
+    appendMetric(out, "nsweekly_server_active_connections", "gauge",
+                 "Connections being handled by workers.",
+                 queue_stats.active.load(std::memory_order_relaxed));
+    appendMetric(out, "nsweekly_server_shed_connections_total", "counter",
+                 "Connections answered with 503 because the queue was full.",
+                 queue_stats.shed.load(std::memory_order_relaxed));
+    appendMetric(out, "nsweekly_server_dropped_connections_total", "counter",
+                 "Connections closed because the server was overloaded.",
+                 queue_stats.dropped.load(std::memory_order_relaxed));
+    if(session_cache != nullptr)
+    {
+        appendMetric(out, "nsweekly_session_cache_hits_total", "counter",
+                     "Sessions found in the session cache.",
+                     session_cache->hits());
+        appendMetric(out, "nsweekly_session_cache_misses_total", "counter",
+                     "Sessions not found in the session cache.",
+                     session_cache->misses());
+    }
+    if(page_cache != nullptr)
+    {
+        appendMetric(out, "nsweekly_page_cache_hits_total", "counter",
+                     "Pages served from the page cache.",
+                     page_cache->hits() + page_cache->staleHits());
+        appendMetric(out, "nsweekly_page_cache_misses_total", "counter",
+                     "Pages rendered for the page cache.",
+                     page_cache->misses());
+    }
+    res.set_header("Cache-Control", "no-store");
+    res.set_content(out, "text/plain; version=0.0.4");
+}
+
+void App::start()
+{
+    SheddingServer server;
+    size_t workers = config.server_threads > 0 ?
+        config.server_threads : CPPHTTPLIB_THREAD_POOL_COUNT;
+    server.new_task_queue = [this, workers]
+    {
+        return new ServerQueue(workers, config.server_max_queued,
+                               queue_stats);
+    };
+    server.set_keep_alive_max_count(config.keep_alive_max_count);
+    server.set_keep_alive_timeout(config.keep_alive_timeout);
+    server.set_read_timeout(config.read_timeout);
+    server.set_write_timeout(config.write_timeout);
+    // Connections that do not fit in the queue are answered before
+    // routing, so that they never wait for the OpenID Connect service
+    // or the database.
+    server.set_pre_routing_handler(
+        []([[maybe_unused]] const httplib::Request& req,
+           httplib::Response& res)
+    {
+        if(!ServerQueue::isShedding())
+        {
+            return httplib::Server::HandlerResponse::Unhandled;
+        }
+        res.status = 503;
+        res.set_header("Retry-After", "1");
+        // Let the client reconnect, so that it could get a worker.
+        res.set_header("Connection", "close");
+        res.set_content("Server is busy", "text/plain");
+        return httplib::Server::HandlerResponse::Handled;
+    });
+
+    // Time the handler of a route by the route pattern, and log it
+    // with its trace if it is slow.
+    const std::chrono::milliseconds slow_threshold(
+        config.slow_request_threshold);
+    auto observe = [slow_threshold](const std::string& method,
+                                    const std::string& route)
+    {
+        Histogram& latency = Metrics::global().histogram(
+            "nsweekly_http_request_duration_seconds",
+            "Time of handling HTTP requests.",
+            {{"method", method}, {"route", route}});
+        return [&latency, slow_threshold, route](
+            const httplib::Request& req, httplib::Response& res,
+            const std::function<void()>& handle)
+        {
+            auto observation = std::make_shared<RequestObservation>(
+                latency, slow_threshold, req, route);
+            current_observation = observation;
+            handle();
+            current_observation.reset();
+            observation->status = res.status;
+        };
+    };
+    auto timed = [&observe](const std::string& method,
+                            const std::string& route,
+                            httplib::Server::Handler handler)
+    {
+        return [observed = observe(method, route),
+                handler = std::move(handler)](const httplib::Request& req,
+                                               httplib::Response& res)
+        {
+            observed(req, res, [&] { handler(req, res); });
+        };
+    };
+    auto get = [&](const std::string& route, httplib::Server::Handler handler)
+    {
+        server.Get(route, timed("GET", route, std::move(handler)));
+    };
+    auto post = [&](const std::string& route, httplib::Server::Handler handler)
+    {
+        server.Post(route, timed("POST", route, std::move(handler)));
+    };
 
-    server.Get("/", [&](const httplib::Request& req,
+    get("/metrics", [&]([[maybe_unused]] const httplib::Request& req,
                         httplib::Response& res)
     {
-        handleIndex(req, res);
+        handleMetrics(res);
     });
 
-    server.Get("/login", [&]([[maybe_unused]] const httplib::Request& req,
+    get("/statics/(.+)", [&](const httplib::Request& req,
                              httplib::Response& res)
+    {
+        handleStatic(req, res, req.matches[1]);
+    });
+
+    get("/", [&](const httplib::Request& req, httplib::Response& res)
+    {
+        handleIndex(req, res);
+    });
+
+    get("/login", [&]([[maybe_unused]] const httplib::Request& req,
+                      httplib::Response& res)
     {
         handleLogin(res);
     });
 
-    server.Get("/openid-redirect", [&](const httplib::Request& req,
-                                       httplib::Response& res)
+    get("/openid-redirect", [&](const httplib::Request& req,
+                                httplib::Response& res)
     {
         handleOpenIDRedirect(req, res);
     });
 
-    server.Get("/weekly/:username", [&](const httplib::Request& req,
-                                        httplib::Response& res)
+    get("/weekly/:username", [&](const httplib::Request& req,
+                                 httplib::Response& res)
     {
         handleUserWeeklies(req, res, req.path_params.at("username"));
     });
 
-    server.Get("/weekly/:username/:date",
-               [&](const httplib::Request& req, httplib::Response& res)
+    get("/weekly/:username/:date",
+        [&](const httplib::Request& req, httplib::Response& res)
     {
         E<Time> date = strToDate(req.path_params.at("date"));
         if(!date.has_value())
@@ -518,8 +1538,27 @@ void App::start()
         handleUserWeekly(req, res, req.path_params.at("username"), *date);
     });
 
-    server.Get("/edit/:username/:date",
-               [&](const httplib::Request& req, httplib::Response& res)
+    get("/api/v1/users/:username/weeklies",
+        [&](const httplib::Request& req, httplib::Response& res)
+    {
+        handleAPIWeeklies(req, res, req.path_params.at("username"));
+    });
+
+    get("/api/v1/users/:username/weeklies/:date",
+        [&](const httplib::Request& req, httplib::Response& res)
+    {
+        E<Time> date = strToDate(req.path_params.at("date"));
+        if(!date.has_value())
+        {
+            res.status = 400;
+            res.set_content(errorMsg(date.error()), "text/plain");
+            return;
+        }
+        handleAPIWeekly(req, res, req.path_params.at("username"), *date);
+    });
+
+    get("/edit/:username/:date",
+        [&](const httplib::Request& req, httplib::Response& res)
     {
         E<Time> date = strToDate(req.path_params.at("date"));
         if(!date.has_value())
@@ -531,8 +1570,8 @@ void App::start()
         handleEditFrontEnd(req, res, req.path_params.at("username"), *date);
     });
 
-    server.Post("/edit/:username/:date",
-               [&](const httplib::Request& req, httplib::Response& res)
+    post("/edit/:username/:date",
+         [&](const httplib::Request& req, httplib::Response& res)
     {
         std::tm t;
         std::istringstream ss(req.path_params.at("date"));
@@ -557,7 +1596,32 @@ void App::start()
                    std::chrono::sys_days(date));
     });
 
-    spdlog::info("Listening at http://{}:{}/...", config.listen_address,
-                 config.listen_port);
+    // This reads the body itself, so that large imports are not
+    // buffered in memory.
+    server.Post("/api/v1/import",
+                [&, observed = observe("POST", "/api/v1/import")](
+                    const httplib::Request& req, httplib::Response& res,
+                    const httplib::ContentReader& reader)
+    {
+        observed(req, res, [&] { handleImport(req, res, reader); });
+    });
+
+    {
+        std::lock_guard lock(server_lock);
+        running_server = &server;
+    }
+    spdlog::info("Listening at http://{}:{}/ with {} workers...",
+                 config.listen_address, config.listen_port, workers);
     server.listen(config.listen_address, config.listen_port);
+    std::lock_guard lock(server_lock);
+    running_server = nullptr;
+}
+
+void App::stop()
+{
+    std::lock_guard lock(server_lock);
+    if(running_server != nullptr)
+    {
+        running_server->stop();
+    }
 }
@@ -1,21 +1,40 @@
 #pragma once
 
+#include <functional>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <string_view>
+#include <unordered_map>
 #include <format>
 
 #include <httplib.h>
 #include <spdlog/spdlog.h>
 #include <inja.hpp>
+#include <nlohmann/json.hpp>
 
 #include "auth.hpp"
+#include "cache.hpp"
 #include "config.hpp"
 #include "data.hpp"
 #include "http_client.hpp"
+#include "page_cache.hpp"
+#include "server_queue.hpp"
+#include "statics.hpp"
+#include "templates.hpp"
 #include "utils.hpp"
+#include "weekly.hpp"
 
 void copyToHttplibReq(const HTTPRequest& src, httplib::Request& dest);
+// Parse the value of a Cookie header into names and values.
+std::unordered_map<std::string, std::string>
+parseCookies(std::string_view value);
+// The data of a weekly for the templates. Content is the rendered
+// HTML.
+nlohmann::json weeklyToJSON(const WeeklyPost& p, std::string content);
+
+// Validated sessions, keyed by the SHA-256 digest of the access token.
+using SessionCache = LRUCache<std::string, UserInfo>;
 
 class App
 {
@@ -26,11 +45,20 @@ public:
                  std::unique_ptr<DataSourceInterface> data_source);
 
     std::string urlFor(const std::string& name, const std::string& arg) const;
+    // Parse the templates, and watch them for changes if configured.
+    // This should be called before start().
+    E<void> loadTemplates();
+    // Load the static files into memory. This should be called before
+    // start().
+    E<void> loadStatics();
 
     void handleIndex(const httplib::Request& req, httplib::Response& res) const;
     void handleLogin(httplib::Response& res) const;
     void handleOpenIDRedirect(const httplib::Request& req,
                               httplib::Response& res) const;
+    // Path is the part of the URL after “/statics/”.
+    void handleStatic(const httplib::Request& req, httplib::Response& res,
+                      const std::string& path) const;
     void handleUserWeeklies(const httplib::Request& req, httplib::Response& res,
                             const std::string& username);
     void handleUserWeekly(const httplib::Request& req, httplib::Response& res,
@@ -40,7 +68,34 @@ public:
                             const Time& week_start);
     void handleEdit(const httplib::Request& req, httplib::Response& res,
                     const std::string& username, const Time& week_start) const;
+    // The weeklies of a user as JSON, from new to old, optionally
+    // before the “before” parameter and at most “limit” of them.
+    void handleAPIWeeklies(const httplib::Request& req,
+                           httplib::Response& res,
+                           const std::string& username) const;
+    // The weekly of a user in the week of date as JSON.
+    void handleAPIWeekly(const httplib::Request& req, httplib::Response& res,
+                         const std::string& username, const Time& date) const;
+    // Import weeklies from the NDJSON in the body, which is read as
+    // it arrives. The Authorization header should carry the import
+    // token as a bearer token.
+    void handleImport(const httplib::Request& req, httplib::Response& res,
+                      const httplib::ContentReader& reader) const;
+    // Export the metrics of the process and the server, for
+    // Prometheus.
+    void handleMetrics(httplib::Response& res) const;
     void start();
+    // Stop the server started by start(), from another thread.
+    void stop();
+
+    // Could be null if the cache is disabled.
+    const SessionCache* sessionCache() const { return session_cache.get(); }
+    // Could be null if the cache is disabled.
+    const RenderCache* renderCache() const { return render_cache.get(); }
+    // Could be null if the cache is disabled.
+    const PageCache* pageCache() const { return page_cache.get(); }
+    // Load of the server started by start().
+    const ServerQueueStats& serverQueueStats() const { return queue_stats; }
 
 private:
     struct SessionValidation
@@ -66,9 +121,70 @@ private:
     };
     E<SessionValidation> validateSession(const httplib::Request& req) const;
     void handleIndexWithInvalidSession(httplib::Response& res) const;
+    // Get the user of the tokens, from the session cache if possible.
+    E<UserInfo> getUser(const Tokens& tokens) const;
+    void cacheUser(const Tokens& tokens, const UserInfo& user) const;
+    // Render a weekly to HTML, from the render cache if possible. On
+    // error return the error message.
+    std::string renderWeekly(const WeeklyPost& post) const;
+    E<std::string> renderTemplate(const std::string& name,
+                                  const nlohmann::json& data) const;
+    // Set the validators (RFC 9110) of a page on res. The page is
+    // identified by page_key, and changes when its weeklies are
+    // updated at last_update, when the templates or static files
+    // change, or when the session user changes. Return true and
+    // respond with 304 if the client already has the page.
+    bool respondNotModified(const httplib::Request& req,
+                            httplib::Response& res,
+                            const std::string& page_key,
+                            const std::string& session_user,
+                            Time last_modified) const;
+    // The URL of the first page of the archive of a user before
+    // before, or an empty string if the user has no weeklies before
+    // that.
+    E<std::string> olderWeekliesURL(const std::string& username,
+                                    const Time& before) const;
+    // Render the page of the weeklies of a user in the year up to
+    // now, which links to the archive if there are older weeklies.
+    E<std::string> renderUserWeeklies(
+        const std::string& username, const std::string& session_user,
+        const std::string& this_url, const Time& now);
+    // Render weeklies.html with the weeklies, and the rest of the
+    // data of the page.
+    E<std::string> renderWeekliesPage(const std::vector<WeeklyPost>& weeklies,
+                                      nlohmann::json page) const;
+    // Return the next weeklies of a page in the order they are shown,
+    // or none after the last. This could also set the data of the
+    // page that only weeklies_end.html uses, i.e. older_url.
+    using NextWeeklies =
+        std::function<E<std::vector<WeeklyPost>>(nlohmann::json& page)>;
+    // Respond with the page of the weeklies from next, streamed if
+    // configured. When streamed, each weekly is sent as its batch is
+    // read, and only one batch is kept in memory.
+    void respondWeekliesPage(const httplib::Request& req,
+                             httplib::Response& res, NextWeeklies next,
+                             nlohmann::json&& page) const;
+    // Respond with a page of the archive of a user, from the
+    // “before” and “limit” parameters.
+    void handleUserWeekliesBefore(const httplib::Request& req,
+                                  httplib::Response& res,
+                                  const std::string& username,
+                                  const std::string& session_user) const;
 
     const Configuration config;
-    inja::Environment templates;
+    // Could be null if loadTemplates() is not called.
+    std::unique_ptr<Templates> templates;
     std::unique_ptr<AuthInterface> auth;
     std::unique_ptr<DataSourceInterface> data;
+    std::unique_ptr<SessionCache> session_cache;
+    std::unique_ptr<RenderCache> render_cache;
+    // Pages of weeklies for visitors without a session, keyed by
+    // username.
+    std::unique_ptr<PageCache> page_cache;
+    // Could be null if loadStatics() is not called.
+    std::unique_ptr<StaticFiles> statics;
+    ServerQueueStats queue_stats;
+    std::mutex server_lock;
+    // The server while start() is running.
+    httplib::Server* running_server = nullptr;
 };
@@ -1,7 +1,10 @@
 #include <httplib.h>
+#include <format>
 #include <memory>
+#include <string>
 
 #include <gtest/gtest.h>
+#include <nlohmann/json.hpp>
 
 #include "app.hpp"
 #include "auth.hpp"
@@ -14,6 +17,38 @@
 using ::testing::Return;
 using ::testing::HasSubstr;
 
+namespace
+{
+
+// Read the whole body of a streamed response, and count its chunks.
+std::string readChunked(httplib::Response& res, int* chunks = nullptr)
+{
+    std::string body;
+    bool done = false;
+    httplib::DataSink sink;
+    sink.write = [&](const char* data, size_t size)
+    {
+        body.append(data, size);
+        if(chunks != nullptr)
+        {
+            (*chunks)++;
+        }
+        return true;
+    };
+    sink.done = [&]() { done = true; };
+    while(!done)
+    {
+        if(!res.content_provider_(body.size(), 0, sink))
+        {
+            ADD_FAILURE() << "Streaming failed";
+            break;
+        }
+    }
+    return body;
+}
+
+} // namespace
+
 TEST(App, CopyReqToHttplibReq)
 {
     {
@@ -54,6 +89,33 @@ TEST(App, IndexCanRedirectWhenLoggedIn)
     EXPECT_EQ(res.get_header_value("Location"), app.urlFor("weekly", "mw"));
 }
 
+TEST(App, ValidatedSessionsAreCached)
+{
+    Configuration config;
+    auto auth = std::make_unique<AuthMock>();
+    Tokens expected_tokens;
+    expected_tokens.access_token = "aaa";
+    UserInfo expected_user;
+    expected_user.name = "mw";
+
+    EXPECT_CALL(*auth, getUser(expected_tokens)).WillOnce(Return(expected_user));
+    ASSIGN_OR_FAIL(auto data, DataSourceSqlite::newFromMemory());
+    App app(config, std::move(auth), std::move(data));
+
+    for(int i = 0; i < 2; i++)
+    {
+        httplib::Request http_req;
+        http_req.set_header("Cookie", "access-token=aaa");
+        httplib::Response res;
+        app.handleIndex(http_req, res);
+        EXPECT_EQ(res.status, 302);
+        EXPECT_EQ(res.get_header_value("Location"), app.urlFor("weekly", "mw"));
+    }
+    ASSERT_NE(app.sessionCache(), nullptr);
+    EXPECT_EQ(app.sessionCache()->hits(), 1);
+    EXPECT_EQ(app.sessionCache()->misses(), 1);
+}
+
 TEST(App, IndexCanRedirectWhenNotLoggedIn)
 {
     Configuration config;
@@ -156,3 +218,380 @@ TEST(App, OpenIDRedirectCanHandleUpstreamError)
         EXPECT_EQ(res.status, 500);
     }
 }
+
+TEST(App, WeekliesOfVisitorsAreCached)
+{
+    Configuration config;
+    config.data_dir = NSWEEKLY_SOURCE_DIR;
+    auto auth = std::make_unique<AuthMock>();
+    ASSIGN_OR_FAIL(auto data, DataSourceSqlite::newFromMemory());
+    ASSERT_TRUE(isExpected(data->createUser("mw")));
+    DataSourceSqlite* data_source = data.get();
+    App app(config, std::move(auth), std::move(data));
+    ASSERT_TRUE(isExpected(app.loadTemplates()));
+    ASSERT_NE(app.pageCache(), nullptr);
+
+    for(int i = 0; i < 2; i++)
+    {
+        httplib::Request req;
+        httplib::Response res;
+        app.handleUserWeeklies(req, res, "mw");
+        EXPECT_NE(res.status, 500);
+    }
+    EXPECT_EQ(app.pageCache()->misses(), 1);
+    EXPECT_EQ(app.pageCache()->hits(), 1);
+
+    WeeklyPost p;
+    p.format = WeeklyPost::MARKDOWN;
+    p.raw_content = "aaa";
+    p.week_begin = weekBegin(Clock::now());
+    ASSERT_TRUE(isExpected(data_source->updateWeekly("mw", std::move(p))));
+
+    httplib::Request req;
+    httplib::Response res;
+    app.handleUserWeeklies(req, res, "mw");
+    EXPECT_EQ(app.pageCache()->misses(), 2);
+}
+
+TEST(App, WeekliesCanBeNotModified)
+{
+    Configuration config;
+    config.data_dir = NSWEEKLY_SOURCE_DIR;
+    auto auth = std::make_unique<AuthMock>();
+    ASSIGN_OR_FAIL(auto data, DataSourceSqlite::newFromMemory());
+    ASSERT_TRUE(isExpected(data->createUser("mw")));
+    App app(config, std::move(auth), std::move(data));
+    ASSERT_TRUE(isExpected(app.loadTemplates()));
+
+    httplib::Request req;
+    httplib::Response res;
+    app.handleUserWeeklies(req, res, "mw");
+    std::string etag = res.get_header_value("ETag");
+    std::string last_modified = res.get_header_value("Last-Modified");
+    ASSERT_FALSE(etag.empty());
+    ASSERT_FALSE(last_modified.empty());
+    {
+        httplib::Request req;
+        req.set_header("If-None-Match", "\"something\", " + etag);
+        httplib::Response res;
+        app.handleUserWeeklies(req, res, "mw");
+        EXPECT_EQ(res.status, 304);
+        EXPECT_TRUE(res.body.empty());
+    }
+    {
+        httplib::Request req;
+        req.set_header("If-Modified-Since", last_modified);
+        httplib::Response res;
+        app.handleUserWeeklies(req, res, "mw");
+        EXPECT_EQ(res.status, 304);
+    }
+    {
+        httplib::Request req;
+        req.set_header("If-None-Match", "\"something\"");
+        httplib::Response res;
+        app.handleUserWeeklies(req, res, "mw");
+        EXPECT_NE(res.status, 304);
+        EXPECT_FALSE(res.body.empty());
+    }
+}
+
+TEST(App, WeekliesLinkToOlderPages)
+{
+    Configuration config;
+    config.data_dir = NSWEEKLY_SOURCE_DIR;
+    auto auth = std::make_unique<AuthMock>();
+    ASSIGN_OR_FAIL(auto data, DataSourceSqlite::newFromMemory());
+    ASSERT_TRUE(isExpected(data->createUser("mw")));
+    DataSourceSqlite* data_source = data.get();
+    App app(config, std::move(auth), std::move(data));
+    ASSERT_TRUE(isExpected(app.loadTemplates()));
+
+    {
+        httplib::Request req;
+        httplib::Response res;
+        app.handleUserWeeklies(req, res, "mw");
+        EXPECT_EQ(res.body.find("?before="), std::string::npos);
+    }
+
+    Time old_week = std::chrono::sys_days(std::chrono::January / 3 / 2000);
+    for(int i = 0; i < 3; i++)
+    {
+        WeeklyPost p;
+        p.format = WeeklyPost::MARKDOWN;
+        p.raw_content = "aaa";
+        p.week_begin = old_week + std::chrono::weeks(i);
+        ASSERT_TRUE(isExpected(data_source->updateWeekly("mw", std::move(p))));
+    }
+    {
+        httplib::Request req;
+        httplib::Response res;
+        app.handleUserWeeklies(req, res, "mw");
+        EXPECT_NE(res.body.find("?before="), std::string::npos);
+    }
+    {
+        httplib::Request req;
+        req.params.emplace("before", "2000-01-24");
+        req.params.emplace("limit", "2");
+        httplib::Response res;
+        app.handleUserWeeklies(req, res, "mw");
+        EXPECT_NE(res.status, 500);
+        EXPECT_NE(res.body.find("/weekly/mw?before=2000-01-10"),
+                  std::string::npos);
+    }
+    {
+        httplib::Request req;
+        req.params.emplace("before", "2000-01-10");
+        req.params.emplace("limit", "2");
+        httplib::Response res;
+        app.handleUserWeeklies(req, res, "mw");
+        EXPECT_EQ(res.body.find("?before="), std::string::npos);
+    }
+    {
+        httplib::Request req;
+        req.params.emplace("before", "2000-01-10");
+        req.params.emplace("limit", "many");
+        httplib::Response res;
+        app.handleUserWeeklies(req, res, "mw");
+        EXPECT_EQ(res.status, 400);
+    }
+}
+
+TEST(App, WeekliesCanBeStreamed)
+{
+    Configuration config;
+    config.data_dir = NSWEEKLY_SOURCE_DIR;
+    ASSIGN_OR_FAIL(auto data, DataSourceSqlite::newFromMemory());
+    WeeklyPost p;
+    p.format = WeeklyPost::MARKDOWN;
+    p.raw_content = "aaa";
+    p.week_begin = weekBegin(Clock::now());
+    ASSERT_TRUE(isExpected(data->updateWeekly("mw", std::move(p))));
+    App app(config, std::make_unique<AuthMock>(), std::move(data));
+    ASSERT_TRUE(isExpected(app.loadTemplates()));
+
+    httplib::Request req;
+    req.params.emplace("before", "2100-01-01");
+    httplib::Response whole;
+    app.handleUserWeeklies(req, whole, "mw");
+    ASSERT_FALSE(whole.body.empty());
+
+    config.stream_pages = true;
+    ASSIGN_OR_FAIL(data, DataSourceSqlite::newFromMemory());
+    p.raw_content = "aaa";
+    ASSERT_TRUE(isExpected(data->updateWeekly("mw", std::move(p))));
+    App streaming_app(config, std::make_unique<AuthMock>(), std::move(data));
+    ASSERT_TRUE(isExpected(streaming_app.loadTemplates()));
+    httplib::Response res;
+    streaming_app.handleUserWeeklies(req, res, "mw");
+    ASSERT_TRUE(res.is_chunked_content_provider_);
+
+    int chunks = 0;
+    std::string body = readChunked(res, &chunks);
+    // The beginning, the weekly and the end.
+    EXPECT_EQ(chunks, 3);
+    EXPECT_EQ(body, whole.body);
+}
+
+TEST(App, CanExportWeekliesAsJSON)
+{
+    Configuration config;
+    config.data_dir = NSWEEKLY_SOURCE_DIR;
+    ASSIGN_OR_FAIL(auto data, DataSourceSqlite::newFromMemory());
+    Time week = std::chrono::sys_days(std::chrono::January / 3 / 2000);
+    for(int i = 0; i < 3; i++)
+    {
+        WeeklyPost p;
+        p.format = WeeklyPost::MARKDOWN;
+        p.raw_content = std::format("weekly \"{}\"\n", i);
+        p.week_begin = week + std::chrono::weeks(i);
+        p.language = "en";
+        ASSERT_TRUE(isExpected(data->updateWeekly("mw", std::move(p))));
+    }
+    App app(config, std::make_unique<AuthMock>(), std::move(data));
+
+    {
+        httplib::Request req;
+        httplib::Response res;
+        app.handleAPIWeeklies(req, res, "mw");
+        nlohmann::json json = nlohmann::json::parse(readChunked(res));
+        EXPECT_EQ(json["username"], "mw");
+        ASSERT_EQ(json["weeklies"].size(), 3);
+        EXPECT_EQ(json["weeklies"][0]["markdown"], "weekly \"2\"\n");
+        EXPECT_EQ(json["weeklies"][2]["week_begin"], "2000-01-03");
+        EXPECT_EQ(json["weeklies"][2]["week_end"], "2000-01-09");
+        EXPECT_EQ(json["weeklies"][2]["format"], "markdown");
+        EXPECT_EQ(json["weeklies"][2]["author"], "mw");
+    }
+    {
+        httplib::Request req;
+        req.params.emplace("before", "2000-01-17");
+        req.params.emplace("limit", "1");
+        httplib::Response res;
+        app.handleAPIWeeklies(req, res, "mw");
+        nlohmann::json json = nlohmann::json::parse(readChunked(res));
+        ASSERT_EQ(json["weeklies"].size(), 1);
+        EXPECT_EQ(json["weeklies"][0]["markdown"], "weekly \"1\"\n");
+    }
+    {
+        httplib::Request req;
+        httplib::Response res;
+        app.handleAPIWeeklies(req, res, "nobody");
+        EXPECT_EQ(res.status, 404);
+    }
+    {
+        httplib::Request req;
+        httplib::Response res;
+        // Any day in the week.
+        app.handleAPIWeekly(req, res, "mw",
+                            week + std::chrono::weeks(1) + std::chrono::days(2));
+        nlohmann::json json = nlohmann::json::parse(res.body);
+        EXPECT_EQ(json["markdown"], "weekly \"1\"\n");
+        EXPECT_TRUE(json.contains("html"));
+    }
+    {
+        httplib::Request req;
+        httplib::Response res;
+        app.handleAPIWeekly(req, res, "mw", week - std::chrono::weeks(1));
+        EXPECT_EQ(res.status, 404);
+    }
+    {
+        httplib::Request req;
+        httplib::Response res;
+        app.handleAPIWeekly(req, res, "nobody", week);
+        EXPECT_EQ(res.status, 404);
+    }
+}
+
+TEST(App, CanImportWeeklies)
+{
+    Configuration config;
+    config.data_dir = NSWEEKLY_SOURCE_DIR;
+    config.import_token = "secret";
+    ASSIGN_OR_FAIL(auto data, DataSourceSqlite::newFromMemory());
+    App app(config, std::make_unique<AuthMock>(), std::move(data));
+    // Weeklies exported by the API, as NDJSON.
+    std::string body =
+        R"({"author":"mw","week_begin":"2000-01-03","week_end":"2000-01-09",)"
+        R"("update_time":"2000-01-04T00:00:00Z","language":"en",)"
+        R"("format":"markdown","markdown":"a\n","html":"<p>a</p>\n"})" "\n"
+        R"({"author":"mw","week_begin":"2000-01-10","markdown":"b\n"})" "\n";
+    // Send the body in small pieces, as a slow client would.
+    httplib::ContentReader reader(
+        [&](httplib::ContentReceiver receiver)
+        {
+            for(size_t i = 0; i < body.size(); i += 10)
+            {
+                std::string_view piece = std::string_view(body).substr(i, 10);
+                if(!receiver(piece.data(), piece.size()))
+                {
+                    return false;
+                }
+            }
+            return true;
+        }, nullptr);
+
+    {
+        httplib::Request req;
+        httplib::Response res;
+        app.handleImport(req, res, reader);
+        EXPECT_EQ(res.status, 401);
+        req.set_header("Authorization", "Bearer secrets");
+        app.handleImport(req, res, reader);
+        EXPECT_EQ(res.status, 401);
+    }
+    {
+        httplib::Request req;
+        req.set_header("Authorization", "Bearer secret");
+        httplib::Response res;
+        app.handleImport(req, res, reader);
+        EXPECT_NE(res.status, 400);
+        EXPECT_NE(res.status, 500);
+        nlohmann::json json = nlohmann::json::parse(res.body);
+        EXPECT_EQ(json["weeklies"], 2);
+    }
+    {
+        httplib::Request req;
+        httplib::Response res;
+        app.handleAPIWeekly(req, res, "mw", std::chrono::sys_days(
+                                std::chrono::January / 3 / 2000));
+        nlohmann::json json = nlohmann::json::parse(res.body);
+        EXPECT_EQ(json["markdown"], "a\n");
+        EXPECT_EQ(json["update_time"], "2000-01-04T00:00:00Z");
+    }
+
+    body = R"({"author":"mw","week_begin":"2000-01-04","markdown":""})";
+    {
+        httplib::Request req;
+        req.set_header("Authorization", "Bearer secret");
+        httplib::Response res;
+        app.handleImport(req, res, reader);
+        EXPECT_EQ(res.status, 400);
+        EXPECT_THAT(res.body, HasSubstr("Line 1"));
+    }
+
+    config.import_token.clear();
+    ASSIGN_OR_FAIL(data, DataSourceSqlite::newFromMemory());
+    App disabled(config, std::make_unique<AuthMock>(), std::move(data));
+    {
+        httplib::Request req;
+        req.set_header("Authorization", "Bearer ");
+        httplib::Response res;
+        disabled.handleImport(req, res, reader);
+        EXPECT_EQ(res.status, 404);
+    }
+}
+
+TEST(App, StaticFilesHaveVersionedURLs)
+{
+    Configuration config;
+    config.data_dir = NSWEEKLY_SOURCE_DIR;
+    auto auth = std::make_unique<AuthMock>();
+    ASSIGN_OR_FAIL(auto data, DataSourceSqlite::newFromMemory());
+    App app(config, std::move(auth), std::move(data));
+    ASSERT_TRUE(isExpected(app.loadStatics()));
+
+    std::string url = app.urlFor("statics", "style.css");
+    ASSERT_TRUE(url.starts_with("/statics/"));
+    ASSERT_NE(url, "/statics/style.css");
+    {
+        httplib::Request req;
+        httplib::Response res;
+        app.handleStatic(req, res, url.substr(std::string("/statics/").size()));
+        EXPECT_NE(res.status, 404);
+        EXPECT_THAT(res.get_header_value("Cache-Control"),
+                    HasSubstr("immutable"));
+        EXPECT_FALSE(res.body.empty());
+    }
+    {
+        httplib::Request req;
+        httplib::Response res;
+        app.handleStatic(req, res, "style.css");
+        EXPECT_NE(res.status, 404);
+        EXPECT_EQ(res.get_header_value("Cache-Control"), "no-cache");
+    }
+    {
+        httplib::Request req;
+        httplib::Response res;
+        app.handleStatic(req, res, "nonexistent.css");
+        EXPECT_EQ(res.status, 404);
+    }
+}
+
+TEST(App, CanExportMetrics)
+{
+    Configuration config;
+    auto auth = std::make_unique<AuthMock>();
+    ASSIGN_OR_FAIL(auto data, DataSourceSqlite::newFromMemory());
+    ASSERT_TRUE(isExpected(data->createUser("mw")));
+    App app(config, std::move(auth), std::move(data));
+
+    httplib::Response res;
+    app.handleMetrics(res);
+    EXPECT_EQ(res.get_header_value("Content-Type"),
+              "text/plain; version=0.0.4");
+    EXPECT_THAT(res.body, HasSubstr("nsweekly_server_queued_connections 0\n"));
+    // Creating the user evaluated SQL.
+    EXPECT_THAT(res.body,
+                HasSubstr("# TYPE nsweekly_sqlite_eval_duration_seconds "
+                          "histogram\n"));
+}
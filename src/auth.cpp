@@ -1,5 +1,7 @@
+#include <algorithm>
 #include <chrono>
 #include <memory>
+#include <mutex>
 #include <expected>
 #include <string>
 #include <string_view>
@@ -11,9 +13,26 @@
 #include "config.hpp"
 #include "error.hpp"
 #include "http_client.hpp"
+#include "jwt.hpp"
+#include "metrics.hpp"
+#include "trace.hpp"
 #include "utils.hpp"
 #include "spdlog/spdlog.h"
 
+namespace
+{
+
+// Time of the requests to an endpoint of the OpenID Connect service.
+Histogram& upstreamLatency(const std::string& endpoint)
+{
+    return Metrics::global().histogram(
+        "nsweekly_openid_request_duration_seconds",
+        "Time of requests to the OpenID Connect service.",
+        {{"endpoint", endpoint}});
+}
+
+} // namespace
+
 E<std::string> getStrProperty(
     const nlohmann::json& json_dict, std::string_view property)
 {
@@ -40,6 +59,21 @@ E<int> getIntProperty(
     }
 }
 
+E<UserInfo> userFromClaims(const nlohmann::json& data)
+{
+    UserInfo user;
+    ASSIGN_OR_RETURN(user.id, getStrProperty(data, "sub"));
+    if(data.contains("name"))
+    {
+        ASSIGN_OR_RETURN(user.name, getStrProperty(data, "name"));
+    }
+    else if(data.contains("preferred_username"))
+    {
+        ASSIGN_OR_RETURN(user.name, getStrProperty(data, "preferred_username"));
+    }
+    return user;
+}
+
 E<Tokens> tokensFromResponse(const HTTPResponse& res)
 {
     nlohmann::json data = parseJSON(res.payloadAsStr());
@@ -106,13 +140,13 @@ E<std::unique_ptr<AuthOpenIDConnect>> AuthOpenIDConnect::create(
     }
 
     std::string url = std::move(prefix) + "/.well-known/openid-configuration";
-    E<const HTTPResponse*> result = http->get(url);
+    E<HTTPResponse> result = http->get(url);
     if(!result.has_value())
     {
         return std::unexpected(result.error());
     }
 
-    const HTTPResponse& res = **result;
+    const HTTPResponse& res = *result;
     nlohmann::json data = parseJSON(res.payload);
     if(data.is_discarded())
     {
@@ -130,9 +164,119 @@ E<std::unique_ptr<AuthOpenIDConnect>> AuthOpenIDConnect::create(
                      getStrProperty(data, "introspection_endpoint"));
     ASSIGN_OR_RETURN(auth->endpoint_user_info,
                      getStrProperty(data, "userinfo_endpoint"));
+    if(config.openid_local_verify)
+    {
+        ASSIGN_OR_RETURN(auth->issuer, getStrProperty(data, "issuer"));
+        ASSIGN_OR_RETURN(auth->endpoint_jwks, getStrProperty(data, "jwks_uri"));
+        DO_OR_RETURN(auth->refreshKeys(true));
+    }
     return auth;
 }
 
+E<std::shared_ptr<const JWKS>> AuthOpenIDConnect::refreshKeys(bool force) const
+{
+    Span span("AuthOpenIDConnect::refreshKeys");
+    // Do not let tokens with made-up key IDs make us download the
+    // keys on every request.
+    constexpr auto min_interval = std::chrono::seconds(60);
+
+    std::lock_guard<std::mutex> refresh_lock(keys_refresh_lock);
+    {
+        std::lock_guard<std::mutex> lock(keys_lock);
+        if(!force && keys_update_time.has_value() &&
+           Clock::now() - *keys_update_time < min_interval)
+        {
+            return keys;
+        }
+    }
+
+    spdlog::debug("Downloading signing keys from {}...", endpoint_jwks);
+    static Histogram& latency = upstreamLatency("jwks");
+    ScopedTimer timer(latency);
+    ASSIGN_OR_RETURN(HTTPResponse res, http_client->get(endpoint_jwks));
+    if(res.status != 200)
+    {
+        return std::unexpected(httpError(res.status, res.payloadAsStr()));
+    }
+    ASSIGN_OR_RETURN(JWKS new_keys, JWKS::fromJSON(res.payloadAsStr()));
+    auto result = std::make_shared<const JWKS>(std::move(new_keys));
+    std::lock_guard<std::mutex> lock(keys_lock);
+    keys = result;
+    keys_update_time = Clock::now();
+    return result;
+}
+
+E<UserInfo> AuthOpenIDConnect::verifyAccessToken(const std::string& token) const
+{
+    Span span("AuthOpenIDConnect::verifyAccessToken");
+    ASSIGN_OR_RETURN(JWT jwt, JWT::parse(token));
+    std::shared_ptr<const JWKS> current_keys;
+    {
+        std::lock_guard<std::mutex> lock(keys_lock);
+        current_keys = keys;
+    }
+    EVP_PKEY* key = nullptr;
+    if(current_keys != nullptr)
+    {
+        key = current_keys->key(jwt.kid);
+    }
+    if(key == nullptr)
+    {
+        // The service could have rotated its keys.
+        ASSIGN_OR_RETURN(current_keys, refreshKeys(false));
+        key = current_keys->key(jwt.kid);
+        if(key == nullptr)
+        {
+            return std::unexpected(runtimeError(std::format(
+                "Unknown signing key: {}", jwt.kid)));
+        }
+    }
+    DO_OR_RETURN(jwt.verify(key));
+
+    const nlohmann::json& claims = jwt.claims;
+    if(!claims.contains("exp") || !claims["exp"].is_number())
+    {
+        return std::unexpected(runtimeError("Token has no expiration"));
+    }
+    int64_t now = timeToSeconds(Clock::now());
+    if(claims["exp"].get<int64_t>() <= now)
+    {
+        return std::unexpected(runtimeError("Token expired"));
+    }
+    if(claims.contains("nbf") && claims["nbf"].is_number() &&
+       claims["nbf"].get<int64_t>() > now)
+    {
+        return std::unexpected(runtimeError("Token not valid yet"));
+    }
+    if(!claims.contains("iss") || claims["iss"] != issuer)
+    {
+        return std::unexpected(runtimeError("Token has wrong issuer"));
+    }
+
+    // The audience could be a string or an array of strings.
+    const std::string& audience = config.openid_audience.empty() ?
+        config.client_id : config.openid_audience;
+    bool audience_ok = false;
+    if(claims.contains("aud"))
+    {
+        const nlohmann::json& aud = claims["aud"];
+        if(aud.is_string())
+        {
+            audience_ok = aud == audience;
+        }
+        else if(aud.is_array())
+        {
+            audience_ok = std::find(std::begin(aud), std::end(aud), audience)
+                != std::end(aud);
+        }
+    }
+    if(!audience_ok)
+    {
+        return std::unexpected(runtimeError("Token has wrong audience"));
+    }
+    return userFromClaims(claims);
+}
+
 std::string AuthOpenIDConnect::initialURL() const
 {
     return std::format(
@@ -142,12 +286,12 @@ std::string AuthOpenIDConnect::initialURL() const
 
 E<HTTPResponse> AuthOpenIDConnect::initiate() const
 {
-    E<const HTTPResponse*> res = http_client->get(initialURL());
-    return res.transform([](const auto* r) { return *r; });
+    return http_client->get(initialURL());
 }
 
 E<Tokens> AuthOpenIDConnect::authenticate(std::string_view code) const
 {
+    Span span("AuthOpenIDConnect::authenticate");
     // TODO: support client with public access type (no client
     // secret).
     std::string payload = std::format(
@@ -155,48 +299,52 @@ E<Tokens> AuthOpenIDConnect::authenticate(std::string_view code) const
         "&client_id={}&client_secret={}",
         urlEncode(code), urlEncode(redirection_url),
         urlEncode(config.client_id), urlEncode(config.client_secret));
-    ASSIGN_OR_RETURN(const HTTPResponse* res, http_client->post(
+    static Histogram& latency = upstreamLatency("token");
+    ScopedTimer timer(latency);
+    ASSIGN_OR_RETURN(HTTPResponse res, http_client->post(
         HTTPRequest(endpoint_token).setPayload(payload)
         .addHeader("Content-Type", "application/x-www-form-urlencoded")
         .addHeader("Authorization", std::string("Basic ") +
                    urlEncode(config.client_secret))));
 
-    if(res->status != 200)
+    if(res.status != 200)
     {
         return std::unexpected(
-            httpError(res->status, res->payloadAsStr()));
+            httpError(res.status, res.payloadAsStr()));
     }
-    return tokensFromResponse(*res);
+    return tokensFromResponse(res);
 }
 
 E<UserInfo> AuthOpenIDConnect::getUser(const Tokens& tokens) const
 {
-    ASSIGN_OR_RETURN(const HTTPResponse* res, http_client->get(
+    if(config.openid_local_verify)
+    {
+        return verifyAccessToken(tokens.access_token);
+    }
+    return getUserFromServer(tokens);
+}
+
+E<UserInfo> AuthOpenIDConnect::getUserFromServer(const Tokens& tokens) const
+{
+    Span span("AuthOpenIDConnect::getUserFromServer");
+    static Histogram& latency = upstreamLatency("userinfo");
+    ScopedTimer timer(latency);
+    ASSIGN_OR_RETURN(HTTPResponse res, http_client->get(
         HTTPRequest(endpoint_user_info).addHeader(
             "Authorization", std::string("Bearer ") +
             urlEncode(tokens.access_token))));
 
-    nlohmann::json data = parseJSON(res->payloadAsStr());
+    nlohmann::json data = parseJSON(res.payloadAsStr());
     if(data.is_discarded())
     {
         return std::unexpected(runtimeError("Invalid user info response"));
     }
-
-    UserInfo user;
-    ASSIGN_OR_RETURN(user.id, getStrProperty(data, "sub"));
-    if(data.contains("name"))
-    {
-        ASSIGN_OR_RETURN(user.name, getStrProperty(data, "name"));
-    }
-    else if(data.contains("preferred_username"))
-    {
-        ASSIGN_OR_RETURN(user.name, getStrProperty(data, "preferred_username"));
-    }
-    return user;
+    return userFromClaims(data);
 }
 
 E<Tokens> AuthOpenIDConnect::refreshTokens(std::string_view refresh_token) const
 {
+    Span span("AuthOpenIDConnect::refreshTokens");
     std::string token_payload = std::format(
         "client_id={}"
         "&client_secret={}"
@@ -205,11 +353,13 @@ E<Tokens> AuthOpenIDConnect::refreshTokens(std::string_view refresh_token) const
         "&scope=openid%20profile",
         urlEncode(config.client_id), urlEncode(config.client_secret),
         urlEncode(refresh_token));
-    ASSIGN_OR_RETURN(const HTTPResponse* res, http_client->post(
+    static Histogram& latency = upstreamLatency("token");
+    ScopedTimer timer(latency);
+    ASSIGN_OR_RETURN(HTTPResponse res, http_client->post(
         HTTPRequest(endpoint_token)
         .addHeader("Authorization", std::string("Basic ") +
                    urlEncode(config.client_secret))
         .setContentType("application/x-www-form-urlencoded")
         .setPayload(std::move(token_payload))));
-    return tokensFromResponse(*res);
+    return tokensFromResponse(res);
 }
@@ -3,11 +3,13 @@
 #include <chrono>
 #include <string>
 #include <memory>
+#include <mutex>
 #include <optional>
 
 #include "error.hpp"
 #include "http_client.hpp"
 #include "config.hpp"
+#include "jwt.hpp"
 #include "utils.hpp"
 
 struct Tokens
@@ -41,6 +43,12 @@ public:
 };
 
 // Authenticate against an OpenID Connect service.
+//
+// If openid_local_verify is set in the configuration, access tokens
+// are expected to be JWTs, and getUser() verifies them locally with
+// the signing keys of the service, instead of asking the user info
+// endpoint. The keys are downloaded when the object is created, and
+// again when a token is signed by a key we do not know.
 class AuthOpenIDConnect : public AuthInterface
 {
 public:
@@ -50,8 +58,9 @@ public:
             : redirection_url(redirect_url), http_client(std::move(http)),
               config(conf) {}
 
-    // This will get metadata from $prefix/.well-known. The returned
-    // pointer will never be null.
+    // This will get metadata from $prefix/.well-known, and the signing
+    // keys if local verification is enabled. The returned pointer
+    // will never be null.
     static E<std::unique_ptr<AuthOpenIDConnect>> create(
         const Configuration& config, std::string_view redirect_url,
         std::unique_ptr<HTTPSessionInterface> http);
@@ -69,11 +78,26 @@ public:
     E<Tokens> refreshTokens(std::string_view refresh_token) const override;
 
 private:
+    E<UserInfo> getUserFromServer(const Tokens& tokens) const;
+    E<UserInfo> verifyAccessToken(const std::string& token) const;
+    // Download the signing keys. Unless force is true, this does
+    // nothing if the keys were downloaded recently.
+    E<std::shared_ptr<const JWKS>> refreshKeys(bool force) const;
+
+    std::string issuer;
     std::string endpoint_auth;
     std::string endpoint_token;
     std::string endpoint_introspect;
     std::string endpoint_end_session;
     std::string endpoint_user_info;
+    std::string endpoint_jwks;
+
+    mutable std::mutex keys_lock;
+    mutable std::shared_ptr<const JWKS> keys;
+    mutable std::optional<Time> keys_update_time;
+    // Held while downloading the keys, so that concurrent requests
+    // with an unknown key ID only download once.
+    mutable std::mutex keys_refresh_lock;
 
     const std::string redirection_url;
     std::unique_ptr<HTTPSessionInterface> http_client;
@@ -10,6 +10,7 @@
 #include "auth.hpp"
 #include "http_client.hpp"
 #include "http_client_mock.hpp"
+#include "test_keys.hpp"
 
 using ::testing::Return;
 
@@ -41,7 +42,7 @@ TEST(Auth, CanInitiate)
 
     EXPECT_CALL(
         *http, get(HTTPRequest("https://example.com/.well-known/openid-configuration")))
-        .WillOnce(Return(&res_conf));
+        .WillOnce(Return(res_conf));
 
     HTTPResponse res_code(200, "Some login page");
     EXPECT_CALL(*http, get(
@@ -49,7 +50,7 @@ TEST(Auth, CanInitiate)
                                 "&client_id=client%20id"
                                 "&redirect_uri=http%3A%2F%2Flocalhost%2F"
                                 "&scope=openid%20profile")))
-        .WillOnce(Return(&res_code));
+        .WillOnce(Return(res_code));
 
     Configuration config;
     config.client_id = "client id";
@@ -70,7 +71,7 @@ TEST(Auth, CreateCanHandleServerConfError)
     HTTPResponse res_conf(500, "");
     EXPECT_CALL(
         *http, get(HTTPRequest("https://example.com/.well-known/openid-configuration")))
-        .WillOnce(Return(&res_conf));
+        .WillOnce(Return(res_conf));
 
     Configuration config;
     config.client_id = "client id";
@@ -89,7 +90,7 @@ TEST(Auth, CreateCanHandleInvalidJSON)
     HTTPResponse res_conf(200, "invalid json");
     EXPECT_CALL(
         *http, get(HTTPRequest("https://example.com/.well-known/openid-configuration")))
-        .WillOnce(Return(&res_conf));
+        .WillOnce(Return(res_conf));
 
     Configuration config;
     config.client_id = "client id";
@@ -135,7 +136,7 @@ TEST(Auth, InitiateJustPropagateServerError)
 
     EXPECT_CALL(
         *http, get(HTTPRequest("https://example.com/.well-known/openid-configuration")))
-        .WillOnce(Return(&res_conf));
+        .WillOnce(Return(res_conf));
 
     HTTPResponse res_code(500, "");
     EXPECT_CALL(*http, get(
@@ -144,7 +145,7 @@ TEST(Auth, InitiateJustPropagateServerError)
                         "&client_id=client%20id"
                         "&redirect_uri=http%3A%2F%2Flocalhost%2F"
                         "&scope=openid%20profile")))
-        .WillOnce(Return(&res_code));
+        .WillOnce(Return(res_code));
 
     Configuration config;
     config.client_id = "client id";
@@ -174,7 +175,7 @@ TEST(Auth, CanGetTokens)
 
     EXPECT_CALL(
         *http, get(HTTPRequest("https://example.com/.well-known/openid-configuration")))
-        .WillOnce(Return(&res_conf));
+        .WillOnce(Return(res_conf));
 
     HTTPResponse res_token(200, R"(
  {
@@ -194,7 +195,7 @@ TEST(Auth, CanGetTokens)
                                 "&client_secret=client%20secret")
                     .addHeader("Content-Type", "application/x-www-form-urlencoded")
                     .addHeader("Authorization", "Basic client%20secret")))
-        .WillOnce(Return(&res_token));
+        .WillOnce(Return(res_token));
 
     Configuration config;
     config.client_id = "client id";
@@ -227,7 +228,7 @@ TEST(Auth, AuthenticateCanHandleFailedQuery)
 
     EXPECT_CALL(
         *http, get(HTTPRequest("https://example.com/.well-known/openid-configuration")))
-        .WillOnce(Return(&res_conf));
+        .WillOnce(Return(res_conf));
 
     HTTPResponse res_token(500, "");
     EXPECT_CALL(*http, post(HTTPRequest("https://example.com/token")
@@ -237,7 +238,7 @@ TEST(Auth, AuthenticateCanHandleFailedQuery)
                                         "&client_secret=client%20secret")
                             .addHeader("Content-Type", "application/x-www-form-urlencoded")
                             .addHeader("Authorization", "Basic client%20secret")))
-        .WillOnce(Return(&res_token));
+        .WillOnce(Return(res_token));
 
     Configuration config;
     config.client_id = "client id";
@@ -268,7 +269,7 @@ TEST(Auth, AuthenticateCanHandleServerFault)
 
     EXPECT_CALL(
         *http, get(HTTPRequest("https://example.com/.well-known/openid-configuration")))
-        .WillOnce(Return(&res_conf));
+        .WillOnce(Return(res_conf));
 
     EXPECT_CALL(*http, post(HTTPRequest("https://example.com/token")
                             .setPayload("grant_type=authorization_code&code=some%20code"
@@ -307,7 +308,7 @@ TEST(Auth, AuthenticateCanHandleInvalidJSON)
 
     EXPECT_CALL(
         *http, get(HTTPRequest("https://example.com/.well-known/openid-configuration")))
-        .WillOnce(Return(&res_conf));
+        .WillOnce(Return(res_conf));
 
     HTTPResponse res_token(200, "invalid json");
     EXPECT_CALL(*http, post(HTTPRequest("https://example.com/token")
@@ -317,7 +318,7 @@ TEST(Auth, AuthenticateCanHandleInvalidJSON)
                                         "&client_secret=client%20secret")
                             .addHeader("Content-Type", "application/x-www-form-urlencoded")
                             .addHeader("Authorization", "Basic client%20secret")))
-        .WillOnce(Return(&res_token));
+        .WillOnce(Return(res_token));
 
     Configuration config;
     config.client_id = "client id";
@@ -347,7 +348,7 @@ TEST(Auth, CanRefreshTokens)
 
     EXPECT_CALL(
         *http, get(HTTPRequest("https://example.com/.well-known/openid-configuration")))
-        .WillOnce(Return(&res_conf));
+        .WillOnce(Return(res_conf));
 
     HTTPResponse res_token(200, R"(
  {
@@ -367,7 +368,7 @@ TEST(Auth, CanRefreshTokens)
                                 "&scope=openid%20profile")
                     .addHeader("Content-Type", "application/x-www-form-urlencoded")
                     .addHeader("Authorization", "Basic client%20secret")))
-        .WillOnce(Return(&res_token));
+        .WillOnce(Return(res_token));
 
     Configuration config;
     config.client_id = "client id";
@@ -384,3 +385,73 @@ TEST(Auth, CanRefreshTokens)
     using namespace std::literals;
     EXPECT_LT(std::chrono::abs(*(tokens->expiration) - (Clock::now() + 1h)), 1s);
 }
+
+TEST(Auth, CanVerifyAccessTokenLocally)
+{
+    TestKey key = TestKey::rsa();
+    auto http = std::make_unique<HTTPSessionMock>();
+    HTTPResponse res_conf(200, R"(
+{
+    "issuer": "https://example.com",
+    "authorization_endpoint": "https://example.com/auth",
+    "token_endpoint": "https://example.com/token",
+    "introspection_endpoint": "https://example.com/token/introspect",
+    "userinfo_endpoint": "https://example.com/userinfo",
+    "jwks_uri": "https://example.com/certs",
+    "end_session_endpoint": "https://example.com/logout"
+}
+)");
+    EXPECT_CALL(
+        *http, get(HTTPRequest("https://example.com/.well-known/openid-configuration")))
+        .WillOnce(Return(res_conf));
+    nlohmann::json jwks{{"keys", {key.jwk("key1")}}};
+    HTTPResponse res_keys(200, jwks.dump());
+    // The keys are downloaded once. A token with an unknown key ID
+    // right after that does not download them again.
+    EXPECT_CALL(*http, get(HTTPRequest("https://example.com/certs")))
+        .WillOnce(Return(res_keys));
+
+    Configuration config;
+    config.client_id = "client id";
+    config.openid_url_prefix = "https://example.com/";
+    config.openid_local_verify = true;
+
+    auto auth = AuthOpenIDConnect::create(
+        config, "http://localhost/", std::move(http));
+    ASSERT_TRUE(auth.has_value());
+
+    int64_t exp = timeToSeconds(Clock::now()) + 300;
+    nlohmann::json claims{{"iss", "https://example.com"},
+                          {"aud", {"account", "client id"}},
+                          {"sub", "123"},
+                          {"preferred_username", "mw"},
+                          {"exp", exp}};
+    Tokens tokens;
+    tokens.access_token = key.sign("key1", claims);
+    E<UserInfo> user = (*auth)->getUser(tokens);
+    ASSERT_TRUE(user.has_value());
+    EXPECT_EQ(user->id, "123");
+    EXPECT_EQ(user->name, "mw");
+
+    // Expired
+    nlohmann::json expired = claims;
+    expired["exp"] = exp - 600;
+    tokens.access_token = key.sign("key1", expired);
+    EXPECT_FALSE((*auth)->getUser(tokens).has_value());
+
+    // Wrong audience
+    nlohmann::json other_aud = claims;
+    other_aud["aud"] = "someone else";
+    tokens.access_token = key.sign("key1", other_aud);
+    EXPECT_FALSE((*auth)->getUser(tokens).has_value());
+
+    // Wrong issuer
+    nlohmann::json other_iss = claims;
+    other_iss["iss"] = "https://example.org";
+    tokens.access_token = key.sign("key1", other_iss);
+    EXPECT_FALSE((*auth)->getUser(tokens).has_value());
+
+    // Unknown key
+    tokens.access_token = TestKey::rsa().sign("key2", claims);
+    EXPECT_FALSE((*auth)->getUser(tokens).has_value());
+}
@@ -0,0 +1,361 @@
+// Microbenchmarks of the hot paths. Build in Release, and compare the
+// JSON results of two commits with tools/compare.py from Google
+// Benchmark. The inputs are generated with fixed seeds, so that runs
+// are comparable.
+
+#include <chrono>
+#include <filesystem>
+#include <format>
+#include <memory>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+#include <nlohmann/json.hpp>
+
+#include "app.hpp"
+#include "data.hpp"
+#include "database.hpp"
+#include "generate.hpp"
+#include "templates.hpp"
+#include "utils.hpp"
+#include "weekly.hpp"
+
+namespace
+{
+
+using namespace std::chrono_literals;
+
+// A Monday, so that the weeks line up with weekBegin().
+const Time BENCH_NOW = std::chrono::sys_days(
+    std::chrono::year(2024) / std::chrono::January / 1);
+
+// A weekly that looks like a real one, with about paragraphs * 300
+// bytes of Markdown.
+std::string makePost(int paragraphs, std::mt19937& rng)
+{
+    static const std::vector<std::string_view> words = {
+        "review", "design", "meeting", "deploy", "fix", "latency",
+        "database", "migration", "team", "customer", "report", "test",
+        "release", "planning", "incident", "followup", "refactor", "docs",
+    };
+    std::uniform_int_distribution<size_t> word(0, words.size() - 1);
+    auto sentence = [&](int n)
+    {
+        std::string result;
+        for(int i = 0; i < n; i++)
+        {
+            if(i > 0)
+            {
+                result += ' ';
+            }
+            result += words[word(rng)];
+        }
+        return result;
+    };
+
+    std::string post;
+    for(int i = 0; i < paragraphs; i++)
+    {
+        switch(i % 4)
+        {
+        case 0:
+            post += std::format("## {}\n\n", sentence(3));
+            break;
+        case 1:
+            for(int j = 0; j < 4; j++)
+            {
+                post += std::format("- {} [link](https://example.com/{})\n",
+                                    sentence(6), j);
+            }
+            post += "\n";
+            break;
+        case 2:
+            post += std::format("```\n{}\n{}\n```\n\n", sentence(5),
+                                sentence(5));
+            break;
+        default:
+            post += std::format("{} *{}* `{}` {}.\n\n", sentence(20),
+                                sentence(2), sentence(1), sentence(15));
+        }
+    }
+    return post;
+}
+
+WeeklyPost makeWeekly(const std::string& author, const Time& week_begin,
+                      std::mt19937& rng)
+{
+    WeeklyPost p;
+    p.format = WeeklyPost::MARKDOWN;
+    p.raw_content = makePost(8, rng);
+    p.week_begin = week_begin;
+    p.update_time = week_begin + 4 * 24h;
+    p.language = "en";
+    p.author = author;
+    return p;
+}
+
+// An in-memory database with the users, each with two years of
+// weeklies.
+std::unique_ptr<DataSourceSqlite> makeDataSource(int users)
+{
+    auto data = DataSourceSqlite::newFromMemory();
+    if(!data.has_value())
+    {
+        return nullptr;
+    }
+    std::mt19937 rng(1);
+    for(int u = 0; u < users; u++)
+    {
+        std::string name = std::format("user{}", u);
+        for(int week = 0; week < 104; week++)
+        {
+            WeeklyPost p = makeWeekly(name, BENCH_NOW - week * 7 * 24h, rng);
+            if(!(*data)->updateWeekly(name, std::move(p)).has_value())
+            {
+                return nullptr;
+            }
+        }
+    }
+    return *std::move(data);
+}
+
+void BM_GetWeeklies(benchmark::State& state)
+{
+    std::unique_ptr<DataSourceSqlite> data = makeDataSource(state.range(0));
+    if(data == nullptr)
+    {
+        state.SkipWithError("Failed to create the database");
+        return;
+    }
+    for(auto _: state)
+    {
+        auto weeklies = data->getWeekliesOneYear("user0", BENCH_NOW);
+        benchmark::DoNotOptimize(weeklies);
+    }
+}
+BENCHMARK(BM_GetWeeklies)->Arg(1)->Arg(16)->Arg(256)
+    ->Unit(benchmark::kMicrosecond);
+
+// The storage profiles of the benchmarks on database files. 0 is the
+// defaults of SQLite, and 1 is the profile suggested in the README.
+SQLiteSettings storageProfile(int64_t profile)
+{
+    SQLiteSettings settings;
+    if(profile == 1)
+    {
+        settings.journal_mode = "wal";
+        settings.synchronous = "normal";
+        settings.temp_store = "memory";
+        settings.mmap_size = 256 * 1024 * 1024;
+        settings.cache_size = -64 * 1024;
+        settings.busy_timeout = 5000;
+    }
+    return settings;
+}
+
+// A database file generated by generateWeeklies(), which is deleted
+// with the object.
+class BenchDatabaseFile
+{
+public:
+    BenchDatabaseFile(int64_t profile, size_t read_connections)
+            : path((std::filesystem::temp_directory_path() /
+                    "nsweekly-bench.db").string())
+    {
+        remove();
+        auto source = DataSourceSqlite::fromFile(
+            path, read_connections, storageProfile(profile));
+        if(!source.has_value())
+        {
+            return;
+        }
+        GenerateOptions options;
+        options.users = 16;
+        options.years = 2;
+        options.now = BENCH_NOW;
+        if(generateWeeklies(**source, options).has_value())
+        {
+            data = *std::move(source);
+        }
+    }
+    ~BenchDatabaseFile()
+    {
+        data.reset();
+        remove();
+    }
+
+    // Null if the file could not be generated.
+    std::unique_ptr<DataSourceSqlite> data;
+
+private:
+    void remove()
+    {
+        for(const char* suffix: {"", "-wal", "-shm"})
+        {
+            std::filesystem::remove(path + suffix);
+        }
+    }
+
+    const std::string path;
+};
+
+// Saving a weekly, which is bound by syncing the file.
+void BM_FileUpdateWeekly(benchmark::State& state)
+{
+    BenchDatabaseFile file(state.range(0), 0);
+    if(file.data == nullptr)
+    {
+        state.SkipWithError("Failed to create the database");
+        return;
+    }
+    std::mt19937 rng(6);
+    int i = 0;
+    for(auto _: state)
+    {
+        std::string name = std::format("user{}", i++ % 16);
+        WeeklyPost p = makeWeekly(name, BENCH_NOW, rng);
+        auto result = file.data->updateWeekly(name, std::move(p));
+        benchmark::DoNotOptimize(result);
+    }
+}
+BENCHMARK(BM_FileUpdateWeekly)->Arg(0)->Arg(1)
+    ->Unit(benchmark::kMicrosecond);
+
+void BM_FileGetWeeklies(benchmark::State& state)
+{
+    BenchDatabaseFile file(state.range(0), 1);
+    if(file.data == nullptr)
+    {
+        state.SkipWithError("Failed to create the database");
+        return;
+    }
+    int i = 0;
+    for(auto _: state)
+    {
+        auto weeklies = file.data->getWeekliesOneYear(
+            std::format("user{}", i++ % 16), BENCH_NOW);
+        benchmark::DoNotOptimize(weeklies);
+    }
+}
+BENCHMARK(BM_FileGetWeeklies)->Arg(0)->Arg(1)
+    ->Unit(benchmark::kMicrosecond);
+
+void BM_RenderWeekly(benchmark::State& state)
+{
+    std::mt19937 rng(2);
+    WeeklyPost p = makeWeekly("user0", BENCH_NOW, rng);
+    p.raw_content = makePost(state.range(0), rng);
+    for(auto _: state)
+    {
+        auto html = p.render();
+        benchmark::DoNotOptimize(html);
+    }
+    state.SetBytesProcessed(state.iterations() * p.raw_content.size());
+}
+BENCHMARK(BM_RenderWeekly)->Arg(4)->Arg(16)->Arg(64);
+
+void BM_WeeklyToJSON(benchmark::State& state)
+{
+    std::mt19937 rng(3);
+    WeeklyPost p = makeWeekly("user0", BENCH_NOW, rng);
+    std::string html = *p.render();
+    for(auto _: state)
+    {
+        nlohmann::json json = weeklyToJSON(p, html);
+        benchmark::DoNotOptimize(json);
+    }
+}
+BENCHMARK(BM_WeeklyToJSON);
+
+void BM_ParseCookies(benchmark::State& state)
+{
+    // Access tokens are usually JWTs of about a kilobyte.
+    std::string cookie = std::format(
+        "access-token={}; refresh-token={}; theme=dark; _ga=GA1.1.12345",
+        std::string(1024, 'a'), std::string(512, 'b'));
+    for(auto _: state)
+    {
+        auto cookies = parseCookies(cookie);
+        benchmark::DoNotOptimize(cookies);
+    }
+}
+BENCHMARK(BM_ParseCookies);
+
+void BM_SQLiteEval(benchmark::State& state)
+{
+    auto db = SQLite::connectMemory();
+    if(!db.has_value() ||
+       !(*db)->execute("CREATE TABLE test (a INTEGER, b TEXT, c REAL);")
+       .has_value())
+    {
+        state.SkipWithError("Failed to create the database");
+        return;
+    }
+    std::mt19937 rng(4);
+    for(int64_t i = 0; i < state.range(0); i++)
+    {
+        auto sql = (*db)->statementFromStr(
+            "INSERT INTO test (a, b, c) VALUES (?, ?, ?);");
+        if(!sql.has_value() ||
+           !sql->bind(i, makePost(1, rng), 0.5 * i).has_value() ||
+           !(*db)->execute(*std::move(sql)).has_value())
+        {
+            state.SkipWithError("Failed to insert");
+            return;
+        }
+    }
+    for(auto _: state)
+    {
+        auto rows = (*db)->eval<int64_t, std::string, double>(
+            "SELECT a, b, c FROM test;");
+        benchmark::DoNotOptimize(rows);
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_SQLiteEval)->Arg(52)->Arg(1024);
+
+void BM_RenderWeekliesTemplate(benchmark::State& state)
+{
+    auto templates = Templates::load(
+        std::filesystem::path(NSWEEKLY_SOURCE_DIR) / "templates",
+        [](inja::Environment& env)
+        {
+            env.add_callback("url_for", 2, [](const inja::Arguments& args)
+            {
+                return std::format(
+                    "/{}/{}", args.at(0)->get_ref<const std::string&>(),
+                    args.at(1)->get_ref<const std::string&>());
+            });
+        });
+    if(!templates.has_value())
+    {
+        state.SkipWithError("Failed to load the templates");
+        return;
+    }
+    std::mt19937 rng(5);
+    nlohmann::json weeklies_json(nlohmann::json::value_t::array);
+    for(int week = 0; week < state.range(0); week++)
+    {
+        WeeklyPost p = makeWeekly("user0", BENCH_NOW - week * 7 * 24h, rng);
+        weeklies_json.push_back(weeklyToJSON(p, *p.render()));
+    }
+    nlohmann::json data{{ "weeklies", std::move(weeklies_json) },
+                        { "username", "user0" },
+                        { "session_user", "" },
+                        { "this_url", "/weekly/user0" },
+                        { "older_url", "" },
+    };
+    for(auto _: state)
+    {
+        auto html = (*templates)->render("weeklies.html", data);
+        benchmark::DoNotOptimize(html);
+    }
+}
+BENCHMARK(BM_RenderWeekliesTemplate)->Arg(1)->Arg(52);
+
+} // namespace
+
+BENCHMARK_MAIN();
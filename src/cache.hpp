@@ -0,0 +1,211 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+
+#include "utils.hpp"
+
+// A thread-safe LRU cache with optionally expiring entries. Keys are
+// spread over a number of shards, each with its own lock, so threads
+// looking up different keys rarely wait for each other.
+//
+// Each entry has a cost (1 by default, but it could be e.g. the size
+// of the value in bytes). When the total cost of a shard goes beyond
+// its share of the capacity, the least recently used entries in that
+// shard are evicted.
+template<typename Key, typename Value, typename Hash = std::hash<Key>>
+class LRUCache
+{
+public:
+    explicit LRUCache(size_t capacity, size_t shard_num = 16);
+    LRUCache(const LRUCache&) = delete;
+    LRUCache& operator=(const LRUCache&) = delete;
+
+    // Return the value of the key if it is in the cache and has not
+    // expired. This counts as a hit or a miss.
+    std::optional<Value> get(const Key& key);
+    // Insert or replace an entry. An entry that costs more than a
+    // shard can hold is not inserted.
+    void put(const Key& key, Value value, size_t cost = 1,
+             std::optional<Time> expiration = std::nullopt);
+    void erase(const Key& key);
+    void clear();
+
+    uint64_t hits() const { return hit_count.load(std::memory_order_relaxed); }
+    uint64_t misses() const
+    {
+        return miss_count.load(std::memory_order_relaxed);
+    }
+    // Number of entries, including expired ones that have not been
+    // looked at since they expired.
+    size_t size() const;
+    // Total cost of the entries.
+    size_t cost() const;
+
+private:
+    struct Entry
+    {
+        Key key;
+        Value value;
+        size_t cost;
+        std::optional<Time> expiration;
+    };
+
+    struct Shard
+    {
+        mutable std::mutex lock;
+        // Most recently used entry at the front.
+        std::list<Entry> entries;
+        std::unordered_map<Key, typename std::list<Entry>::iterator, Hash>
+        index;
+        size_t cost = 0;
+    };
+
+    Shard& shardOf(const Key& key);
+    // The shard should be locked.
+    static void removeEntry(Shard& shard,
+                            typename std::list<Entry>::iterator it);
+
+    std::unique_ptr<Shard[]> shards;
+    size_t shard_count;
+    size_t shard_capacity;
+    Hash hasher;
+    std::atomic<uint64_t> hit_count = 0;
+    std::atomic<uint64_t> miss_count = 0;
+};
+
+// ========== Template implementations ==============================>
+
+template<typename Key, typename Value, typename Hash>
+LRUCache<Key, Value, Hash>::LRUCache(size_t capacity, size_t shard_num)
+        : shards(std::make_unique<Shard[]>(shard_num == 0 ? 1 : shard_num)),
+          shard_count(shard_num == 0 ? 1 : shard_num),
+          shard_capacity(capacity / shard_count)
+{
+    if(shard_capacity == 0 && capacity > 0)
+    {
+        shard_capacity = 1;
+    }
+}
+
+template<typename Key, typename Value, typename Hash>
+typename LRUCache<Key, Value, Hash>::Shard&
+LRUCache<Key, Value, Hash>::shardOf(const Key& key)
+{
+    // The same hash is used by the index inside the shard, so mix the
+    // bits before picking a shard. Otherwise all keys in a shard
+    // could end up in a few buckets.
+    uint64_t h = hasher(key);
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdull;
+    h ^= h >> 33;
+    return shards[h % shard_count];
+}
+
+template<typename Key, typename Value, typename Hash>
+void LRUCache<Key, Value, Hash>::removeEntry(
+    Shard& shard, typename std::list<Entry>::iterator it)
+{
+    shard.cost -= it->cost;
+    shard.index.erase(it->key);
+    shard.entries.erase(it);
+}
+
+template<typename Key, typename Value, typename Hash>
+std::optional<Value> LRUCache<Key, Value, Hash>::get(const Key& key)
+{
+    Shard& shard = shardOf(key);
+    std::lock_guard<std::mutex> lock(shard.lock);
+    auto found = shard.index.find(key);
+    if(found == std::end(shard.index))
+    {
+        miss_count.fetch_add(1, std::memory_order_relaxed);
+        return std::nullopt;
+    }
+    auto it = found->second;
+    if(it->expiration.has_value() && *it->expiration <= Clock::now())
+    {
+        removeEntry(shard, it);
+        miss_count.fetch_add(1, std::memory_order_relaxed);
+        return std::nullopt;
+    }
+    shard.entries.splice(std::begin(shard.entries), shard.entries, it);
+    hit_count.fetch_add(1, std::memory_order_relaxed);
+    return it->value;
+}
+
+template<typename Key, typename Value, typename Hash>
+void LRUCache<Key, Value, Hash>::put(const Key& key, Value value, size_t cost,
+                                     std::optional<Time> expiration)
+{
+    Shard& shard = shardOf(key);
+    std::lock_guard<std::mutex> lock(shard.lock);
+    if(auto found = shard.index.find(key); found != std::end(shard.index))
+    {
+        removeEntry(shard, found->second);
+    }
+    if(cost > shard_capacity)
+    {
+        return;
+    }
+    while(shard.cost + cost > shard_capacity)
+    {
+        removeEntry(shard, std::prev(std::end(shard.entries)));
+    }
+    shard.entries.push_front(Entry{key, std::move(value), cost, expiration});
+    shard.index.emplace(key, std::begin(shard.entries));
+    shard.cost += cost;
+}
+
+template<typename Key, typename Value, typename Hash>
+void LRUCache<Key, Value, Hash>::erase(const Key& key)
+{
+    Shard& shard = shardOf(key);
+    std::lock_guard<std::mutex> lock(shard.lock);
+    if(auto found = shard.index.find(key); found != std::end(shard.index))
+    {
+        removeEntry(shard, found->second);
+    }
+}
+
+template<typename Key, typename Value, typename Hash>
+void LRUCache<Key, Value, Hash>::clear()
+{
+    for(size_t i = 0; i < shard_count; i++)
+    {
+        std::lock_guard<std::mutex> lock(shards[i].lock);
+        shards[i].entries.clear();
+        shards[i].index.clear();
+        shards[i].cost = 0;
+    }
+}
+
+template<typename Key, typename Value, typename Hash>
+size_t LRUCache<Key, Value, Hash>::size() const
+{
+    size_t result = 0;
+    for(size_t i = 0; i < shard_count; i++)
+    {
+        std::lock_guard<std::mutex> lock(shards[i].lock);
+        result += shards[i].entries.size();
+    }
+    return result;
+}
+
+template<typename Key, typename Value, typename Hash>
+size_t LRUCache<Key, Value, Hash>::cost() const
+{
+    size_t result = 0;
+    for(size_t i = 0; i < shard_count; i++)
+    {
+        std::lock_guard<std::mutex> lock(shards[i].lock);
+        result += shards[i].cost;
+    }
+    return result;
+}
@@ -0,0 +1,58 @@
+#include <chrono>
+#include <string>
+
+#include <gtest/gtest.h>
+
+#include "cache.hpp"
+#include "utils.hpp"
+
+TEST(Cache, CanGetAndPut)
+{
+    LRUCache<std::string, int> cache(10);
+    EXPECT_FALSE(cache.get("aaa").has_value());
+    cache.put("aaa", 1);
+    ASSERT_TRUE(cache.get("aaa").has_value());
+    EXPECT_EQ(*cache.get("aaa"), 1);
+    cache.put("aaa", 2);
+    EXPECT_EQ(*cache.get("aaa"), 2);
+    EXPECT_EQ(cache.size(), 1);
+    EXPECT_EQ(cache.hits(), 3);
+    EXPECT_EQ(cache.misses(), 1);
+
+    cache.erase("aaa");
+    EXPECT_FALSE(cache.get("aaa").has_value());
+}
+
+TEST(Cache, EvictsLeastRecentlyUsed)
+{
+    // One shard, so that the order of eviction is predictable.
+    LRUCache<std::string, int> cache(3, 1);
+    cache.put("a", 1);
+    cache.put("b", 2);
+    cache.put("c", 3);
+    EXPECT_TRUE(cache.get("a").has_value());
+    cache.put("d", 4);
+    EXPECT_FALSE(cache.get("b").has_value());
+    EXPECT_TRUE(cache.get("a").has_value());
+    EXPECT_TRUE(cache.get("c").has_value());
+    EXPECT_TRUE(cache.get("d").has_value());
+
+    // Costly entries push out more.
+    cache.put("e", 5, 2);
+    EXPECT_EQ(cache.size(), 2);
+    EXPECT_EQ(cache.cost(), 3);
+    // Too costly to be cached at all.
+    cache.put("f", 6, 4);
+    EXPECT_FALSE(cache.get("f").has_value());
+}
+
+TEST(Cache, ExpiredEntriesAreMissed)
+{
+    using namespace std::chrono_literals;
+    LRUCache<std::string, int> cache(10);
+    cache.put("aaa", 1, 1, Clock::now() - 1s);
+    cache.put("bbb", 2, 1, Clock::now() + 1h);
+    EXPECT_FALSE(cache.get("aaa").has_value());
+    EXPECT_TRUE(cache.get("bbb").has_value());
+    EXPECT_EQ(cache.size(), 1);
+}
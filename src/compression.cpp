@@ -0,0 +1,410 @@
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <format>
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include <zlib.h>
+#ifdef NSWEEKLY_HAVE_BROTLI
+#include <brotli/encode.h>
+#endif
+
+#include "compression.hpp"
+#include "error.hpp"
+
+namespace
+{
+
+std::string_view trim(std::string_view s)
+{
+    while(!s.empty() && (s.front() == ' ' || s.front() == '\t'))
+    {
+        s.remove_prefix(1);
+    }
+    while(!s.empty() && (s.back() == ' ' || s.back() == '\t'))
+    {
+        s.remove_suffix(1);
+    }
+    return s;
+}
+
+bool equalsIgnoreCase(std::string_view a, std::string_view b)
+{
+    return std::equal(std::begin(a), std::end(a), std::begin(b), std::end(b),
+                      [](char x, char y)
+                      {
+                          return std::tolower(static_cast<unsigned char>(x)) ==
+                              std::tolower(static_cast<unsigned char>(y));
+                      });
+}
+
+// Parse the q parameter of an element in Accept-Encoding. Return 1 if
+// there is none, and 0 if it is invalid.
+double qValue(std::string_view params)
+{
+    while(!params.empty())
+    {
+        size_t semicolon = params.find(';');
+        std::string_view param = trim(params.substr(0, semicolon));
+        params = semicolon == std::string_view::npos ?
+            std::string_view() : params.substr(semicolon + 1);
+        if(param.size() < 2 || !equalsIgnoreCase(param.substr(0, 2), "q="))
+        {
+            continue;
+        }
+        param.remove_prefix(2);
+        double q = 0;
+        auto status = std::from_chars(param.data(), param.data() + param.size(),
+                                      q);
+        if(status.ec != std::errc())
+        {
+            return 0;
+        }
+        return q;
+    }
+    return 1;
+}
+
+E<std::string> gzipCompress(std::string_view data, CompressionEffort effort)
+{
+    z_stream stream{};
+    int level = effort == CompressionEffort::BEST ? Z_BEST_COMPRESSION : 6;
+    // 16 + the max window bits means gzip instead of raw zlib.
+    if(deflateInit2(&stream, level, Z_DEFLATED, 16 + MAX_WBITS, 8,
+                    Z_DEFAULT_STRATEGY) != Z_OK)
+    {
+        return std::unexpected(runtimeError("Failed to initialize zlib"));
+    }
+    std::string result(deflateBound(&stream, data.size()), '\0');
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+    stream.avail_in = data.size();
+    stream.next_out = reinterpret_cast<Bytef*>(result.data());
+    stream.avail_out = result.size();
+    int status = deflate(&stream, Z_FINISH);
+    result.resize(stream.total_out);
+    deflateEnd(&stream);
+    if(status != Z_STREAM_END)
+    {
+        return std::unexpected(runtimeError(
+            std::format("Failed to gzip: {}", status)));
+    }
+    return result;
+}
+
+#ifdef NSWEEKLY_HAVE_BROTLI
+E<std::string> brotliCompress(std::string_view data, CompressionEffort effort)
+{
+    // Quality 11 is too slow even for things that are compressed once.
+    int quality = effort == CompressionEffort::BEST ? 9 : 4;
+    size_t size = BrotliEncoderMaxCompressedSize(data.size());
+    std::string result(size, '\0');
+    if(!BrotliEncoderCompress(
+           quality, BROTLI_DEFAULT_WINDOW, BROTLI_MODE_TEXT, data.size(),
+           reinterpret_cast<const uint8_t*>(data.data()), &size,
+           reinterpret_cast<uint8_t*>(result.data())))
+    {
+        return std::unexpected(runtimeError("Failed to compress with brotli"));
+    }
+    result.resize(size);
+    return result;
+}
+#endif
+
+// Return the compressed data if it is smaller, otherwise empty.
+std::string compressIfSmaller(std::string_view data, ContentEncoding encoding)
+{
+    E<std::string> result = compress(data, encoding, CompressionEffort::BEST);
+    if(!result.has_value() || result->size() >= data.size())
+    {
+        return "";
+    }
+    return *std::move(result);
+}
+
+} // namespace
+
+ContentEncoding negotiateEncoding(std::string_view accept_encoding)
+{
+    double gzip_q = 0;
+    [[maybe_unused]] double brotli_q = 0;
+    std::optional<double> wildcard_q;
+    bool has_gzip = false;
+    bool has_brotli = false;
+    while(!accept_encoding.empty())
+    {
+        size_t comma = accept_encoding.find(',');
+        std::string_view element = accept_encoding.substr(0, comma);
+        accept_encoding = comma == std::string_view::npos ?
+            std::string_view() : accept_encoding.substr(comma + 1);
+
+        size_t semicolon = element.find(';');
+        std::string_view name = trim(element.substr(0, semicolon));
+        double q = semicolon == std::string_view::npos ? 1 :
+            qValue(element.substr(semicolon + 1));
+        if(equalsIgnoreCase(name, "gzip") || equalsIgnoreCase(name, "x-gzip"))
+        {
+            gzip_q = q;
+            has_gzip = true;
+        }
+        else if(equalsIgnoreCase(name, "br"))
+        {
+            brotli_q = q;
+            has_brotli = true;
+        }
+        else if(name == "*")
+        {
+            wildcard_q = q;
+        }
+    }
+    if(wildcard_q.has_value())
+    {
+        if(!has_gzip)
+        {
+            gzip_q = *wildcard_q;
+        }
+        if(!has_brotli)
+        {
+            brotli_q = *wildcard_q;
+        }
+    }
+
+#ifdef NSWEEKLY_HAVE_BROTLI
+    // Brotli wins ties, as it compresses better.
+    if(brotli_q > 0 && brotli_q >= gzip_q)
+    {
+        return ContentEncoding::BROTLI;
+    }
+#endif
+    if(gzip_q > 0)
+    {
+        return ContentEncoding::GZIP;
+    }
+    return ContentEncoding::IDENTITY;
+}
+
+std::string_view encodingName(ContentEncoding encoding)
+{
+    switch(encoding)
+    {
+    case ContentEncoding::IDENTITY:
+        return "";
+    case ContentEncoding::GZIP:
+        return "gzip";
+    case ContentEncoding::BROTLI:
+        return "br";
+    }
+    return "";
+}
+
+bool isCompressible(std::string_view content_type)
+{
+    return content_type.starts_with("text/") ||
+        content_type.starts_with("application/javascript") ||
+        content_type.starts_with("application/json") ||
+        content_type.starts_with("image/svg+xml");
+}
+
+E<std::string> compress(std::string_view data, ContentEncoding encoding,
+                        CompressionEffort effort)
+{
+    switch(encoding)
+    {
+    case ContentEncoding::IDENTITY:
+        return std::string(data);
+    case ContentEncoding::GZIP:
+        return gzipCompress(data, effort);
+    case ContentEncoding::BROTLI:
+#ifdef NSWEEKLY_HAVE_BROTLI
+        return brotliCompress(data, effort);
+#else
+        break;
+#endif
+    }
+    return std::unexpected(runtimeError("Unsupported content encoding"));
+}
+
+CompressedBody::CompressedBody(std::string body, bool compressible)
+        : raw_body(std::move(body))
+{
+    if(!compressible || raw_body.size() < MIN_COMPRESS_SIZE)
+    {
+        return;
+    }
+    gzip = compressIfSmaller(raw_body, ContentEncoding::GZIP);
+#ifdef NSWEEKLY_HAVE_BROTLI
+    brotli = compressIfSmaller(raw_body, ContentEncoding::BROTLI);
+#endif
+}
+
+const std::string& CompressedBody::get(ContentEncoding& encoding) const
+{
+    switch(encoding)
+    {
+    case ContentEncoding::IDENTITY:
+        break;
+    case ContentEncoding::GZIP:
+        if(!gzip.empty())
+        {
+            return gzip;
+        }
+        break;
+    case ContentEncoding::BROTLI:
+        if(!brotli.empty())
+        {
+            return brotli;
+        }
+        break;
+    }
+    encoding = ContentEncoding::IDENTITY;
+    return raw_body;
+}
+
+size_t CompressedBody::bytes() const
+{
+    return raw_body.size() + gzip.size() + brotli.size();
+}
+
+struct StreamCompressor::State
+{
+    z_stream gzip{};
+    bool gzip_initialized = false;
+#ifdef NSWEEKLY_HAVE_BROTLI
+    BrotliEncoderState* brotli = nullptr;
+#endif
+};
+
+StreamCompressor::StreamCompressor(ContentEncoding encoding)
+        : enc(encoding), state(std::make_unique<State>())
+{
+}
+
+StreamCompressor::~StreamCompressor()
+{
+    if(state->gzip_initialized)
+    {
+        deflateEnd(&state->gzip);
+    }
+#ifdef NSWEEKLY_HAVE_BROTLI
+    if(state->brotli != nullptr)
+    {
+        BrotliEncoderDestroyInstance(state->brotli);
+    }
+#endif
+}
+
+E<std::unique_ptr<StreamCompressor>> StreamCompressor::create(
+    ContentEncoding encoding)
+{
+    std::unique_ptr<StreamCompressor> result(new StreamCompressor(encoding));
+    switch(encoding)
+    {
+    case ContentEncoding::IDENTITY:
+        return result;
+    case ContentEncoding::GZIP:
+        // The same settings as compress() with CompressionEffort::FAST.
+        if(deflateInit2(&result->state->gzip, 6, Z_DEFLATED, 16 + MAX_WBITS,
+                        8, Z_DEFAULT_STRATEGY) != Z_OK)
+        {
+            return std::unexpected(runtimeError("Failed to initialize zlib"));
+        }
+        result->state->gzip_initialized = true;
+        return result;
+    case ContentEncoding::BROTLI:
+#ifdef NSWEEKLY_HAVE_BROTLI
+        result->state->brotli = BrotliEncoderCreateInstance(nullptr, nullptr,
+                                                            nullptr);
+        if(result->state->brotli == nullptr)
+        {
+            return std::unexpected(runtimeError(
+                "Failed to initialize brotli"));
+        }
+        BrotliEncoderSetParameter(result->state->brotli, BROTLI_PARAM_QUALITY,
+                                  4);
+        BrotliEncoderSetParameter(result->state->brotli, BROTLI_PARAM_MODE,
+                                  BROTLI_MODE_TEXT);
+        return result;
+#else
+        break;
+#endif
+    }
+    return std::unexpected(runtimeError("Unsupported content encoding"));
+}
+
+E<std::string> StreamCompressor::write(std::string_view data)
+{
+    return process(data, false);
+}
+
+E<std::string> StreamCompressor::finish()
+{
+    return process({}, true);
+}
+
+E<std::string> StreamCompressor::process(std::string_view data, bool last)
+{
+    std::string result;
+    switch(enc)
+    {
+    case ContentEncoding::IDENTITY:
+        return std::string(data);
+    case ContentEncoding::GZIP:
+    {
+        z_stream& stream = state->gzip;
+        stream.next_in = reinterpret_cast<Bytef*>(
+            const_cast<char*>(data.data()));
+        stream.avail_in = data.size();
+        int flush = last ? Z_FINISH : Z_SYNC_FLUSH;
+        // Deflate until all the input is consumed and flushed, which
+        // is when there is space left in the output.
+        do
+        {
+            size_t size = result.size();
+            size_t space = deflateBound(&stream, stream.avail_in) + 64;
+            result.resize(size + space);
+            stream.next_out = reinterpret_cast<Bytef*>(result.data() + size);
+            stream.avail_out = space;
+            int status = deflate(&stream, flush);
+            // Z_BUF_ERROR only means there was nothing to do.
+            if(status != Z_OK && status != Z_STREAM_END &&
+               status != Z_BUF_ERROR)
+            {
+                return std::unexpected(runtimeError(
+                    std::format("Failed to gzip: {}", status)));
+            }
+            result.resize(result.size() - stream.avail_out);
+        } while(stream.avail_out == 0);
+        return result;
+    }
+    case ContentEncoding::BROTLI:
+#ifdef NSWEEKLY_HAVE_BROTLI
+    {
+        size_t available_in = data.size();
+        const uint8_t* next_in = reinterpret_cast<const uint8_t*>(data.data());
+        BrotliEncoderOperation op = last ? BROTLI_OPERATION_FINISH :
+            BROTLI_OPERATION_FLUSH;
+        do
+        {
+            size_t available_out = 0;
+            if(!BrotliEncoderCompressStream(state->brotli, op, &available_in,
+                                            &next_in, &available_out, nullptr,
+                                            nullptr))
+            {
+                return std::unexpected(runtimeError(
+                    "Failed to compress with brotli"));
+            }
+            size_t size = 0;
+            const uint8_t* output = BrotliEncoderTakeOutput(state->brotli,
+                                                            &size);
+            result.append(reinterpret_cast<const char*>(output), size);
+        } while(available_in > 0 ||
+                BrotliEncoderHasMoreOutput(state->brotli));
+        return result;
+    }
+#else
+        break;
+#endif
+    }
+    return std::unexpected(runtimeError("Unsupported content encoding"));
+}
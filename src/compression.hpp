@@ -0,0 +1,93 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include "error.hpp"
+
+// Content codings (RFC 9110) of response bodies. Brotli is only
+// available if NSWeekly is built with it.
+enum class ContentEncoding
+{
+    IDENTITY,
+    GZIP,
+    BROTLI,
+};
+
+// Bodies smaller than this are not worth compressing.
+constexpr size_t MIN_COMPRESS_SIZE = 256;
+
+// Return the supported encoding that the client prefers, according
+// to the value of its Accept-Encoding header.
+ContentEncoding negotiateEncoding(std::string_view accept_encoding);
+// The value of the Content-Encoding header for the encoding. Empty
+// for identity.
+std::string_view encodingName(ContentEncoding encoding);
+// Whether bodies of the MIME type are worth compressing.
+bool isCompressible(std::string_view content_type);
+
+enum class CompressionEffort
+{
+    // For bodies that are compressed on every request.
+    FAST,
+    // For bodies that are compressed once and sent many times.
+    BEST,
+};
+
+E<std::string> compress(std::string_view data, ContentEncoding encoding,
+                        CompressionEffort effort);
+
+// A response body together with all its compressed variants, which
+// are computed once on construction. It does not change afterwards,
+// so threads can share it.
+class CompressedBody
+{
+public:
+    // If compressible is false, there will be no compressed variants.
+    explicit CompressedBody(std::string raw_body, bool compressible = true);
+
+    const std::string& raw() const { return raw_body; }
+    // Return the variant of the body in the encoding. If there is
+    // not such a variant (e.g. the body is too small), return the raw
+    // body and set encoding to identity.
+    const std::string& get(ContentEncoding& encoding) const;
+    // Total size of all the variants.
+    size_t bytes() const;
+
+private:
+    std::string raw_body;
+    // Empty if there is no such variant.
+    std::string gzip;
+    std::string brotli;
+};
+
+// Compresses a body that is produced piece by piece, e.g. a streamed
+// response. Each piece is flushed, so that the client can decode it
+// as soon as it arrives.
+class StreamCompressor
+{
+public:
+    ~StreamCompressor();
+    StreamCompressor(const StreamCompressor&) = delete;
+    StreamCompressor& operator=(const StreamCompressor&) = delete;
+
+    static E<std::unique_ptr<StreamCompressor>> create(
+        ContentEncoding encoding);
+
+    ContentEncoding encoding() const { return enc; }
+    // Compress the data, and return what can be sent so far.
+    E<std::string> write(std::string_view data);
+    // Return the rest of the compressed body. Nothing can be written
+    // after this.
+    E<std::string> finish();
+
+private:
+    struct State;
+
+    explicit StreamCompressor(ContentEncoding encoding);
+    E<std::string> process(std::string_view data, bool last);
+
+    ContentEncoding enc;
+    std::unique_ptr<State> state;
+};
@@ -0,0 +1,104 @@
+#include <memory>
+#include <string>
+
+#include <gtest/gtest.h>
+#include <zlib.h>
+
+#include "compression.hpp"
+#include "error.hpp"
+#include "test_utils.hpp"
+
+namespace {
+
+std::string gunzip(const std::string& data)
+{
+    z_stream stream{};
+    inflateInit2(&stream, 16 + MAX_WBITS);
+    std::string result(1024 * 1024, '\0');
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+    stream.avail_in = data.size();
+    stream.next_out = reinterpret_cast<Bytef*>(result.data());
+    stream.avail_out = result.size();
+    inflate(&stream, Z_FINISH);
+    result.resize(stream.total_out);
+    inflateEnd(&stream);
+    return result;
+}
+
+std::string repetitiveHTML()
+{
+    std::string html;
+    for(int i = 0; i < 100; i++)
+    {
+        html += "<section class=\"Weekly\"><p>aaa</p></section>\n";
+    }
+    return html;
+}
+
+} // namespace
+
+TEST(Compression, CanNegotiateEncoding)
+{
+    EXPECT_EQ(negotiateEncoding(""), ContentEncoding::IDENTITY);
+    EXPECT_EQ(negotiateEncoding("gzip"), ContentEncoding::GZIP);
+    EXPECT_EQ(negotiateEncoding("deflate, GZip;q=0.5"), ContentEncoding::GZIP);
+    EXPECT_EQ(negotiateEncoding("gzip;q=0"), ContentEncoding::IDENTITY);
+    EXPECT_EQ(negotiateEncoding("*"), negotiateEncoding("gzip, br"));
+    EXPECT_EQ(negotiateEncoding("gzip;q=0, *"), negotiateEncoding("br"));
+#ifdef NSWEEKLY_HAVE_BROTLI
+    EXPECT_EQ(negotiateEncoding("gzip, deflate, br"), ContentEncoding::BROTLI);
+    EXPECT_EQ(negotiateEncoding("gzip, br;q=0.9"), ContentEncoding::GZIP);
+#else
+    EXPECT_EQ(negotiateEncoding("br"), ContentEncoding::IDENTITY);
+#endif
+}
+
+TEST(Compression, CanGzip)
+{
+    std::string html = repetitiveHTML();
+    ASSIGN_OR_FAIL(std::string compressed, compress(
+        html, ContentEncoding::GZIP, CompressionEffort::FAST));
+    EXPECT_LT(compressed.size(), html.size());
+    EXPECT_EQ(gunzip(compressed), html);
+}
+
+TEST(Compression, CompressedBodyHasVariants)
+{
+    std::string html = repetitiveHTML();
+    CompressedBody body(html);
+    ContentEncoding encoding = ContentEncoding::GZIP;
+    EXPECT_EQ(gunzip(body.get(encoding)), html);
+    EXPECT_EQ(encoding, ContentEncoding::GZIP);
+    EXPECT_GT(body.bytes(), html.size());
+
+    // Too small to compress
+    CompressedBody small("aaa");
+    encoding = ContentEncoding::GZIP;
+    EXPECT_EQ(small.get(encoding), "aaa");
+    EXPECT_EQ(encoding, ContentEncoding::IDENTITY);
+}
+
+TEST(Compression, CanGzipAStream)
+{
+    std::string html = repetitiveHTML();
+    ASSIGN_OR_FAIL(auto compressor,
+                   StreamCompressor::create(ContentEncoding::GZIP));
+    std::string compressed;
+    for(int i = 0; i < 3; i++)
+    {
+        ASSIGN_OR_FAIL(std::string piece, compressor->write(html));
+        // Each piece is flushed, so it can be decoded right away.
+        EXPECT_FALSE(piece.empty());
+        compressed += piece;
+        EXPECT_EQ(gunzip(compressed).size(), html.size() * (i + 1));
+    }
+    ASSIGN_OR_FAIL(std::string rest, compressor->finish());
+    compressed += rest;
+    EXPECT_LT(compressed.size(), html.size());
+    EXPECT_EQ(gunzip(compressed), html + html + html);
+
+    ASSIGN_OR_FAIL(auto identity,
+                   StreamCompressor::create(ContentEncoding::IDENTITY));
+    ASSIGN_OR_FAIL(std::string piece, identity->write("aaa"));
+    EXPECT_EQ(piece, "aaa");
+}
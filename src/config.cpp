@@ -1,33 +1,19 @@
 #include <string>
+#include <string_view>
 #include <expected>
 #include <filesystem>
-#include <fstream>
 #include <format>
+#include <optional>
 
 #include <ryml.hpp>
 #include <ryml_std.hpp>
 
 #include "config.hpp"
 #include "error.hpp"
+#include "utils.hpp"
 
 namespace {
 
-E<std::vector<char>> readFile(const std::filesystem::path& path)
-{
-    std::ifstream f(path, std::ios::binary);
-    std::vector<char> content;
-    content.reserve(102400);
-    content.assign(std::istreambuf_iterator<char>(f),
-                   std::istreambuf_iterator<char>());
-    if(f.bad() || f.fail())
-    {
-        return std::unexpected(runtimeError(
-            std::format("Failed to read file {}", path.string())));
-    }
-
-    return content;
-}
-
 template<class T>
 bool getYamlValue(ryml::ConstNodeRef node, T& result)
 {
@@ -36,6 +22,31 @@ bool getYamlValue(ryml::ConstNodeRef node, T& result)
     return status.ec == std::errc();
 }
 
+// Set the result from the key, if the tree has it. The value should
+// be true or false.
+E<void> parseBool(ryml::Tree& tree, ryml::csubstr key, bool& result)
+{
+    if(!tree[key].has_key())
+    {
+        return {};
+    }
+    auto value = tree[key].val();
+    if(value == "true")
+    {
+        result = true;
+    }
+    else if(value == "false")
+    {
+        result = false;
+    }
+    else
+    {
+        return std::unexpected(runtimeError(std::format(
+            "Invalid {}", std::string_view(key.str, key.len))));
+    }
+    return {};
+}
+
 } // namespace
 
 E<Configuration> Configuration::fromYaml(const std::filesystem::path& path)
@@ -80,6 +91,12 @@ E<Configuration> Configuration::fromYaml(const std::filesystem::path& path)
         auto value = tree["openid-url-prefix"].val();
         config.openid_url_prefix = std::string(value.begin(), value.end());
     }
+    DO_OR_RETURN(parseBool(tree, "openid-local-verify", config.openid_local_verify));
+    if(tree["openid-audience"].has_key())
+    {
+        auto value = tree["openid-audience"].val();
+        config.openid_audience = std::string(value.begin(), value.end());
+    }
     if(tree["url-prefix"].has_key())
     {
         auto value = tree["url-prefix"].val();
@@ -108,5 +125,183 @@ E<Configuration> Configuration::fromYaml(const std::filesystem::path& path)
         auto value = tree["default-lang"].val();
         config.default_lang = std::string(value.begin(), value.end());
     }
+    if(tree["storage"].has_key())
+    {
+        ryml::ConstNodeRef storage = tree["storage"];
+        auto get_string = [&](const char* key, std::string& result)
+        {
+            if(storage.has_child(ryml::to_csubstr(key)))
+            {
+                auto value = storage[ryml::to_csubstr(key)].val();
+                result = std::string(value.begin(), value.end());
+            }
+        };
+        auto get_int = [&](const char* key, std::optional<int64_t>& result)
+        {
+            if(!storage.has_child(ryml::to_csubstr(key)))
+            {
+                return true;
+            }
+            int64_t value = 0;
+            if(!getYamlValue(storage[ryml::to_csubstr(key)], value))
+            {
+                return false;
+            }
+            result = value;
+            return true;
+        };
+        // The values of the strings are checked when they are applied.
+        get_string("journal-mode", config.storage.journal_mode);
+        get_string("synchronous", config.storage.synchronous);
+        get_string("temp-store", config.storage.temp_store);
+        if(!get_int("mmap-size", config.storage.mmap_size) ||
+           !get_int("cache-size", config.storage.cache_size) ||
+           !get_int("busy-timeout", config.storage.busy_timeout))
+        {
+            return std::unexpected(runtimeError("Invalid storage settings"));
+        }
+    }
+    if(tree["db-read-connections"].has_key())
+    {
+        if(!getYamlValue(tree["db-read-connections"],
+                         config.db_read_connections) ||
+           config.db_read_connections < 0)
+        {
+            return std::unexpected(runtimeError(
+                "Invalid db-read-connections"));
+        }
+    }
+    if(tree["session-cache-size"].has_key())
+    {
+        if(!getYamlValue(tree["session-cache-size"],
+                         config.session_cache_size) ||
+           config.session_cache_size < 0)
+        {
+            return std::unexpected(runtimeError("Invalid session-cache-size"));
+        }
+    }
+    if(tree["session-cache-ttl"].has_key())
+    {
+        if(!getYamlValue(tree["session-cache-ttl"],
+                         config.session_cache_ttl) ||
+           config.session_cache_ttl < 0)
+        {
+            return std::unexpected(runtimeError("Invalid session-cache-ttl"));
+        }
+    }
+    if(tree["render-cache-bytes"].has_key())
+    {
+        if(!getYamlValue(tree["render-cache-bytes"],
+                         config.render_cache_bytes) ||
+           config.render_cache_bytes < 0)
+        {
+            return std::unexpected(runtimeError("Invalid render-cache-bytes"));
+        }
+    }
+    if(tree["page-cache-bytes"].has_key())
+    {
+        if(!getYamlValue(tree["page-cache-bytes"], config.page_cache_bytes) ||
+           config.page_cache_bytes < 0)
+        {
+            return std::unexpected(runtimeError("Invalid page-cache-bytes"));
+        }
+    }
+    if(tree["page-cache-max-age"].has_key())
+    {
+        if(!getYamlValue(tree["page-cache-max-age"],
+                         config.page_cache_max_age) ||
+           config.page_cache_max_age < 0)
+        {
+            return std::unexpected(runtimeError("Invalid page-cache-max-age"));
+        }
+    }
+    DO_OR_RETURN(parseBool(tree, "template-hot-reload", config.template_hot_reload));
+    if(tree["static-mmap-threshold"].has_key())
+    {
+        if(!getYamlValue(tree["static-mmap-threshold"],
+                         config.static_mmap_threshold) ||
+           config.static_mmap_threshold < 0)
+        {
+            return std::unexpected(runtimeError(
+                "Invalid static-mmap-threshold"));
+        }
+    }
+    if(tree["server-threads"].has_key())
+    {
+        if(!getYamlValue(tree["server-threads"], config.server_threads) ||
+           config.server_threads < 0)
+        {
+            return std::unexpected(runtimeError("Invalid server-threads"));
+        }
+    }
+    if(tree["server-max-queued"].has_key())
+    {
+        if(!getYamlValue(tree["server-max-queued"], config.server_max_queued) ||
+           config.server_max_queued < 0)
+        {
+            return std::unexpected(runtimeError("Invalid server-max-queued"));
+        }
+    }
+    if(tree["keep-alive-max-count"].has_key())
+    {
+        if(!getYamlValue(tree["keep-alive-max-count"],
+                         config.keep_alive_max_count) ||
+           config.keep_alive_max_count <= 0)
+        {
+            return std::unexpected(runtimeError(
+                "Invalid keep-alive-max-count"));
+        }
+    }
+    if(tree["keep-alive-timeout"].has_key())
+    {
+        if(!getYamlValue(tree["keep-alive-timeout"],
+                         config.keep_alive_timeout) ||
+           config.keep_alive_timeout < 0)
+        {
+            return std::unexpected(runtimeError("Invalid keep-alive-timeout"));
+        }
+    }
+    if(tree["read-timeout"].has_key())
+    {
+        if(!getYamlValue(tree["read-timeout"], config.read_timeout) ||
+           config.read_timeout < 0)
+        {
+            return std::unexpected(runtimeError("Invalid read-timeout"));
+        }
+    }
+    if(tree["write-timeout"].has_key())
+    {
+        if(!getYamlValue(tree["write-timeout"], config.write_timeout) ||
+           config.write_timeout < 0)
+        {
+            return std::unexpected(runtimeError("Invalid write-timeout"));
+        }
+    }
+    if(tree["slow-request-threshold"].has_key())
+    {
+        if(!getYamlValue(tree["slow-request-threshold"],
+                         config.slow_request_threshold) ||
+           config.slow_request_threshold < 0)
+        {
+            return std::unexpected(runtimeError(
+                "Invalid slow-request-threshold"));
+        }
+    }
+    DO_OR_RETURN(parseBool(tree, "stream-pages", config.stream_pages));
+    if(tree["group-commit-window"].has_key())
+    {
+        if(!getYamlValue(tree["group-commit-window"],
+                         config.group_commit_window) ||
+           config.group_commit_window < 0)
+        {
+            return std::unexpected(runtimeError(
+                "Invalid group-commit-window"));
+        }
+    }
+    if(tree["import-token"].has_key())
+    {
+        auto value = tree["import-token"].val();
+        config.import_token = std::string(value.begin(), value.end());
+    }
     return E<Configuration>{std::in_place, std::move(config)};
 }
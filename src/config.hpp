@@ -1,9 +1,11 @@
 #pragma once
 
+#include <cstdint>
 #include <string>
 #include <expected>
 #include <filesystem>
 
+#include "database.hpp"
 #include "error.hpp"
 
 // What should be displayed on the index page if there is no session?
@@ -21,9 +23,68 @@ struct Configuration
     std::string client_secret;
     std::string openid_url_prefix;
     std::string url_prefix;
+    // Verify JWT access tokens locally with the signing keys of the
+    // OpenID Connect service, instead of asking its user info
+    // endpoint.
+    bool openid_local_verify = false;
+    // The expected audience of the access tokens when verifying
+    // locally. Empty means the client ID.
+    std::string openid_audience;
     GuestIndex guest_index;
     std::string guest_index_user;
     std::string default_lang;
+    // Settings of the database connections, from the “storage”
+    // section.
+    SQLiteSettings storage;
+    // Number of read-only database connections. 0 means one for each
+    // worker thread of the server.
+    int db_read_connections = 0;
+    // Maximal number of validated sessions to remember. 0 disables
+    // the cache.
+    int session_cache_size = 1024;
+    // A validated session is trusted for at most this many seconds
+    // without asking the OpenID Connect server again.
+    int session_cache_ttl = 60;
+    // Memory budget in bytes for the rendered HTML of weeklies. 0
+    // disables the cache.
+    int64_t render_cache_bytes = 16 * 1024 * 1024;
+    // Memory budget in bytes for the pages of weeklies served to
+    // visitors without a session. 0 disables the cache.
+    int64_t page_cache_bytes = 32 * 1024 * 1024;
+    // A cached page is rendered again after this many seconds, even
+    // if nothing changed.
+    int page_cache_max_age = 3600;
+    // Parse the templates again when they change. This is for
+    // development.
+    bool template_hot_reload = false;
+    // Static files larger than this are memory mapped, instead of
+    // read into memory.
+    int64_t static_mmap_threshold = 256 * 1024;
+    // Number of worker threads of the server. 0 means
+    // CPPHTTPLIB_THREAD_POOL_COUNT.
+    int server_threads = 0;
+    // Maximal number of connections waiting for a worker. Beyond this
+    // new connections are answered with 503. 0 means unbounded.
+    int server_max_queued = 128;
+    // Maximal number of requests on a keep-alive connection.
+    int keep_alive_max_count = 5;
+    // In seconds.
+    int keep_alive_timeout = 5;
+    int read_timeout = 5;
+    int write_timeout = 5;
+    // Requests that take at least this many milliseconds are logged
+    // with the time spent in each stage. 0 disables this.
+    int slow_request_threshold = 1000;
+    // Send the pages of weeklies that are not cached in chunks while
+    // rendering them, instead of all at once.
+    bool stream_pages = false;
+    // Concurrent edits wait up to this many milliseconds for each
+    // other, and are committed in one transaction. 0 commits each
+    // edit on its own.
+    int group_commit_window = 0;
+    // The bearer token that authorizes bulk imports at
+    // /api/v1/import. Empty disables the endpoint.
+    std::string import_token;
 
     static E<Configuration> fromYaml(const std::filesystem::path& path);
 
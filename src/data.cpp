@@ -1,11 +1,13 @@
 #include <iterator>
 #include <string_view>
 #include <memory>
+#include <unordered_map>
 #include <vector>
 #include <expected>
 #include <tuple>
 #include <optional>
 #include <chrono>
+#include <future>
 
 #include <spdlog/spdlog.h>
 #include <sqlite3.h>
@@ -13,12 +15,39 @@
 #include "data.hpp"
 #include "database.hpp"
 #include "error.hpp"
+#include "trace.hpp"
 #include "utils.hpp"
 #include "weekly.hpp"
 
+// Formats are stored as their values.
+template<>
+struct SQLiteValue<WeeklyPost::Format>
+{
+    static constexpr int type = SQLITE_INTEGER;
+    static E<void> read(const SQLiteRow& row, int i,
+                        WeeklyPost::Format& format)
+    {
+        int value = row.getInt(i);
+        if(!WeeklyPost::isValidFormatInt(value))
+        {
+            return std::unexpected(runtimeError(std::format(
+                "Invalid format: {}", value)));
+        }
+        format = static_cast<WeeklyPost::Format>(value);
+        return {};
+    }
+};
+
 namespace
 {
 
+// A group commit starts without waiting for the rest of the window
+// once this many updates are waiting.
+constexpr size_t GROUP_COMMIT_MAX_SIZE = 256;
+// The busy timeout when there are read connections, and it is not
+// set.
+constexpr int64_t READ_POOL_BUSY_TIMEOUT_MS = 5000;
+
 // Calculate all the Monday 00:00 in a time period
 std::vector<Time> allWeekStarts(const Time& begin, const Time& end)
 {
@@ -39,21 +68,131 @@ std::vector<Time> allWeekStarts(const Time& begin, const Time& end)
     return result;
 }
 
+// The end of the one-year window that includes now. The window is
+// pinned to week boundaries, so that it does not change within a
+// week.
+Time oneYearEnd(const Time& now)
+{
+    return weekBegin(now) + std::chrono::weeks(1);
+}
+
+// The columns of the queries of weeklies, in the order they are
+// selected.
+constexpr SQLiteRowMapping WEEKLY_COLUMNS(
+    SQLiteColumn{"content", &WeeklyPost::raw_content},
+    SQLiteColumn{"format", &WeeklyPost::format},
+    SQLiteColumn{"lang", &WeeklyPost::language},
+    SQLiteColumn{"week_start", &WeeklyPost::week_begin},
+    SQLiteColumn{"update_time", &WeeklyPost::update_time});
+
+// Evaluate a query of WEEKLY_COLUMNS, and call visit with a weekly
+// object of each row, which is built from the row directly.
+template<typename Visitor>
+E<void> visitWeeklies(const SQLite& conn, SQLiteStatement& sql,
+                      const std::string& username, Visitor&& visit)
+{
+    return conn.forEachRow(sql, [&](const SQLiteRow& row) -> E<void>
+    {
+        WeeklyPost p;
+        DO_OR_RETURN(WEEKLY_COLUMNS.read(row, p));
+        p.author = username;
+        visit(std::move(p));
+        return {};
+    });
+}
+
+// Execute a statement with fixed SQL, from the statement cache.
+E<void> executeCached(SQLite& conn, std::string_view sql_code)
+{
+    ASSIGN_OR_RETURN(SQLite::CachedStatement sql,
+                     conn.cachedStatement(sql_code));
+    return conn.executeAndReset(*sql);
+}
+
+// Commit the transaction, unless SQLite has rolled it back because of
+// an error. In that case, the writes before the error are gone, and
+// must not be reported as done.
+E<void> commitIfOpen(SQLite& conn)
+{
+    if(!conn.inTransaction())
+    {
+        return std::unexpected(runtimeError(
+            "The transaction was rolled back"));
+    }
+    return executeCached(conn, "COMMIT;");
+}
+
 } // namespace
 
 
 E<std::vector<WeeklyPost>>
-DataSourceInterface::getWeekliesOneYear(const std::string& user) const
+DataSourceInterface::getWeekliesOneYear(const std::string& user,
+                                        const Time& now) const
+{
+    return this->getWeeklies(user, oneYearBegin(now), oneYearEnd(now));
+}
+
+E<std::optional<Time>>
+DataSourceInterface::getLastUpdateTimeOneYear(const std::string& user,
+                                              const Time& now) const
 {
-    auto now = Clock::now();
-    return this->getWeeklies(user, now - std::chrono::years(1), now);
+    return this->getLastUpdateTime(user, oneYearBegin(now), oneYearEnd(now));
+}
+
+Time DataSourceInterface::oneYearBegin(const Time& now)
+{
+    return oneYearEnd(now) - std::chrono::weeks(52);
+}
+
+void DataSourceInterface::addUpdateCallback(UpdateCallback callback)
+{
+    update_callbacks.push_back(std::move(callback));
+}
+
+void DataSourceInterface::notifyUpdate(const std::string& username,
+                                       const Time& week_begin) const
+{
+    for(const UpdateCallback& callback: update_callbacks)
+    {
+        callback(username, week_begin);
+    }
 }
 
 E<std::unique_ptr<DataSourceSqlite>>
-DataSourceSqlite::fromFile(const std::string& db_file)
+DataSourceSqlite::fromFile(const std::string& db_file, size_t read_connections,
+                           const SQLiteSettings& settings)
 {
     auto data_source = std::make_unique<DataSourceSqlite>();
+    // Every connection to “:memory:” is a different database, so an
+    // in-memory database cannot have a read pool.
+    bool has_readers = read_connections > 0 && db_file != ":memory:";
+    SQLiteSettings writer_settings = settings;
+    if(has_readers)
+    {
+        // In the rollback journal modes, a reader holding its lock
+        // makes a commit fail at once, and the other way around.
+        if(writer_settings.journal_mode.empty())
+        {
+            writer_settings.journal_mode = "wal";
+        }
+        if(writer_settings.journal_mode != "wal")
+        {
+            spdlog::warn("Not using read connections, because the journal "
+                         "mode is {} instead of wal.",
+                         writer_settings.journal_mode);
+            has_readers = false;
+        }
+        // Even in WAL mode, e.g. a checkpoint could briefly lock the
+        // others out.
+        else if(!writer_settings.busy_timeout.has_value())
+        {
+            writer_settings.busy_timeout = READ_POOL_BUSY_TIMEOUT_MS;
+        }
+    }
     ASSIGN_OR_RETURN(data_source->db, SQLite::connectFile(db_file));
+    // This goes before creating the tables, so that the journal mode
+    // is set before anything is written.
+    DO_OR_RETURN(data_source->db->configure(writer_settings));
     DO_OR_RETURN(data_source->db->execute(
         "CREATE TABLE IF NOT EXISTS Users "
         "(id INTEGER PRIMARY KEY ASC, name TEXT UNIQUE);"));
@@ -62,6 +201,16 @@ DataSourceSqlite::fromFile(const std::string& db_file)
         "(user_id INTEGER REFERENCES Users (id) ON DELETE CASCADE,"
         " week_start INTEGER, update_time INTEGER, format INTEGER,"
         " lang TEXT, content TEXT, UNIQUE (user_id, week_start));"));
+    if(has_readers)
+    {
+        // The journal mode is kept in the file, and cannot be set by
+        // read-only connections anyway.
+        SQLiteSettings reader_settings = writer_settings;
+        reader_settings.journal_mode.clear();
+        ASSIGN_OR_RETURN(data_source->readers, SQLitePool::connectFile(
+            db_file, read_connections,
+            SQLITE_OPEN_READONLY | SQLITE_OPEN_NOMUTEX, reader_settings));
+    }
     return data_source;
 }
 
@@ -70,10 +219,34 @@ E<std::unique_ptr<DataSourceSqlite>> DataSourceSqlite::newFromMemory()
     return fromFile(":memory:");
 }
 
+E<SQLiteSettings> DataSourceSqlite::storageSettings() const
+{
+    std::lock_guard<std::mutex> lock(write_lock);
+    return db->settings();
+}
+
+DataSourceSqlite::ReadConnection DataSourceSqlite::reader() const
+{
+    ReadConnection result;
+    if(readers == nullptr)
+    {
+        result.lock = std::unique_lock<std::mutex>(write_lock);
+        result.conn = db.get();
+    }
+    else
+    {
+        result.lease.emplace(readers->lease());
+        result.conn = &**result.lease;
+    }
+    return result;
+}
+
 E<std::vector<WeeklyPost>> DataSourceSqlite::getWeeklies(
     const std::string& username, const Time& begin, const Time& end) const
 {
-    ASSIGN_OR_RETURN(std::optional<int64_t> uid, getUserID(username));
+    Span span("DataSourceSqlite::getWeeklies");
+    ReadConnection conn = reader();
+    ASSIGN_OR_RETURN(std::optional<int64_t> uid, queryUserID(*conn, username));
     if(!uid.has_value())
     {
         return std::unexpected(runtimeError("User not found"));
@@ -81,116 +254,371 @@ E<std::vector<WeeklyPost>> DataSourceSqlite::getWeeklies(
     int64_t start = timeToSeconds(begin);
     int64_t stop = timeToSeconds(end);
     // Get all rows whose week_start is in the time period.
-    ASSIGN_OR_RETURN(auto sql, db->statementFromStr(
+    ASSIGN_OR_RETURN(auto sql, conn->cachedStatement(
         "SELECT content, format, lang, week_start, update_time FROM Weeklies "
         "WHERE user_id = ? AND week_start >= ? AND week_start < ? "
-        "ORDER BY week_start ASC;"));
-    DO_OR_RETURN(sql.bind(*uid, start, stop));
-    ASSIGN_OR_RETURN(
-        auto rows, (db->eval<std::string, int, std::string, int64_t, int64_t>(
-            std::move(sql))));
-    // Converting rows to weekly objects.
-    std::vector<WeeklyPost> weeklies;
-    weeklies.reserve(rows.size());
-    for(auto& row: rows)
-    {
-        int format = std::get<1>(row);
-        if(!WeeklyPost::isValidFormatInt(format))
-        {
-            return std::unexpected(runtimeError(std::format(
-                "Invalid format: {}", format)));
-        }
-        WeeklyPost p;
-        p.format = static_cast<WeeklyPost::Format>(format);
-        p.raw_content = std::move(std::get<0>(row));
-        p.week_begin = secondsToTime(std::get<3>(row));
-        p.update_time = secondsToTime(std::get<4>(row));
-        p.language = std::move(std::get<2>(row));
-        p.author = username;
-        weeklies.push_back(std::move(p));
-    }
+        "ORDER BY week_start ASC;",
+        WEEKLY_COLUMNS));
+    DO_OR_RETURN(sql->bind(*uid, start, stop));
 
-    // Now we have a set of weeklies, the week_begin of each of which
-    // is a Monday. However, these Mondays are only a subset of all
-    // the Mondays in the queried time period. Our goal is to return
-    // one weekly for each of the Monday in the time period. If there
-    // is not a weekly on a Monday, we return an empty weekly for
-    // that. This way the logic in the HTTP handler and the frontend
-    // is simplified.
+    // The weeklies from the query have week_begin on a Monday.
+    // However, these Mondays are only a subset of all the Mondays in
+    // the queried time period. Our goal is to return one weekly for
+    // each of the Monday in the time period. If there is not a
+    // weekly on a Monday, we return an empty weekly for that. This
+    // way the logic in the HTTP handler and the frontend is
+    // simplified.
     //
     // Our algorithm for this is the classic double pointer. We will
     // have a “pointer” for all the mondays in the time peroid, and
-    // another for the (non-empty) weeklies, both from the start of
-    // the respective sequence. If the current weekly’s week_begin
-    // happens to be the current monday, we add this weekly to the
-    // result, and advance both pointers; if not we just advance the
-    // Monday pointer.
+    // the rows of the query come in the same order. Before adding a
+    // weekly to the result, we add an empty weekly for each Monday
+    // before it. This way the rows go into the result as they are
+    // read, without a vector in between.
     //
     // I think this could be an interview question...
     std::vector<Time> week_starts = allWeekStarts(begin, end);
-    std::vector<WeeklyPost> result(week_starts.size());
+    std::vector<WeeklyPost> result;
+    result.reserve(week_starts.size());
     // The monday “pointer”
     auto monday_it = std::begin(week_starts);
-    // The weeklies “pointer”
-    auto weekly_it = std::begin(weeklies);
-    auto result_it = std::begin(result); // This should sync with monday_it.
-
-    while(true)
+    auto fill_until = [&](const Time& until)
     {
-        if(weekly_it != std::end(weeklies) &&
-           weekly_it->week_begin == *monday_it)
+        for(; monday_it != std::end(week_starts) && *monday_it < until;
+            ++monday_it)
         {
-            *result_it = *weekly_it;
-            ++monday_it;
-            ++weekly_it;
-            ++result_it;
+            WeeklyPost& empty = result.emplace_back();
+            empty.week_begin = *monday_it;
+            empty.author = username;
         }
-        else
+    };
+    DO_OR_RETURN(visitWeeklies(*conn, *sql, username, [&](WeeklyPost&& p)
+    {
+        fill_until(p.week_begin);
+        if(monday_it != std::end(week_starts) && *monday_it == p.week_begin)
         {
-            result_it->week_begin = *monday_it;
-            result_it->author = username;
+            result.push_back(std::move(p));
             ++monday_it;
-            ++result_it;
-        }
-        if(monday_it == std::end(week_starts))
-        {
-            break;
         }
+    }));
+    fill_until(Time::max());
+    return result;
+}
+
+E<std::vector<WeeklyPost>> DataSourceSqlite::getWeekliesBefore(
+    const std::string& username, const Time& before, int limit) const
+{
+    Span span("DataSourceSqlite::getWeekliesBefore");
+    ReadConnection conn = reader();
+    ASSIGN_OR_RETURN(std::optional<int64_t> uid, queryUserID(*conn, username));
+    if(!uid.has_value())
+    {
+        return std::unexpected(runtimeError("User not found"));
     }
+    // This walks the index of the unique key (user_id, week_start)
+    // backwards from before, so it only reads the rows it returns.
+    ASSIGN_OR_RETURN(auto sql, conn->cachedStatement(
+        "SELECT content, format, lang, week_start, update_time FROM Weeklies "
+        "WHERE user_id = ? AND week_start < ? "
+        "ORDER BY week_start DESC LIMIT ?;",
+        WEEKLY_COLUMNS));
+    DO_OR_RETURN(sql->bind(*uid, timeToSeconds(before), limit));
+    std::vector<WeeklyPost> weeklies;
+    DO_OR_RETURN(visitWeeklies(*conn, *sql, username, [&](WeeklyPost&& p)
+    {
+        weeklies.push_back(std::move(p));
+    }));
+    return weeklies;
+}
 
-    return result;
+struct DataSourceSqlite::PendingWrite
+{
+    const std::string& username;
+    WeeklyPost post;
+    Time update_time;
+    std::promise<E<void>> result;
+};
+
+void DataSourceSqlite::setGroupCommitWindow(std::chrono::microseconds window)
+{
+    if(window <= std::chrono::microseconds::zero())
+    {
+        group_commit.reset();
+        return;
+    }
+    group_commit = std::make_unique<GroupCommit>();
+    group_commit->window = window;
 }
 
 E<void> DataSourceSqlite::updateWeekly(
     const std::string& username, WeeklyPost&& new_post) const
 {
-    ASSIGN_OR_RETURN(std::optional<int64_t> uid, getUserID(username));
+    Span span("DataSourceSqlite::updateWeekly");
+    if(group_commit != nullptr)
+    {
+        return updateWeeklyInGroup(username, std::move(new_post));
+    }
+    std::lock_guard<std::mutex> lock(write_lock);
+    ASSIGN_OR_RETURN(std::optional<int64_t> uid, queryUserID(*db, username));
     if(!uid.has_value())
     {
-        ASSIGN_OR_RETURN(uid, createUser(username));
+        ASSIGN_OR_RETURN(uid, insertUser(*db, username));
+    }
+    ASSIGN_OR_RETURN(SQLite::CachedStatement sql, upsertStatement(*db));
+    DO_OR_RETURN(upsertWeekly(*db, *sql, *uid, new_post, Clock::now()));
+    notifyUpdate(username, new_post.week_begin);
+    return {};
+}
+
+E<void> DataSourceSqlite::updateWeeklies(std::vector<WeeklyPost>&& posts,
+                                         UserIDs* user_ids) const
+{
+    Span span("DataSourceSqlite::updateWeeklies");
+    UserIDs local_user_ids;
+    if(user_ids == nullptr)
+    {
+        user_ids = &local_user_ids;
+    }
+    {
+        std::lock_guard<std::mutex> lock(write_lock);
+        DO_OR_RETURN(executeCached(*db, "BEGIN;"));
+        // Users created in this transaction, which are forgotten if it
+        // is rolled back.
+        std::vector<std::string> new_users;
+        auto insert_all = [&]() -> E<void>
+        {
+            ASSIGN_OR_RETURN(SQLite::CachedStatement sql,
+                             upsertStatement(*db));
+            for(const WeeklyPost& p: posts)
+            {
+                auto it = user_ids->find(p.author);
+                if(it == std::end(*user_ids))
+                {
+                    ASSIGN_OR_RETURN(std::optional<int64_t> uid,
+                                     queryUserID(*db, p.author));
+                    if(!uid.has_value())
+                    {
+                        ASSIGN_OR_RETURN(uid, insertUser(*db, p.author));
+                        new_users.push_back(p.author);
+                    }
+                    it = user_ids->emplace(p.author, *uid).first;
+                }
+                DO_OR_RETURN(upsertWeekly(*db, *sql, it->second, p,
+                                          p.update_time));
+            }
+            return commitIfOpen(*db);
+        };
+        if(E<void> result = insert_all(); !result.has_value())
+        {
+            if(db->inTransaction())
+            {
+                db->execute("ROLLBACK;");
+            }
+            for(const std::string& name: new_users)
+            {
+                user_ids->erase(name);
+            }
+            return result;
+        }
+    }
+    for(const WeeklyPost& p: posts)
+    {
+        notifyUpdate(p.author, p.week_begin);
+    }
+    return {};
+}
+
+// The first caller that finds no leader becomes the leader. It waits
+// for the window, or until the queue is full, and commits everything
+// queued by then. Callers arriving while it commits queue up for the
+// next leader, so commits run back to back under load.
+E<void> DataSourceSqlite::updateWeeklyInGroup(
+    const std::string& username, WeeklyPost&& new_post) const
+{
+    PendingWrite write{username, std::move(new_post), Clock::now(), {}};
+    std::future<E<void>> result = write.result.get_future();
+    std::vector<PendingWrite*> writes;
+    {
+        std::unique_lock<std::mutex> lock(group_commit->lock);
+        group_commit->queue.push_back(&write);
+        if(group_commit->has_leader)
+        {
+            if(group_commit->queue.size() >= GROUP_COMMIT_MAX_SIZE)
+            {
+                group_commit->full.notify_one();
+            }
+        }
+        else
+        {
+            group_commit->has_leader = true;
+            group_commit->full.wait_for(
+                lock, group_commit->window, [this]
+                {
+                    return group_commit->queue.size() >=
+                        GROUP_COMMIT_MAX_SIZE;
+                });
+            writes.swap(group_commit->queue);
+            group_commit->has_leader = false;
+        }
+    }
+    if(!writes.empty())
+    {
+        Span span("DataSourceSqlite::commitGroup");
+        commitGroup(writes);
+    }
+    return result.get();
+}
+
+void DataSourceSqlite::commitGroup(
+    const std::vector<PendingWrite*>& writes) const
+{
+    std::vector<E<void>> results(writes.size());
+    {
+        std::lock_guard<std::mutex> lock(write_lock);
+        auto upsert = [this](SQLiteStatement& sql,
+                             const PendingWrite& w) -> E<void>
+        {
+            ASSIGN_OR_RETURN(std::optional<int64_t> uid,
+                             queryUserID(*db, w.username));
+            if(!uid.has_value())
+            {
+                ASSIGN_OR_RETURN(uid, insertUser(*db, w.username));
+            }
+            return upsertWeekly(*db, sql, *uid, w.post, w.update_time);
+        };
+        auto write_all = [&]() -> E<void>
+        {
+            DO_OR_RETURN(executeCached(*db, "BEGIN;"));
+            ASSIGN_OR_RETURN(SQLite::CachedStatement sql,
+                             upsertStatement(*db));
+            // Each write has its own savepoint, so that a failed write
+            // does not fail the others, unless SQLite has rolled back
+            // the whole transaction. Then the writes before it are
+            // gone too, and the group fails.
+            for(size_t i = 0; i < writes.size(); i++)
+            {
+                DO_OR_RETURN(executeCached(*db, "SAVEPOINT group_write;"));
+                results[i] = upsert(*sql, *writes[i]);
+                if(!results[i].has_value())
+                {
+                    if(!db->inTransaction())
+                    {
+                        return std::unexpected(results[i].error());
+                    }
+                    DO_OR_RETURN(executeCached(*db,
+                                               "ROLLBACK TO group_write;"));
+                }
+                DO_OR_RETURN(executeCached(*db, "RELEASE group_write;"));
+            }
+            return commitIfOpen(*db);
+        };
+        if(E<void> committed = write_all(); !committed.has_value())
+        {
+            if(db->inTransaction())
+            {
+                db->execute("ROLLBACK;");
+            }
+            for(E<void>& result: results)
+            {
+                if(result.has_value())
+                {
+                    result = committed;
+                }
+            }
+        }
+    }
+    for(size_t i = 0; i < writes.size(); i++)
+    {
+        if(results[i].has_value())
+        {
+            notifyUpdate(writes[i]->username, writes[i]->post.week_begin);
+        }
+        // This wakes up the caller, which then destroys the write.
+        writes[i]->result.set_value(std::move(results[i]));
     }
-    ASSIGN_OR_RETURN(auto sql, db->statementFromStr(
+}
+
+E<SQLite::CachedStatement> DataSourceSqlite::upsertStatement(SQLite& conn)
+{
+    return conn.cachedStatement(
         "INSERT INTO weeklies "
         "(user_id, week_start, update_time, format, lang, content) "
         "VALUES (?, ?, ?, ?, ?, ?) ON CONFLICT DO UPDATE SET update_time = ?, "
-        "format = ?, lang = ?, content = ?;"));
-    int64_t now = timeToSeconds(Clock::now());
+        "format = ?, lang = ?, content = ?;");
+}
+
+E<void> DataSourceSqlite::upsertWeekly(SQLite& conn, SQLiteStatement& sql,
+                                       int64_t uid, const WeeklyPost& post,
+                                       const Time& update_time)
+{
+    int64_t update_seconds = timeToSeconds(update_time);
     DO_OR_RETURN(sql.bind(
-        *uid, timeToSeconds(new_post.week_begin), now,
-        static_cast<int>(new_post.format), new_post.language,
-        new_post.raw_content, now, static_cast<int>(new_post.format),
-        new_post.language, new_post.raw_content));
-    return db->execute(std::move(sql));
+        uid, timeToSeconds(post.week_begin), update_seconds,
+        static_cast<int>(post.format), post.language,
+        post.raw_content, update_seconds, static_cast<int>(post.format),
+        post.language, post.raw_content));
+    return conn.executeAndReset(sql);
 }
 
 E<std::optional<int64_t>>
 DataSourceSqlite::getUserID(const std::string& name) const
 {
-    ASSIGN_OR_RETURN(auto sql, db->statementFromStr(
+    Span span("DataSourceSqlite::getUserID");
+    return queryUserID(*reader(), name);
+}
+
+E<std::optional<Time>> DataSourceSqlite::getLastUpdateTime(
+    const std::string& username, const Time& begin, const Time& end) const
+{
+    Span span("DataSourceSqlite::getLastUpdateTime");
+    ReadConnection conn = reader();
+    ASSIGN_OR_RETURN(auto sql, conn->cachedStatement(
+        "SELECT Weeklies.update_time FROM Weeklies "
+        "JOIN Users ON Users.id = Weeklies.user_id "
+        "WHERE Users.name = ? AND week_start >= ? AND week_start < ? "
+        "ORDER BY Weeklies.update_time DESC LIMIT 1;"));
+    DO_OR_RETURN(sql->bind(username, timeToSeconds(begin),
+                           timeToSeconds(end)));
+    ASSIGN_OR_RETURN(std::vector<std::tuple<int64_t>> rows,
+                     conn->evalAndReset<int64_t>(*sql));
+    if(rows.empty())
+    {
+        return std::nullopt;
+    }
+    return secondsToTime(std::get<0>(rows[0]));
+}
+
+E<bool> DataSourceSqlite::hasWeekliesBefore(const std::string& username,
+                                            const Time& before) const
+{
+    Span span("DataSourceSqlite::hasWeekliesBefore");
+    ReadConnection conn = reader();
+    // This only looks at the index of (user_id, week_start).
+    ASSIGN_OR_RETURN(auto sql, conn->cachedStatement(
+        "SELECT EXISTS (SELECT 1 FROM Weeklies "
+        "JOIN Users ON Users.id = Weeklies.user_id "
+        "WHERE Users.name = ? AND week_start < ?);"));
+    DO_OR_RETURN(sql->bind(username, timeToSeconds(before)));
+    ASSIGN_OR_RETURN(std::vector<std::tuple<int64_t>> rows,
+                     conn->evalAndReset<int64_t>(*sql));
+    return !rows.empty() && std::get<0>(rows[0]) != 0;
+}
+
+E<int64_t> DataSourceSqlite::createUser(const std::string& name) const
+{
+    Span span("DataSourceSqlite::createUser");
+    std::lock_guard<std::mutex> lock(write_lock);
+    return insertUser(*db, name);
+}
+
+E<std::optional<int64_t>>
+DataSourceSqlite::queryUserID(SQLite& conn, const std::string& name)
+{
+    ASSIGN_OR_RETURN(auto sql, conn.cachedStatement(
         "SELECT id FROM Users WHERE name = ?;"));
-    DO_OR_RETURN(sql.bind(name));
+    DO_OR_RETURN(sql->bind(name));
     ASSIGN_OR_RETURN(std::vector<std::tuple<int64_t>> result,
-                     db->eval<int64_t>(std::move(sql)));
+                     conn.evalAndReset<int64_t>(*sql));
     if(result.empty())
     {
         return std::nullopt;
@@ -203,11 +631,11 @@ DataSourceSqlite::getUserID(const std::string& name) const
     return std::get<0>(result[0]);
 }
 
-E<int64_t> DataSourceSqlite::createUser(const std::string& name) const
+E<int64_t> DataSourceSqlite::insertUser(SQLite& conn, const std::string& name)
 {
-    ASSIGN_OR_RETURN(auto sql, db->statementFromStr(
+    ASSIGN_OR_RETURN(auto sql, conn.cachedStatement(
         "INSERT INTO Users (name) VALUES (?);"));
-    DO_OR_RETURN(sql.bind(name));
-    DO_OR_RETURN(db->execute(std::move(sql)));
-    return db->lastInsertRowID();
+    DO_OR_RETURN(sql->bind(name));
+    DO_OR_RETURN(conn.executeAndReset(*sql));
+    return conn.lastInsertRowID();
 }
@@ -1,6 +1,11 @@
 #pragma once
+#include <chrono>
+#include <condition_variable>
+#include <functional>
 #include <memory>
+#include <mutex>
 #include <tuple>
+#include <unordered_map>
 #include <vector>
 #include <string>
 #include <string_view>
@@ -20,15 +25,68 @@ public:
         const std::string& user, const Time& begin, const Time& end) const = 0;
     virtual E<void> updateWeekly(const std::string& username,
                                  WeeklyPost&& new_post) const = 0;
+    // IDs of users by name.
+    using UserIDs = std::unordered_map<std::string, int64_t>;
+    // Update or create many weeklies in one transaction, which is
+    // much faster than updating them one by one. The author of each
+    // post is its user, and its update_time is kept. If anything
+    // fails, nothing is changed. If user_ids is not null, the IDs of
+    // the users are looked up there first, and added to it, so that
+    // callers writing many batches only look up each user once.
+    virtual E<void> updateWeeklies(std::vector<WeeklyPost>&& posts,
+                                   UserIDs* user_ids = nullptr) const = 0;
     virtual E<std::optional<int64_t>> getUserID(const std::string& name) const
     = 0;
+    // Return the latest update time of the weeklies of a user, from
+    // begin (inclusive) to end (exclusive), or nullopt if there is
+    // none. This is much cheaper than getting the weeklies.
+    virtual E<std::optional<Time>> getLastUpdateTime(
+        const std::string& user, const Time& begin, const Time& end) const = 0;
+    // Return at most limit weeklies of a user that begin before
+    // before, from new to old. Unlike getWeeklies(), weeks without a
+    // weekly are skipped. This is for paging through the archive, and
+    // costs the same however many weeklies the user has.
+    virtual E<std::vector<WeeklyPost>> getWeekliesBefore(
+        const std::string& user, const Time& before, int limit) const = 0;
+    // Whether the user has any weekly that begins before before. Like
+    // getLastUpdateTime(), this does not read the weeklies.
+    virtual E<bool> hasWeekliesBefore(const std::string& user,
+                                      const Time& before) const = 0;
+
+    // Convenient function to get weeklies in the last year, i.e. the
+    // 52 weeks up to and including the week of now.
+    E<std::vector<WeeklyPost>> getWeekliesOneYear(
+        const std::string& user, const Time& now = Clock::now()) const;
+    // The latest update time of the weeklies that
+    // getWeekliesOneYear() would return.
+    E<std::optional<Time>> getLastUpdateTimeOneYear(
+        const std::string& user, const Time& now = Clock::now()) const;
+    // The beginning of the first week that getWeekliesOneYear()
+    // returns.
+    static Time oneYearBegin(const Time& now);
+
+    // Called after a weekly is successfully updated, e.g. to
+    // invalidate caches of the weekly.
+    using UpdateCallback = std::function<void(const std::string& username,
+                                              const Time& week_begin)>;
+    // This is not thread-safe. Callbacks should be added before the
+    // data source is used by multiple threads.
+    void addUpdateCallback(UpdateCallback callback);
 
-    // Convenient function to get weeklies in the last year.
-    E<std::vector<WeeklyPost>> getWeekliesOneYear(const std::string& user) const;
+protected:
+    void notifyUpdate(const std::string& username,
+                      const Time& week_begin) const;
+
+private:
+    std::vector<UpdateCallback> update_callbacks;
 };
 
 // Username and start time of the week uniquely identify a weekly
 // post.
+//
+// All writes go through a single writer connection. Reads go through
+// a pool of read-only connections if there is one, so that they can
+// run in parallel; otherwise they share the writer connection.
 class DataSourceSqlite : public DataSourceInterface
 {
 public:
@@ -39,8 +97,16 @@ public:
     DataSourceSqlite(const DataSourceSqlite&) = delete;
     DataSourceSqlite& operator=(const DataSourceSqlite&) = delete;
 
+    // Open the database file, and also open read_connections
+    // read-only connections to it for the readers. Normally this
+    // should be the number of worker threads of the server. The
+    // settings are applied to all the connections. The read
+    // connections need WAL mode, so it is the default when there are
+    // any, together with a busy timeout; with another journal mode,
+    // there are no read connections.
     static E<std::unique_ptr<DataSourceSqlite>>
-    fromFile(const std::string& db_file);
+    fromFile(const std::string& db_file, size_t read_connections = 0,
+             const SQLiteSettings& settings = {});
     static E<std::unique_ptr<DataSourceSqlite>> newFromMemory();
 
     // Return the weeklies of a user, from begin (inclusive) to end
@@ -57,13 +123,78 @@ public:
     // behavior.
     E<void> updateWeekly(const std::string& username,
                          WeeklyPost&& new_post) const;
+    // The settings in effect on the writer connection.
+    E<SQLiteSettings> storageSettings() const;
+    // Let concurrent updateWeekly() calls wait up to window for each
+    // other, and commit them in one transaction. Each call still
+    // returns only after its weekly is committed, with its own
+    // result. A zero window, the default, commits each update on its
+    // own. This is not thread-safe, and should be called before the
+    // data source is used by multiple threads.
+    void setGroupCommitWindow(std::chrono::microseconds window);
+    E<void> updateWeeklies(std::vector<WeeklyPost>&& posts,
+                           UserIDs* user_ids = nullptr) const override;
     E<std::optional<int64_t>> getUserID(const std::string& name) const;
+    E<std::optional<Time>> getLastUpdateTime(
+        const std::string& user, const Time& begin, const Time& end)
+        const override;
+    E<std::vector<WeeklyPost>> getWeekliesBefore(
+        const std::string& user, const Time& before, int limit)
+        const override;
+    E<bool> hasWeekliesBefore(const std::string& user, const Time& before)
+        const override;
     // Create a user and return user_id.
     E<int64_t> createUser(const std::string& name) const;
 
     // Do not use.
     DataSourceSqlite() = default;
 private:
+    // A connection for reading, together with whatever keeps other
+    // threads off it while it is in use.
+    struct ReadConnection
+    {
+        std::optional<SQLitePool::Lease> lease;
+        std::unique_lock<std::mutex> lock;
+        SQLite* conn = nullptr;
+
+        SQLite* operator->() const { return conn; }
+        SQLite& operator*() const { return *conn; }
+    };
+    ReadConnection reader() const;
+
+    static E<std::optional<int64_t>> queryUserID(SQLite& conn,
+                                                 const std::string& name);
+    static E<int64_t> insertUser(SQLite& conn, const std::string& name);
+    // An updateWeekly() call waiting in a group commit.
+    struct PendingWrite;
+    // Updates waiting to be committed together.
+    struct GroupCommit
+    {
+        std::chrono::microseconds window;
+        std::mutex lock;
+        // Notified when the queue is full.
+        std::condition_variable full;
+        std::vector<PendingWrite*> queue;
+        // Whether a caller is waiting to commit the queue.
+        bool has_leader = false;
+    };
+    E<void> updateWeeklyInGroup(const std::string& username,
+                                WeeklyPost&& new_post) const;
+    // Commit the writes in one transaction, and give each its result.
+    void commitGroup(const std::vector<PendingWrite*>& writes) const;
+
+    // The statement that upsertWeekly() takes.
+    static E<SQLite::CachedStatement> upsertStatement(SQLite& conn);
+    static E<void> upsertWeekly(SQLite& conn, SQLiteStatement& sql,
+                                int64_t uid, const WeeklyPost& post,
+                                const Time& update_time);
 
+    // The writer connection.
     std::unique_ptr<SQLite> db;
+    mutable std::mutex write_lock;
+    // Read-only connections. Could be null, in which case the readers
+    // use the writer connection.
+    std::unique_ptr<SQLitePool> readers;
+    // Null if group commit is disabled.
+    std::unique_ptr<GroupCommit> group_commit;
 };
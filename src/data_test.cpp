@@ -1,5 +1,12 @@
+#include <atomic>
 #include <optional>
+#include <string>
 #include <chrono>
+#include <filesystem>
+#include <format>
+#include <mutex>
+#include <thread>
+#include <vector>
 
 #include <gtest/gtest.h>
 #include <gmock/gmock.h>
@@ -10,6 +17,8 @@
 #include "weekly.hpp"
 #include "test_utils.hpp"
 
+using ::testing::Each;
+using ::testing::ElementsAre;
 using ::testing::IsEmpty;
 
 TEST(DataSource, GettingNonExistUserIsNotError)
@@ -49,3 +58,264 @@ TEST(DataSource, CanCreateAndGetWeekly)
     EXPECT_EQ(ps[1].language, p.language);
     EXPECT_EQ(ps[1].author, "mw");
 }
+
+TEST(DataSource, UpdateCallsUpdateCallbacks)
+{
+    ASSIGN_OR_FAIL(auto data, DataSourceSqlite::newFromMemory());
+    std::vector<std::string> updated;
+    data->addUpdateCallback([&](const std::string& username, const Time&)
+    {
+        updated.push_back(username);
+    });
+    WeeklyPost p;
+    p.format = WeeklyPost::MARKDOWN;
+    p.week_begin = std::chrono::sys_days(std::chrono::January / 3 / 2000);
+    EXPECT_TRUE(isExpected(data->updateWeekly("mw", std::move(p))));
+    EXPECT_THAT(updated, ElementsAre("mw"));
+}
+
+TEST(DataSource, CanUpdateManyWeekliesAtOnce)
+{
+    ASSIGN_OR_FAIL(auto data, DataSourceSqlite::newFromMemory());
+    std::vector<std::string> updated;
+    data->addUpdateCallback([&](const std::string& username, const Time&)
+    {
+        updated.push_back(username);
+    });
+    Time monday = std::chrono::sys_days(std::chrono::January / 3 / 2000);
+    std::vector<WeeklyPost> posts;
+    for(const char* author: {"mw", "mw", "xyz"})
+    {
+        WeeklyPost p;
+        p.format = WeeklyPost::MARKDOWN;
+        p.author = author;
+        p.raw_content = std::string("by ") + author;
+        p.week_begin = monday + std::chrono::weeks(posts.size());
+        p.update_time = p.week_begin + std::chrono::days(2);
+        posts.push_back(std::move(p));
+    }
+    ASSERT_TRUE(isExpected(data->updateWeeklies(std::move(posts))));
+    EXPECT_THAT(updated, ElementsAre("mw", "mw", "xyz"));
+
+    ASSIGN_OR_FAIL(std::vector<WeeklyPost> ps, data->getWeeklies(
+        "mw", monday, monday + std::chrono::weeks(3)));
+    ASSERT_EQ(ps.size(), 3);
+    EXPECT_EQ(ps[0].raw_content, "by mw");
+    EXPECT_EQ(ps[1].raw_content, "by mw");
+    EXPECT_THAT(ps[2].raw_content, IsEmpty());
+    // The update time is kept.
+    EXPECT_EQ(ps[1].update_time, ps[1].week_begin + std::chrono::days(2));
+    ASSIGN_OR_FAIL(std::optional<int64_t> uid, data->getUserID("xyz"));
+    EXPECT_TRUE(uid.has_value());
+}
+
+TEST(DataSource, GroupCommitGivesEachUpdateItsResult)
+{
+    ASSIGN_OR_FAIL(auto data, DataSourceSqlite::newFromMemory());
+    std::mutex updated_lock;
+    std::vector<std::string> updated;
+    data->addUpdateCallback([&](const std::string& username, const Time&)
+    {
+        std::lock_guard lock(updated_lock);
+        updated.push_back(username);
+    });
+    const std::chrono::milliseconds window(100);
+    data->setGroupCommitWindow(window);
+    Time monday = std::chrono::sys_days(std::chrono::January / 3 / 2000);
+
+    std::vector<std::thread> threads;
+    std::vector<int> succeeded(8);
+    auto begin = std::chrono::steady_clock::now();
+    for(size_t i = 0; i < succeeded.size(); i++)
+    {
+        threads.emplace_back([&, i]()
+        {
+            WeeklyPost p;
+            p.format = WeeklyPost::MARKDOWN;
+            p.raw_content = std::format("post {}", i);
+            p.week_begin = monday + std::chrono::weeks(i / 2);
+            std::string user = i % 2 == 0 ? "aaa" : "bbb";
+            succeeded[i] = data->updateWeekly(user, std::move(p)).has_value();
+        });
+    }
+    for(auto& t: threads)
+    {
+        t.join();
+    }
+    // One by one, each update would wait for the whole window.
+    EXPECT_LT(std::chrono::steady_clock::now() - begin,
+              window * succeeded.size());
+    EXPECT_THAT(succeeded, Each(1));
+    EXPECT_EQ(updated.size(), succeeded.size());
+
+    ASSIGN_OR_FAIL(std::vector<WeeklyPost> ps, data->getWeeklies(
+        "bbb", monday, monday + std::chrono::weeks(4)));
+    ASSERT_EQ(ps.size(), 4);
+    for(size_t i = 0; i < ps.size(); i++)
+    {
+        EXPECT_EQ(ps[i].raw_content, std::format("post {}", i * 2 + 1));
+    }
+}
+
+TEST(DataSource, ReadPoolCanReadInParallel)
+{
+    std::string db_file = (std::filesystem::temp_directory_path() /
+                           "nsweekly-data-test.db").string();
+    std::filesystem::remove(db_file);
+    Time begin = std::chrono::sys_days(std::chrono::January / 3 / 2000);
+    Time end = std::chrono::sys_days(std::chrono::January / 31 / 2000);
+    {
+        ASSIGN_OR_FAIL(auto data, DataSourceSqlite::fromFile(db_file, 4));
+        for(const char* user: {"aaa", "bbb", "ccc", "ddd"})
+        {
+            WeeklyPost p;
+            p.format = WeeklyPost::MARKDOWN;
+            p.raw_content = user;
+            p.week_begin = begin;
+            ASSERT_TRUE(isExpected(data->updateWeekly(user, std::move(p))));
+        }
+
+        std::vector<std::thread> threads;
+        std::vector<std::string> contents(8);
+        for(size_t i = 0; i < contents.size(); i++)
+        {
+            threads.emplace_back([&, i]()
+            {
+                std::string user = (i % 2 == 0) ? "aaa" : "ddd";
+                auto ps = data->getWeeklies(user, begin, end);
+                if(ps.has_value() && ps->size() == 4)
+                {
+                    contents[i] = (*ps)[0].raw_content;
+                }
+            });
+        }
+        for(auto& t: threads)
+        {
+            t.join();
+        }
+        for(size_t i = 0; i < contents.size(); i++)
+        {
+            EXPECT_EQ(contents[i], (i % 2 == 0) ? "aaa" : "ddd");
+        }
+    }
+    std::filesystem::remove(db_file);
+}
+
+TEST(DataSource, ReadPoolCanReadWhileWriting)
+{
+    std::string db_file = (std::filesystem::temp_directory_path() /
+                           "nsweekly-data-test.db").string();
+    std::filesystem::remove(db_file);
+    Time begin = std::chrono::sys_days(std::chrono::January / 3 / 2000);
+    Time end = begin + std::chrono::weeks(40);
+    {
+        ASSIGN_OR_FAIL(auto data, DataSourceSqlite::fromFile(db_file, 4));
+        ASSIGN_OR_FAIL(auto settings, data->storageSettings());
+        EXPECT_EQ(settings.journal_mode, "wal");
+
+        std::atomic<int> failures = 0;
+        std::vector<std::thread> threads;
+        threads.emplace_back([&]()
+        {
+            for(int i = 0; i < 40; i++)
+            {
+                WeeklyPost p;
+                p.format = WeeklyPost::MARKDOWN;
+                p.raw_content = std::format("{}", i);
+                p.week_begin = begin + std::chrono::weeks(i);
+                if(!data->updateWeekly("aaa", std::move(p)).has_value())
+                {
+                    failures++;
+                }
+            }
+        });
+        for(int i = 0; i < 4; i++)
+        {
+            threads.emplace_back([&]()
+            {
+                for(int j = 0; j < 40; j++)
+                {
+                    // The user does not exist before the first
+                    // write.
+                    auto ps = data->getWeeklies("aaa", begin, end);
+                    if(!ps.has_value() &&
+                       errorMsg(ps.error()) != "User not found")
+                    {
+                        failures++;
+                    }
+                }
+            });
+        }
+        for(auto& t: threads)
+        {
+            t.join();
+        }
+        EXPECT_EQ(failures, 0);
+        ASSIGN_OR_FAIL(auto ps, data->getWeeklies("aaa", begin, end));
+        ASSERT_EQ(ps.size(), 40);
+        EXPECT_EQ(ps[39].raw_content, "39");
+    }
+    std::filesystem::remove(db_file);
+}
+
+TEST(DataSource, CanGetLastUpdateTime)
+{
+    Time begin = std::chrono::sys_days(std::chrono::January / 3 / 2000);
+    Time end = std::chrono::sys_days(std::chrono::January / 17 / 2000);
+    ASSIGN_OR_FAIL(auto data, DataSourceSqlite::newFromMemory());
+    ASSIGN_OR_FAIL(std::optional<Time> t,
+                   data->getLastUpdateTime("mw", begin, end));
+    EXPECT_FALSE(t.has_value());
+
+    Time before = std::chrono::floor<std::chrono::seconds>(Clock::now());
+    WeeklyPost p;
+    p.format = WeeklyPost::MARKDOWN;
+    p.week_begin = begin;
+    ASSERT_TRUE(isExpected(data->updateWeekly("mw", std::move(p))));
+    ASSIGN_OR_FAIL(t, data->getLastUpdateTime("mw", begin, end));
+    ASSERT_TRUE(t.has_value());
+    EXPECT_GE(*t, before);
+    ASSIGN_OR_FAIL(t, data->getLastUpdateTime(
+        "mw", end, end + std::chrono::weeks(1)));
+    EXPECT_FALSE(t.has_value());
+}
+
+TEST(DataSource, CanGetWeekliesBefore)
+{
+    Time begin = std::chrono::sys_days(std::chrono::January / 3 / 2000);
+    ASSIGN_OR_FAIL(auto data, DataSourceSqlite::newFromMemory());
+    // Every other week has a weekly.
+    for(int i = 0; i < 10; i += 2)
+    {
+        WeeklyPost p;
+        p.format = WeeklyPost::MARKDOWN;
+        p.raw_content = std::to_string(i);
+        p.week_begin = begin + std::chrono::weeks(i);
+        ASSERT_TRUE(isExpected(data->updateWeekly("mw", std::move(p))));
+    }
+
+    ASSIGN_OR_FAIL(std::vector<WeeklyPost> ws, data->getWeekliesBefore(
+        "mw", begin + std::chrono::weeks(7), 2));
+    ASSERT_EQ(ws.size(), 2);
+    EXPECT_EQ(ws[0].raw_content, "6");
+    EXPECT_EQ(ws[1].raw_content, "4");
+    EXPECT_EQ(ws[1].author, "mw");
+
+    // The next page.
+    ASSIGN_OR_FAIL(ws, data->getWeekliesBefore("mw", ws[1].week_begin, 10));
+    ASSERT_EQ(ws.size(), 2);
+    EXPECT_EQ(ws[0].raw_content, "2");
+    EXPECT_EQ(ws[1].raw_content, "0");
+    ASSIGN_OR_FAIL(ws, data->getWeekliesBefore("mw", begin, 10));
+    EXPECT_TRUE(ws.empty());
+
+    EXPECT_FALSE(data->getWeekliesBefore("nobody", begin, 10).has_value());
+
+    ASSIGN_OR_FAIL(bool has_older, data->hasWeekliesBefore(
+        "mw", begin + std::chrono::days(1)));
+    EXPECT_TRUE(has_older);
+    ASSIGN_OR_FAIL(has_older, data->hasWeekliesBefore("mw", begin));
+    EXPECT_FALSE(has_older);
+    ASSIGN_OR_FAIL(has_older, data->hasWeekliesBefore("nobody", Time::max()));
+    EXPECT_FALSE(has_older);
+}
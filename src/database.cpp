@@ -1,3 +1,8 @@
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <format>
+#include <string>
 #include <string_view>
 #include <memory>
 #include <vector>
@@ -10,6 +15,115 @@
 
 #include "database.hpp"
 #include "error.hpp"
+#include "metrics.hpp"
+
+bool internal::declTypeAllows(std::string_view decl_type, int type)
+{
+    std::string upper(decl_type);
+    std::transform(std::begin(upper), std::end(upper), std::begin(upper),
+                   [](unsigned char c) { return std::toupper(c); });
+    auto has = [&](std::string_view part)
+    {
+        return upper.find(part) != std::string::npos;
+    };
+    // The rules of https://www.sqlite.org/datatype3.html, in order.
+    if(has("INT"))
+    {
+        return type == SQLITE_INTEGER;
+    }
+    if(has("CHAR") || has("CLOB") || has("TEXT"))
+    {
+        return type == SQLITE_TEXT;
+    }
+    if(upper.empty() || has("BLOB"))
+    {
+        // No affinity keeps anything as it is.
+        return true;
+    }
+    if(has("REAL") || has("FLOA") || has("DOUB"))
+    {
+        return type == SQLITE_FLOAT;
+    }
+    // Numeric affinity.
+    return type == SQLITE_INTEGER || type == SQLITE_FLOAT;
+}
+
+Histogram& internal::evalLatency()
+{
+    return Metrics::global().histogram(
+        "nsweekly_sqlite_eval_duration_seconds",
+        "Time of evaluating SQL statements.");
+}
+
+namespace
+{
+
+const std::array<std::string_view, 6> JOURNAL_MODES = {
+    "delete", "truncate", "persist", "memory", "wal", "off",
+};
+// Indexed by the values of the PRAGMAs.
+const std::array<std::string_view, 4> SYNCHRONOUS_MODES = {
+    "off", "normal", "full", "extra",
+};
+const std::array<std::string_view, 3> TEMP_STORES = {
+    "default", "file", "memory",
+};
+
+// The values are put in the PRAGMA statements as they are, so only
+// the known ones are allowed.
+template<size_t N>
+E<void> checkSetting(const std::array<std::string_view, N>& values,
+                     const std::string& value, const char* name)
+{
+    if(std::find(std::begin(values), std::end(values), value) ==
+       std::end(values))
+    {
+        return std::unexpected(runtimeError(std::format(
+            "Invalid {}: {}", name, value)));
+    }
+    return {};
+}
+
+template<size_t N>
+std::string settingName(const std::array<std::string_view, N>& values,
+                        int64_t i)
+{
+    if(i < 0 || static_cast<size_t>(i) >= N)
+    {
+        return std::to_string(i);
+    }
+    return std::string(values[i]);
+}
+
+} // namespace
+
+std::string SQLiteSettings::str() const
+{
+    std::string result;
+    auto append = [&](const char* name, const std::string& value)
+    {
+        if(value.empty())
+        {
+            return;
+        }
+        if(!result.empty())
+        {
+            result += ' ';
+        }
+        result += std::format("{}={}", name, value);
+    };
+    auto to_str = [](const std::optional<int64_t>& value)
+    {
+        return value.has_value() ? std::to_string(*value) : std::string();
+    };
+    append("journal_mode", journal_mode);
+    append("synchronous", synchronous);
+    append("temp_store", temp_store);
+    append("mmap_size", to_str(mmap_size));
+    append("cache_size", to_str(cache_size));
+    append("busy_timeout", to_str(busy_timeout));
+    return result;
+}
 
 SQLiteStatement::SQLiteStatement(SQLiteStatement&& rhs)
 {
@@ -42,8 +156,19 @@ E<SQLiteStatement> SQLiteStatement::fromStr(sqlite3* db, const char* expr)
     return E<SQLiteStatement>{std::in_place, std::move(s)};
 }
 
+E<void> SQLiteStatement::reset() const
+{
+    // sqlite3_reset() returns the error of the last evaluation, which
+    // is already reported by then.
+    sqlite3_reset(sql);
+    return internal::sqlMaybe(sqlite3_clear_bindings(sql),
+                              "Failed to clear bindings");
+}
+
 void SQLite::clear()
 {
+    // sqlite3_close() fails if there are statements left.
+    statement_cache.clear();
     if(db != nullptr)
     {
         sqlite3_close(db);
@@ -52,10 +177,10 @@ void SQLite::clear()
 }
 
 E<std::unique_ptr<SQLite>>
-SQLite::connectFile(const std::string& db_file)
+SQLite::connectFile(const std::string& db_file, int flags)
 {
     auto data = std::make_unique<SQLite>();
-    if(int code = sqlite3_open(db_file.c_str(), &data->db);
+    if(int code = sqlite3_open_v2(db_file.c_str(), &data->db, flags, nullptr);
        code != SQLITE_OK)
     {
         data->clear();
@@ -70,11 +195,167 @@ E<std::unique_ptr<SQLite>> SQLite::connectMemory()
     return connectFile(":memory:");
 }
 
+E<void> SQLite::configure(const SQLiteSettings& settings) const
+{
+    // The busy timeout goes first, so that changing the journal mode
+    // waits for other connections.
+    if(settings.busy_timeout.has_value())
+    {
+        DO_OR_RETURN(execute(std::format("PRAGMA busy_timeout = {};",
+                                         *settings.busy_timeout)));
+    }
+    if(!settings.journal_mode.empty())
+    {
+        DO_OR_RETURN(checkSetting(JOURNAL_MODES, settings.journal_mode,
+                                  "journal mode"));
+        DO_OR_RETURN(execute(std::format("PRAGMA journal_mode = {};",
+                                         settings.journal_mode)));
+    }
+    if(!settings.synchronous.empty())
+    {
+        DO_OR_RETURN(checkSetting(SYNCHRONOUS_MODES, settings.synchronous,
+                                  "synchronous"));
+        DO_OR_RETURN(execute(std::format("PRAGMA synchronous = {};",
+                                         settings.synchronous)));
+    }
+    if(!settings.temp_store.empty())
+    {
+        DO_OR_RETURN(checkSetting(TEMP_STORES, settings.temp_store,
+                                  "temp store"));
+        DO_OR_RETURN(execute(std::format("PRAGMA temp_store = {};",
+                                         settings.temp_store)));
+    }
+    if(settings.mmap_size.has_value())
+    {
+        DO_OR_RETURN(execute(std::format("PRAGMA mmap_size = {};",
+                                         *settings.mmap_size)));
+    }
+    if(settings.cache_size.has_value())
+    {
+        DO_OR_RETURN(execute(std::format("PRAGMA cache_size = {};",
+                                         *settings.cache_size)));
+    }
+    return {};
+}
+
+E<SQLiteSettings> SQLite::settings() const
+{
+    // Some PRAGMAs return nothing if SQLite is built without the
+    // feature.
+    auto pragma = [this](const char* name) -> E<std::optional<int64_t>>
+    {
+        ASSIGN_OR_RETURN(auto rows, eval<int64_t>(
+            std::format("PRAGMA {};", name)));
+        if(rows.empty())
+        {
+            return std::nullopt;
+        }
+        return std::get<0>(rows[0]);
+    };
+    SQLiteSettings result;
+    ASSIGN_OR_RETURN(auto journal_mode,
+                     eval<std::string>("PRAGMA journal_mode;"));
+    if(!journal_mode.empty())
+    {
+        result.journal_mode = std::get<0>(journal_mode[0]);
+    }
+    ASSIGN_OR_RETURN(std::optional<int64_t> synchronous,
+                     pragma("synchronous"));
+    if(synchronous.has_value())
+    {
+        result.synchronous = settingName(SYNCHRONOUS_MODES, *synchronous);
+    }
+    ASSIGN_OR_RETURN(std::optional<int64_t> temp_store, pragma("temp_store"));
+    if(temp_store.has_value())
+    {
+        result.temp_store = settingName(TEMP_STORES, *temp_store);
+    }
+    ASSIGN_OR_RETURN(result.mmap_size, pragma("mmap_size"));
+    ASSIGN_OR_RETURN(result.cache_size, pragma("cache_size"));
+    ASSIGN_OR_RETURN(result.busy_timeout, pragma("busy_timeout"));
+    return result;
+}
+
 E<SQLiteStatement> SQLite::statementFromStr(const char* s)
 {
     return SQLiteStatement::fromStr(db, s);
 }
 
+SQLite::CachedStatement::CachedStatement(CacheEntry* e)
+        : sql(&e->sql), entry(e)
+{
+    entry->in_use = true;
+}
+
+SQLite::CachedStatement::CachedStatement(SQLiteStatement&& s)
+        : owned(std::move(s)), sql(&owned)
+{
+}
+
+SQLite::CachedStatement::CachedStatement(CachedStatement&& rhs)
+{
+    *this = std::move(rhs);
+}
+
+SQLite::CachedStatement&
+SQLite::CachedStatement::operator=(CachedStatement&& rhs)
+{
+    giveBack();
+    if(rhs.sql == &rhs.owned)
+    {
+        owned = std::move(rhs.owned);
+        sql = &owned;
+    }
+    else
+    {
+        sql = rhs.sql;
+    }
+    entry = rhs.entry;
+    rhs.sql = nullptr;
+    rhs.entry = nullptr;
+    return *this;
+}
+
+SQLite::CachedStatement::~CachedStatement()
+{
+    giveBack();
+}
+
+void SQLite::CachedStatement::giveBack()
+{
+    if(sql != nullptr)
+    {
+        sql->reset();
+    }
+    if(entry != nullptr)
+    {
+        entry->in_use = false;
+    }
+    sql = nullptr;
+    entry = nullptr;
+}
+
+E<SQLite::CachedStatement> SQLite::cachedStatement(std::string_view s)
+{
+    auto it = statement_cache.find(s);
+    if(it == std::end(statement_cache))
+    {
+        std::string text(s);
+        ASSIGN_OR_RETURN(SQLiteStatement sql,
+                         SQLiteStatement::fromStr(db, text.c_str()));
+        it = statement_cache.emplace(std::move(text),
+                                     CacheEntry{std::move(sql), false}).first;
+    }
+    else if(it->second.in_use)
+    {
+        // E.g. a query nested in the evaluation of the same query.
+        ASSIGN_OR_RETURN(SQLiteStatement sql,
+                         SQLiteStatement::fromStr(db, it->first.c_str()));
+        return CachedStatement(std::move(sql));
+    }
+    return CachedStatement(&it->second);
+}
+
 E<void> SQLite::execute(SQLiteStatement sql_code) const
 {
     auto result = eval<int>(std::move(sql_code));
@@ -88,6 +369,26 @@ E<void> SQLite::execute(SQLiteStatement sql_code) const
     }
 }
 
+E<void> SQLite::executeAndReset(SQLiteStatement& sql_code) const
+{
+    static Histogram& latency = internal::evalLatency();
+    ScopedTimer timer(latency);
+    int code = sqlite3_step(sql_code.data());
+    DO_OR_RETURN(sql_code.reset());
+    if(code == SQLITE_DONE || code == SQLITE_ROW)
+    {
+        return {};
+    }
+    if(code == SQLITE_BUSY)
+    {
+        // This leaves an open transaction to the caller, which could
+        // retry or roll back.
+        return std::unexpected(runtimeError(sqlite3_errstr(code)));
+    }
+    return std::unexpected(runtimeError(std::string(
+        "Failed to evaluate SQL: ") + sqlite3_errstr(code)));
+}
+
 E<void> SQLite::execute(const char* sql_code) const
 {
     ASSIGN_OR_RETURN(auto sql, SQLiteStatement::fromStr(db, sql_code));
@@ -99,7 +400,67 @@ SQLite::~SQLite()
     clear();
 }
 
+bool SQLite::inTransaction() const
+{
+    return sqlite3_get_autocommit(db) == 0;
+}
+
 int64_t SQLite::lastInsertRowID() const
 {
     return sqlite3_last_insert_rowid(db);
 }
+
+SQLitePool::Lease::Lease(Lease&& rhs)
+{
+    std::swap(pool, rhs.pool);
+    std::swap(conn, rhs.conn);
+}
+
+SQLitePool::Lease& SQLitePool::Lease::operator=(Lease&& rhs)
+{
+    std::swap(pool, rhs.pool);
+    std::swap(conn, rhs.conn);
+    return *this;
+}
+
+SQLitePool::Lease::~Lease()
+{
+    if(pool != nullptr && conn != nullptr)
+    {
+        pool->giveBack(std::move(conn));
+    }
+}
+
+E<std::unique_ptr<SQLitePool>>
+SQLitePool::connectFile(const std::string& db_file, size_t size, int flags,
+                        const SQLiteSettings& settings)
+{
+    auto pool = std::make_unique<SQLitePool>();
+    pool->idle.reserve(size);
+    for(size_t i = 0; i < size; i++)
+    {
+        ASSIGN_OR_RETURN(auto conn, SQLite::connectFile(db_file, flags));
+        DO_OR_RETURN(conn->configure(settings));
+        pool->idle.push_back(std::move(conn));
+    }
+    pool->total = size;
+    return pool;
+}
+
+SQLitePool::Lease SQLitePool::lease()
+{
+    std::unique_lock<std::mutex> l(lock);
+    available.wait(l, [this] { return !idle.empty(); });
+    std::unique_ptr<SQLite> conn = std::move(idle.back());
+    idle.pop_back();
+    return Lease(this, std::move(conn));
+}
+
+void SQLitePool::giveBack(std::unique_ptr<SQLite> conn)
+{
+    {
+        std::lock_guard<std::mutex> l(lock);
+        idle.push_back(std::move(conn));
+    }
+    available.notify_one();
+}
@@ -1,8 +1,12 @@
 #pragma once
 
+#include <condition_variable>
 #include <memory>
+#include <mutex>
+#include <optional>
 #include <tuple>
 #include <type_traits>
+#include <unordered_map>
 #include <vector>
 #include <string>
 #include <string_view>
@@ -12,6 +16,7 @@
 #include <sqlite3.h>
 
 #include "error.hpp"
+#include "metrics.hpp"
 #include "utils.hpp"
 
 // A simple RAII wrapper of sqlite3_stmt*.
@@ -29,7 +34,10 @@ public:
     sqlite3_stmt* data() const { return sql; }
 
     template<typename... Types>
-    E<void> bind(Types... args) const;
+    E<void> bind(const Types&... args) const;
+    // Reset the statement and clear its parameters, so that it can be
+    // bound and evaluated again.
+    E<void> reset() const;
 
     // Do not use.
     SQLiteStatement() = default;
@@ -37,19 +45,133 @@ private:
     sqlite3_stmt* sql = nullptr;
 };
 
+// A row of the result of a statement, which is only valid until the
+// statement steps to the next row. So is the text in it.
+class SQLiteRow
+{
+public:
+    explicit SQLiteRow(sqlite3_stmt* s) : sql(s) {}
+
+    int columns() const { return sqlite3_column_count(sql); }
+    bool isNull(int i) const
+    {
+        return sqlite3_column_type(sql, i) == SQLITE_NULL;
+    }
+    int64_t getInt64(int i) const { return sqlite3_column_int64(sql, i); }
+    int getInt(int i) const { return sqlite3_column_int(sql, i); }
+    double getDouble(int i) const { return sqlite3_column_double(sql, i); }
+    // NULL is an empty string.
+    std::string_view getText(int i) const
+    {
+        // sqlite3_column_bytes() should be called after
+        // sqlite3_column_text(), which could convert the value.
+        const unsigned char* raw = sqlite3_column_text(sql, i);
+        if(raw == nullptr)
+        {
+            return {};
+        }
+        return {reinterpret_cast<const char*>(raw),
+                static_cast<size_t>(sqlite3_column_bytes(sql, i))};
+    }
+
+    // Column i as a value of type T, which is one of the types of
+    // the columns of SQLite::eval().
+    template<typename T>
+    T get(int i) const;
+
+private:
+    sqlite3_stmt* sql;
+};
+
+// Per-connection settings, applied with PRAGMAs when a connection is
+// opened. Unset or empty ones keep the defaults of SQLite. See
+// https://www.sqlite.org/pragma.html for their meanings.
+struct SQLiteSettings
+{
+    // E.g. “wal”. This is stored in the database file, so it is not
+    // applied to read-only connections.
+    std::string journal_mode;
+    // “off”, “normal”, “full” or “extra”.
+    std::string synchronous;
+    // “default”, “file” or “memory”.
+    std::string temp_store;
+    // In bytes.
+    std::optional<int64_t> mmap_size;
+    // In pages if positive, or in KiB if negative.
+    std::optional<int64_t> cache_size;
+    // In milliseconds.
+    std::optional<int64_t> busy_timeout;
+
+    // E.g. “journal_mode=wal synchronous=normal”, for logging.
+    std::string str() const;
+};
+
+template<typename T, typename... Members>
+class SQLiteRowMapping;
+
 class SQLite
 {
+    struct CacheEntry;
 public:
     SQLite() = default;
     ~SQLite();
     SQLite(const SQLite&) = delete;
     SQLite& operator=(const SQLite&) = delete;
 
+    // Open a connection to the database file. The flags are passed
+    // to sqlite3_open_v2().
     static E<std::unique_ptr<SQLite>>
-    connectFile(const std::string& db_file);
+    connectFile(const std::string& db_file,
+                int flags = SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE);
     static E<std::unique_ptr<SQLite>> connectMemory();
+    // Apply the settings to this connection.
+    E<void> configure(const SQLiteSettings& settings) const;
+    // The settings in effect on this connection, which could differ
+    // from the ones applied, e.g. in-memory databases do not do WAL.
+    E<SQLiteSettings> settings() const;
+
+    // A statement from the statement cache of the connection. It
+    // goes back to the cache, reset and with its parameters cleared,
+    // when this is destroyed, so it should not outlive the
+    // connection.
+    class CachedStatement
+    {
+    public:
+        CachedStatement(const CachedStatement&) = delete;
+        CachedStatement& operator=(const CachedStatement&) = delete;
+        CachedStatement(CachedStatement&& rhs);
+        CachedStatement& operator=(CachedStatement&& rhs);
+        ~CachedStatement();
+
+        SQLiteStatement* operator->() const { return sql; }
+        SQLiteStatement& operator*() const { return *sql; }
+
+    private:
+        friend class SQLite;
+        explicit CachedStatement(CacheEntry* e);
+        explicit CachedStatement(SQLiteStatement&& s);
+        void giveBack();
+
+        // Used when the statement in the cache is already in use.
+        SQLiteStatement owned;
+        SQLiteStatement* sql = nullptr;
+        // Null if the statement is not from the cache.
+        CacheEntry* entry = nullptr;
+    };
 
     E<SQLiteStatement> statementFromStr(const char* s);
+    // Like statementFromStr(), but the statement is only prepared the
+    // first time, and kept in the cache of this connection for the
+    // next time. This is for the fixed SQL of the queries, as the
+    // cache never forgets anything. Like the connection, the cache is
+    // not thread-safe.
+    E<CachedStatement> cachedStatement(std::string_view s);
+    // Like cachedStatement(), and also check that the columns of the
+    // result match the mapping. This is only checked when the
+    // statement is prepared.
+    template<typename T, typename... Members>
+    E<CachedStatement> cachedStatement(
+        std::string_view s, const SQLiteRowMapping<T, Members...>& mapping);
 
     // Evaluate a SQL statement, and retrieve the result. In the
     // return value, each element is a row, which is modeled as a
@@ -59,10 +181,29 @@ public:
     //   eval<int, std::string>(...);
     //
     // You are responsible to make sure that the template arguments
-    // matche the expected result of the SQL statement. Otherwise it
-    // could seg fault.
+    // matche the expected result of the SQL statement. Otherwise the
+    // values are converted as sqlite3_column_*() do. To go through a
+    // large result without keeping it, use forEachRow().
     template<typename... Types>
     E<std::vector<std::tuple<Types...>>> eval(SQLiteStatement sql_code) const;
+    // Evaluate a SQL statement, and call visit with each row of the
+    // result as it is read, without keeping the rows. Visit could
+    // return void, or E<void> to stop the evaluation with an error.
+    // The statement is reset afterwards, so that it can be used
+    // again. Example:
+    //
+    //   forEachRow(sql, [&](const SQLiteRow& row)
+    //   {
+    //       total += row.getText(0).size();
+    //   });
+    template<typename Visitor>
+    E<void> forEachRow(SQLiteStatement& sql_code, Visitor&& visit) const;
+
+    // Like eval(), but keep the statement and reset it, so that it
+    // can be used again without preparing it again.
+    template<typename... Types>
+    E<std::vector<std::tuple<Types...>>> evalAndReset(
+        SQLiteStatement& sql_code) const;
     template<typename... Types>
     E<std::vector<std::tuple<Types...>>> eval(const char* sql_code) const;
     template<typename... Types>
@@ -73,6 +214,9 @@ public:
 
     // Evalute a SQL statement that is not supposed to return data.
     E<void> execute(SQLiteStatement sql_code) const;
+    // Like execute(), but keep the statement and reset it, so that
+    // it can be used again without preparing it again.
+    E<void> executeAndReset(SQLiteStatement& sql_code) const;
     E<void> execute(const char* sql_code) const;
     E<void> execute(const std::string& sql_code) const
     {
@@ -80,76 +224,202 @@ public:
     }
 
     int64_t lastInsertRowID() const;
+    // Whether there is an open transaction. SQLite rolls back the
+    // whole transaction on some errors, e.g. SQLITE_FULL, after which
+    // this is false.
+    bool inTransaction() const;
 
 private:
+    struct CacheEntry
+    {
+        SQLiteStatement sql;
+        bool in_use = false;
+        // The last row mapping the statement is checked against.
+        const void* checked_mapping = nullptr;
+    };
+    // Hashes std::string_view too, so that looking up does not
+    // allocate.
+    struct StringHash
+    {
+        using is_transparent = void;
+        size_t operator()(std::string_view s) const
+        {
+            return std::hash<std::string_view>()(s);
+        }
+    };
+
     sqlite3* db = nullptr;
+    // Destroyed before the connection is closed.
+    std::unordered_map<std::string, CacheEntry, StringHash, std::equal_to<>>
+    statement_cache;
     void clear();
 };
 
-// ========== Template implementations ==============================>
-
-namespace internal
+// A fixed set of connections to the same database file. A connection
+// is leased to one thread at a time, so the connections can be opened
+// with SQLITE_OPEN_NOMUTEX.
+class SQLitePool
 {
+public:
+    // A leased connection. It goes back to the pool when the lease is
+    // destroyed.
+    class Lease
+    {
+    public:
+        Lease(const Lease&) = delete;
+        Lease& operator=(const Lease&) = delete;
+        Lease(Lease&& rhs);
+        Lease& operator=(Lease&& rhs);
+        ~Lease();
+
+        SQLite* operator->() const { return conn.get(); }
+        SQLite& operator*() const { return *conn; }
+
+    private:
+        friend class SQLitePool;
+        Lease(SQLitePool* p, std::unique_ptr<SQLite> c)
+                : pool(p), conn(std::move(c)) {}
+
+        SQLitePool* pool = nullptr;
+        std::unique_ptr<SQLite> conn;
+    };
+
+    SQLitePool(const SQLitePool&) = delete;
+    SQLitePool& operator=(const SQLitePool&) = delete;
 
+    static E<std::unique_ptr<SQLitePool>>
+    connectFile(const std::string& db_file, size_t size, int flags,
+                const SQLiteSettings& settings = {});
+
+    // Lease a connection. Block until one is available.
+    Lease lease();
+    size_t size() const { return total; }
+
+    // Do not use.
+    SQLitePool() = default;
+private:
+    void giveBack(std::unique_ptr<SQLite> conn);
+
+    std::mutex lock;
+    std::condition_variable available;
+    std::vector<std::unique_ptr<SQLite>> idle;
+    size_t total = 0;
+};
+
+// How a C++ type is read from a column of a row mapping. Specialize
+// this for other types, e.g. enums stored as integers, with:
+//
+//   // The fundamental type of SQLite, e.g. SQLITE_INTEGER.
+//   static constexpr int type;
+//   static E<void> read(const SQLiteRow& row, int i, T& value);
 template<typename T>
-inline void getValue(SQLiteStatement&, int, T&)
-{
-    static_assert(false, "Invalid type of sqlite column");
-}
+struct SQLiteValue;
 
 template<>
-inline void getValue(SQLiteStatement& sql, int i, int64_t& x)
+struct SQLiteValue<int64_t>
 {
-    x = sqlite3_column_int64(sql.data(), i);
-}
+    static constexpr int type = SQLITE_INTEGER;
+    static E<void> read(const SQLiteRow& row, int i, int64_t& value)
+    {
+        value = row.getInt64(i);
+        return {};
+    }
+};
 
 template<>
-inline void getValue(SQLiteStatement& sql, int i, int& x)
+struct SQLiteValue<int>
 {
-    x = sqlite3_column_int(sql.data(), i);
-}
+    static constexpr int type = SQLITE_INTEGER;
+    static E<void> read(const SQLiteRow& row, int i, int& value)
+    {
+        value = row.getInt(i);
+        return {};
+    }
+};
 
 template<>
-inline void getValue(SQLiteStatement& sql, int i, double& x)
+struct SQLiteValue<double>
 {
-    x = sqlite3_column_double(sql.data(), i);
-}
+    static constexpr int type = SQLITE_FLOAT;
+    static E<void> read(const SQLiteRow& row, int i, double& value)
+    {
+        value = row.getDouble(i);
+        return {};
+    }
+};
 
 template<>
-inline void getValue(SQLiteStatement& sql, int i, std::string& s)
+struct SQLiteValue<std::string>
 {
-    const unsigned char* raw = sqlite3_column_text(sql.data(), i);
-    s = reinterpret_cast<const char*>(raw);
-}
-
-// template<typename T, typename T1, typename... Types>
-// inline std::tuple<T, T1, Types...> getRowInternal(SQLiteStatement& sql, int i)
-// {
-//     std::tuple<T> result;
-//     getValue(sql, i, std::get<0>(result));
-//     return std::tuple_cat(result, getRowInternal<T1, Types...>(sql, i+1));
-// }
-
-template<typename T, typename... Types>
-inline std::tuple<T, Types...> getRowInternal(SQLiteStatement& sql, int i)
-{
-    std::tuple<T> result;
-    getValue(sql, i, std::get<0>(result));
-    if constexpr(sizeof...(Types) == 0)
+    static constexpr int type = SQLITE_TEXT;
+    // Assigning reuses the memory of the string if it is large
+    // enough.
+    static E<void> read(const SQLiteRow& row, int i, std::string& value)
     {
-        return result;
+        value.assign(row.getText(i));
+        return {};
     }
-    else
+};
+
+// Times are stored as seconds since the epoch.
+template<>
+struct SQLiteValue<Time>
+{
+    static constexpr int type = SQLITE_INTEGER;
+    static E<void> read(const SQLiteRow& row, int i, Time& value)
     {
-        return std::tuple_cat(result, getRowInternal<Types...>(sql, i+1));
+        value = secondsToTime(row.getInt64(i));
+        return {};
     }
-}
+};
 
-template<typename T, typename... Types>
-inline std::tuple<T, Types...> getRow(SQLiteStatement& sql)
+// A column of a row mapping, which goes into member of T.
+template<typename T, typename M>
+struct SQLiteColumn
 {
-    return getRowInternal<T, Types...>(sql, 0);
-}
+    const char* name;
+    M T::* member;
+};
+
+// Where the columns of the result of a query go in a struct T, in the
+// order of the columns. This is meant to be a constant next to the
+// SQL, e.g.
+//
+//   constexpr SQLiteRowMapping POST_COLUMNS(
+//       SQLiteColumn{"content", &Post::content},
+//       SQLiteColumn{"time", &Post::time});
+//
+// so that the columns and their types are spelled once, instead of in
+// a tuple and again when converting the tuple.
+template<typename T, typename... Members>
+class SQLiteRowMapping
+{
+public:
+    constexpr explicit SQLiteRowMapping(SQLiteColumn<T, Members>... cols)
+            : columns(cols...) {}
+
+    // Check that the result of the statement has the columns, with
+    // compatible declared types.
+    E<void> check(const SQLiteStatement& sql) const;
+    // Read the row into the members of value. The other members are
+    // left as they are.
+    E<void> read(const SQLiteRow& row, T& value) const;
+
+private:
+    std::tuple<SQLiteColumn<T, Members>...> columns;
+};
+
+// ========== Template implementations ==============================>
+
+namespace internal
+{
+
+// Time of evaluating SQL statements.
+Histogram& evalLatency();
+
+// Whether a value of the fundamental type could be stored in a
+// column of the declared type, by the affinity rules of SQLite.
+bool declTypeAllows(std::string_view decl_type, int type);
 
 inline E<void> sqlMaybe(int code, const char* msg)
 {
@@ -194,14 +464,14 @@ inline E<void> bindOne(const SQLiteStatement& sql, int i, const char* x)
 }
 
 template<typename T>
-inline E<void> bindInternal(const SQLiteStatement& sql, int i, T x)
+inline E<void> bindInternal(const SQLiteStatement& sql, int i, const T& x)
 {
     return bindOne(sql, i, x);
 }
 
 template<typename T, typename...Types>
-inline E<void> bindInternal(const SQLiteStatement& sql, int i, T x,
-                            Types... args)
+inline E<void> bindInternal(const SQLiteStatement& sql, int i, const T& x,
+                            const Types&... args)
 {
     auto e = bindOne(sql, i, x);
     if(!e.has_value())
@@ -214,7 +484,7 @@ inline E<void> bindInternal(const SQLiteStatement& sql, int i, T x,
 } // namespace internal
 
 template<typename... Types>
-E<void> SQLiteStatement::bind(Types... args) const
+E<void> SQLiteStatement::bind(const Types&... args) const
 {
     return internal::bindInternal(*this, 1, args...);
 }
@@ -222,19 +492,64 @@ E<void> SQLiteStatement::bind(Types... args) const
 template<typename... Types>
 E<std::vector<std::tuple<Types...>>> SQLite::eval(SQLiteStatement sql) const
 {
-    std::vector<std::tuple<Types...>> result;
+    return evalAndReset<Types...>(sql);
+}
+
+template<typename T>
+T SQLiteRow::get(int i) const
+{
+    if constexpr(std::is_same_v<T, int64_t>)
+    {
+        return getInt64(i);
+    }
+    else if constexpr(std::is_same_v<T, int>)
+    {
+        return getInt(i);
+    }
+    else if constexpr(std::is_same_v<T, double>)
+    {
+        return getDouble(i);
+    }
+    else if constexpr(std::is_same_v<T, std::string>)
+    {
+        return std::string(getText(i));
+    }
+    else
+    {
+        static_assert(false, "Invalid type of sqlite column");
+    }
+}
+
+template<typename Visitor>
+E<void> SQLite::forEachRow(SQLiteStatement& sql, Visitor&& visit) const
+{
+    static Histogram& latency = internal::evalLatency();
+    ScopedTimer timer(latency);
     while(true)
     {
         int code = sqlite3_step(sql.data());
+        if(code == SQLITE_ROW)
+        {
+            SQLiteRow row(sql.data());
+            if constexpr(std::is_void_v<std::invoke_result_t<Visitor&,
+                                                             SQLiteRow&>>)
+            {
+                visit(row);
+            }
+            else if(E<void> result = visit(row); !result.has_value())
+            {
+                sql.reset();
+                return result;
+            }
+            continue;
+        }
+        DO_OR_RETURN(sql.reset());
         switch(code)
         {
         case SQLITE_DONE:
-            return result;
-        case SQLITE_ROW:
-            result.push_back(internal::getRow<Types...>(sql));
-            break;
+            return {};
         case SQLITE_BUSY:
-            sqlite3_exec(db, "ROLLBACK;", nullptr, nullptr, nullptr);
+            // Like in executeAndReset(), the transaction is left open.
             return std::unexpected(runtimeError(sqlite3_errstr(code)));
         case SQLITE_ERROR:
         case SQLITE_MISUSE:
@@ -246,9 +561,98 @@ E<std::vector<std::tuple<Types...>>> SQLite::eval(SQLiteStatement sql) const
                 sqlite3_errstr(code)));
         }
     }
+}
+
+template<typename... Types>
+E<std::vector<std::tuple<Types...>>> SQLite::evalAndReset(
+    SQLiteStatement& sql) const
+{
+    std::vector<std::tuple<Types...>> result;
+    DO_OR_RETURN(forEachRow(sql, [&result](const SQLiteRow& row)
+    {
+        [&]<size_t... I>(std::index_sequence<I...>)
+        {
+            result.emplace_back(row.get<Types>(I)...);
+        }(std::index_sequence_for<Types...>());
+    }));
+    return result;
+}
+
+template<typename T, typename... Members>
+E<void> SQLiteRowMapping<T, Members...>::check(const SQLiteStatement& sql) const
+{
+    int count = sqlite3_column_count(sql.data());
+    if(count != sizeof...(Members))
+    {
+        return std::unexpected(runtimeError(std::format(
+            "Expected {} columns in the result, got {}", sizeof...(Members),
+            count)));
+    }
+    E<void> result;
+    auto check_column = [&]<size_t I>(std::integral_constant<size_t, I>)
+    {
+        if(!result.has_value())
+        {
+            return;
+        }
+        using M = std::tuple_element_t<I, std::tuple<Members...>>;
+        const char* expected = std::get<I>(columns).name;
+        const char* name = sqlite3_column_name(sql.data(), I);
+        if(name == nullptr || std::string_view(name) != expected)
+        {
+            result = std::unexpected(runtimeError(std::format(
+                "Expected column {} to be {}, got {}", I, expected,
+                name == nullptr ? "nothing" : name)));
+            return;
+        }
+        // This is null for expressions, which could be anything.
+        const char* decl_type = sqlite3_column_decltype(sql.data(), I);
+        if(decl_type != nullptr &&
+           !internal::declTypeAllows(decl_type, SQLiteValue<M>::type))
+        {
+            result = std::unexpected(runtimeError(std::format(
+                "Column {} is {}, which does not fit its member", name,
+                decl_type)));
+        }
+    };
+    [&]<size_t... I>(std::index_sequence<I...>)
+    {
+        (check_column(std::integral_constant<size_t, I>()), ...);
+    }(std::index_sequence_for<Members...>());
     return result;
 }
 
+template<typename T, typename... Members>
+E<void> SQLiteRowMapping<T, Members...>::read(const SQLiteRow& row,
+                                              T& value) const
+{
+    E<void> result;
+    [&]<size_t... I>(std::index_sequence<I...>)
+    {
+        // This stops at the first error.
+        ((result = SQLiteValue<Members>::read(
+              row, I, value.*std::get<I>(columns).member),
+          result.has_value()) && ...);
+    }(std::index_sequence_for<Members...>());
+    return result;
+}
+
+template<typename T, typename... Members>
+E<SQLite::CachedStatement> SQLite::cachedStatement(
+    std::string_view s, const SQLiteRowMapping<T, Members...>& mapping)
+{
+    ASSIGN_OR_RETURN(CachedStatement sql, cachedStatement(s));
+    if(sql.entry == nullptr || sql.entry->checked_mapping != &mapping)
+    {
+        DO_OR_RETURN(mapping.check(*sql));
+        if(sql.entry != nullptr)
+        {
+            sql.entry->checked_mapping = &mapping;
+        }
+    }
+    return sql;
+}
+
 template<typename... Types>
 E<std::vector<std::tuple<Types...>>> SQLite::eval(const char* sql_code) const
 {
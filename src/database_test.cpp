@@ -1,3 +1,7 @@
+#include <filesystem>
+#include <string>
+#include <vector>
+
 #include <gtest/gtest.h>
 
 #include "database.hpp"
@@ -50,3 +54,231 @@ TEST(Database, ParametrizedStatement)
         "SELECT * FROM test WHERE b = 'aaa';")));
     EXPECT_EQ(result1.size(), 1);
 }
+
+TEST(Database, CanVisitRows)
+{
+    ASSIGN_OR_FAIL(auto db, SQLite::connectMemory());
+    ASSERT_TRUE(db->execute("CREATE TABLE test (a INTEGER, b TEXT);")
+                .has_value());
+    ASSERT_TRUE(db->execute(
+        "INSERT INTO test (a, b) VALUES (1, 'aaa'), (2, NULL), (3, 'c');")
+                .has_value());
+    ASSIGN_OR_FAIL(auto sql, db->statementFromStr(
+        "SELECT a, b FROM test ORDER BY a;"));
+    std::vector<std::string> texts;
+    ASSERT_TRUE(isExpected(db->forEachRow(sql, [&](const SQLiteRow& row)
+    {
+        EXPECT_EQ(row.columns(), 2);
+        EXPECT_EQ(row.isNull(1), row.getInt64(0) == 2);
+        texts.emplace_back(row.getText(1));
+    })));
+    EXPECT_EQ(texts, (std::vector<std::string>{"aaa", "", "c"}));
+
+    // Stopping with an error leaves the statement usable.
+    int visited = 0;
+    E<void> stopped = db->forEachRow(sql, [&](const SQLiteRow&) -> E<void>
+    {
+        visited++;
+        return std::unexpected(runtimeError("stop"));
+    });
+    EXPECT_FALSE(stopped.has_value());
+    EXPECT_EQ(visited, 1);
+    ASSIGN_OR_FAIL(auto rows, (db->evalAndReset<int, std::string>(sql)));
+    ASSERT_EQ(rows.size(), 3);
+    EXPECT_EQ(std::get<1>(rows[1]), "");
+}
+
+struct TestRow
+{
+    std::string name;
+    int64_t count = 0;
+    Time time;
+};
+
+constexpr SQLiteRowMapping TEST_ROW_COLUMNS(
+    SQLiteColumn{"name", &TestRow::name},
+    SQLiteColumn{"count", &TestRow::count},
+    SQLiteColumn{"time", &TestRow::time});
+
+TEST(Database, CanMapRowsToStructs)
+{
+    ASSIGN_OR_FAIL(auto db, SQLite::connectMemory());
+    ASSERT_TRUE(db->execute(
+        "CREATE TABLE test (name TEXT, count INTEGER, time INTEGER);")
+                .has_value());
+    ASSERT_TRUE(db->execute(
+        "INSERT INTO test VALUES ('aaa', 1, 60), (NULL, 2, 120);")
+                .has_value());
+    ASSIGN_OR_FAIL(auto sql, db->cachedStatement(
+        "SELECT name, count, time FROM test ORDER BY count;",
+        TEST_ROW_COLUMNS));
+    std::vector<TestRow> rows;
+    ASSERT_TRUE(isExpected(db->forEachRow(*sql, [&](const SQLiteRow& row)
+    {
+        return TEST_ROW_COLUMNS.read(row, rows.emplace_back());
+    })));
+    ASSERT_EQ(rows.size(), 2);
+    EXPECT_EQ(rows[0].name, "aaa");
+    EXPECT_EQ(rows[0].count, 1);
+    EXPECT_EQ(rows[0].time, secondsToTime(60));
+    EXPECT_EQ(rows[1].name, "");
+    EXPECT_EQ(rows[1].time, secondsToTime(120));
+
+    // The columns are checked by name and by declared type.
+    EXPECT_FALSE(db->cachedStatement(
+        "SELECT count, name, time FROM test;", TEST_ROW_COLUMNS)
+                 .has_value());
+    EXPECT_FALSE(db->cachedStatement(
+        "SELECT name, count FROM test;", TEST_ROW_COLUMNS).has_value());
+    EXPECT_FALSE(db->cachedStatement(
+        "SELECT name, name AS count, time FROM test;", TEST_ROW_COLUMNS)
+                 .has_value());
+    // Expressions have no declared type.
+    EXPECT_TRUE(db->cachedStatement(
+        "SELECT name, count + 1 AS count, time FROM test;", TEST_ROW_COLUMNS)
+                .has_value());
+}
+
+TEST(Database, StatementsCanBeReused)
+{
+    ASSIGN_OR_FAIL(auto db, SQLite::connectMemory());
+    ASSERT_TRUE(db->execute("CREATE TABLE test (a INTEGER UNIQUE, b TEXT);")
+                .has_value());
+    ASSIGN_OR_FAIL(auto sql, db->statementFromStr(
+        "INSERT INTO test (a, b) VALUES (?, ?);"));
+    for(int64_t i = 0; i < 3; i++)
+    {
+        ASSERT_TRUE(sql.bind(i, "aaa").has_value());
+        ASSERT_TRUE(db->executeAndReset(sql).has_value());
+    }
+    // A failure leaves the statement usable.
+    ASSERT_TRUE(sql.bind(int64_t(0), "aaa").has_value());
+    EXPECT_FALSE(db->executeAndReset(sql).has_value());
+    ASSERT_TRUE(sql.bind(int64_t(3), "aaa").has_value());
+    EXPECT_TRUE(db->executeAndReset(sql).has_value());
+
+    ASSIGN_OR_FAIL(auto count,
+                   (db->eval<int64_t>("SELECT COUNT(*) FROM test;")));
+    EXPECT_EQ(std::get<0>(count[0]), 4);
+}
+
+TEST(Database, StatementsAreCached)
+{
+    ASSIGN_OR_FAIL(auto db, SQLite::connectMemory());
+    ASSERT_TRUE(db->execute("CREATE TABLE test (a INTEGER);").has_value());
+    ASSERT_TRUE(db->execute("INSERT INTO test (a) VALUES (1), (2);")
+                .has_value());
+    const char* query = "SELECT a FROM test WHERE a >= ? ORDER BY a;";
+    sqlite3_stmt* cached = nullptr;
+    {
+        ASSIGN_OR_FAIL(auto sql, db->cachedStatement(query));
+        cached = sql->data();
+        ASSERT_TRUE(sql->bind(int64_t(2)).has_value());
+        ASSIGN_OR_FAIL(auto rows, db->evalAndReset<int64_t>(*sql));
+        ASSERT_EQ(rows.size(), 1);
+
+        // The cached one is in use, so this is another one.
+        ASSIGN_OR_FAIL(auto nested, db->cachedStatement(query));
+        EXPECT_NE(nested->data(), cached);
+    }
+    // The same statement comes back, without the old bindings.
+    ASSIGN_OR_FAIL(auto sql, db->cachedStatement(query));
+    EXPECT_EQ(sql->data(), cached);
+    ASSERT_TRUE(sql->bind(int64_t(1)).has_value());
+    ASSIGN_OR_FAIL(auto rows, db->evalAndReset<int64_t>(*sql));
+    EXPECT_EQ(rows.size(), 2);
+}
+
+TEST(Database, PoolLeasesEachConnectionOnce)
+{
+    std::string db_file = (std::filesystem::temp_directory_path() /
+                           "nsweekly-pool-test.db").string();
+    std::filesystem::remove(db_file);
+    {
+        ASSIGN_OR_FAIL(auto db, SQLite::connectFile(db_file));
+        ASSERT_TRUE(db->execute("CREATE TABLE test (a INTEGER);")
+                    .has_value());
+        ASSERT_TRUE(db->execute("INSERT INTO test (a) VALUES (1);")
+                    .has_value());
+    }
+    ASSIGN_OR_FAIL(auto pool, SQLitePool::connectFile(
+        db_file, 2, SQLITE_OPEN_READONLY | SQLITE_OPEN_NOMUTEX));
+    EXPECT_EQ(pool->size(), 2);
+    {
+        SQLitePool::Lease c0 = pool->lease();
+        SQLitePool::Lease c1 = pool->lease();
+        EXPECT_NE(&*c0, &*c1);
+        ASSIGN_OR_FAIL(auto result, c0->eval<int64_t>("SELECT a FROM test;"));
+        ASSERT_EQ(result.size(), 1);
+        EXPECT_EQ(std::get<0>(result[0]), 1);
+        // Read-only connections cannot write.
+        EXPECT_FALSE(c1->execute("INSERT INTO test (a) VALUES (2);")
+                     .has_value());
+    }
+    // Both connections are back.
+    SQLitePool::Lease c0 = pool->lease();
+    SQLitePool::Lease c1 = pool->lease();
+    std::filesystem::remove(db_file);
+}
+
+TEST(Database, BusyStatementKeepsTransaction)
+{
+    std::string db_file = (std::filesystem::temp_directory_path() /
+                           "nsweekly-busy-test.db").string();
+    std::filesystem::remove(db_file);
+    {
+        ASSIGN_OR_FAIL(auto db0, SQLite::connectFile(db_file));
+        ASSIGN_OR_FAIL(auto db1, SQLite::connectFile(db_file));
+        ASSERT_TRUE(db0->execute("CREATE TABLE test (a INTEGER);")
+                    .has_value());
+        ASSERT_TRUE(db0->execute("BEGIN IMMEDIATE;").has_value());
+        ASSERT_TRUE(db0->execute("INSERT INTO test (a) VALUES (1);")
+                    .has_value());
+
+        ASSERT_TRUE(db1->execute("BEGIN;").has_value());
+        EXPECT_FALSE(db1->execute("INSERT INTO test (a) VALUES (2);")
+                     .has_value());
+        // The caller decides what to do with the transaction.
+        EXPECT_TRUE(db1->inTransaction());
+        ASSERT_TRUE(db0->execute("COMMIT;").has_value());
+        ASSERT_TRUE(db1->execute("INSERT INTO test (a) VALUES (2);")
+                    .has_value());
+        ASSERT_TRUE(db1->execute("COMMIT;").has_value());
+        EXPECT_FALSE(db1->inTransaction());
+        ASSIGN_OR_FAIL(auto rows, db0->eval<int64_t>("SELECT a FROM test;"));
+        EXPECT_EQ(rows.size(), 2);
+    }
+    std::filesystem::remove(db_file);
+}
+
+TEST(Database, SettingsAreApplied)
+{
+    std::string db_file = (std::filesystem::temp_directory_path() /
+                           "nsweekly-settings-test.db").string();
+    std::filesystem::remove(db_file);
+    SQLiteSettings settings;
+    settings.journal_mode = "wal";
+    settings.synchronous = "normal";
+    settings.temp_store = "memory";
+    settings.cache_size = -4096;
+    settings.busy_timeout = 1234;
+    {
+        ASSIGN_OR_FAIL(auto db, SQLite::connectFile(db_file));
+        ASSERT_TRUE(isExpected(db->configure(settings)));
+        ASSIGN_OR_FAIL(SQLiteSettings applied, db->settings());
+        EXPECT_EQ(applied.journal_mode, "wal");
+        EXPECT_EQ(applied.synchronous, "normal");
+        EXPECT_EQ(applied.temp_store, "memory");
+        EXPECT_EQ(applied.cache_size, -4096);
+        EXPECT_EQ(applied.busy_timeout, 1234);
+        EXPECT_NE(applied.str().find("journal_mode=wal"), std::string::npos);
+
+        // Values that are not known are not put in the PRAGMAs.
+        SQLiteSettings invalid;
+        invalid.synchronous = "normal; DROP TABLE x";
+        EXPECT_FALSE(db->configure(invalid).has_value());
+    }
+    std::filesystem::remove(db_file);
+    std::filesystem::remove(db_file + "-wal");
+    std::filesystem::remove(db_file + "-shm");
+}
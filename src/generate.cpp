@@ -0,0 +1,172 @@
+#include <chrono>
+#include <format>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "data.hpp"
+#include "error.hpp"
+#include "generate.hpp"
+#include "utils.hpp"
+#include "weekly.hpp"
+
+namespace
+{
+
+constexpr std::string_view WORDS[] = {
+    "review", "design", "meeting", "deploy", "fix", "latency", "database",
+    "migration", "team", "customer", "report", "test", "release", "planning",
+    "incident", "followup", "refactor", "docs", "interview", "roadmap",
+    "prototype", "benchmark", "oncall", "feedback", "budget", "hiring",
+};
+
+std::string sentence(int words, std::mt19937& rng)
+{
+    std::uniform_int_distribution<size_t> word(0, std::size(WORDS) - 1);
+    std::string result;
+    for(int i = 0; i < words; i++)
+    {
+        if(i > 0)
+        {
+            result += ' ';
+        }
+        result += WORDS[word(rng)];
+    }
+    return result;
+}
+
+void appendProse(std::string& post, std::mt19937& rng)
+{
+    post += std::format("{}. {}, {}.\n\n", sentence(14, rng),
+                        sentence(8, rng), sentence(10, rng));
+}
+
+void appendList(std::string& post, std::mt19937& rng)
+{
+    std::uniform_int_distribution<int> items(3, 7);
+    int n = items(rng);
+    for(int i = 0; i < n; i++)
+    {
+        post += std::format("- {}\n", sentence(8, rng));
+    }
+    post += '\n';
+}
+
+void appendMixed(std::string& post, int block, std::mt19937& rng)
+{
+    switch(block % 4)
+    {
+    case 0:
+        post += std::format("## {}\n\n", sentence(3, rng));
+        break;
+    case 1:
+        for(int i = 0; i < 4; i++)
+        {
+            post += std::format("- {} [link](https://example.com/{})\n",
+                                sentence(6, rng), i);
+        }
+        post += '\n';
+        break;
+    case 2:
+        post += std::format("```\n{}\n{}\n```\n\n", sentence(5, rng),
+                            sentence(5, rng));
+        break;
+    default:
+        post += std::format("{} *{}* `{}` {}.\n\n", sentence(20, rng),
+                            sentence(2, rng), sentence(1, rng),
+                            sentence(15, rng));
+    }
+}
+
+} // namespace
+
+E<PostShape> postShapeFromStr(std::string_view s)
+{
+    if(s == "prose")
+    {
+        return PostShape::PROSE;
+    }
+    if(s == "list")
+    {
+        return PostShape::LIST;
+    }
+    if(s == "mixed")
+    {
+        return PostShape::MIXED;
+    }
+    return std::unexpected(runtimeError(std::format(
+        "Invalid post shape: {}", s)));
+}
+
+std::string generatePost(size_t size, PostShape shape, std::mt19937& rng)
+{
+    std::string post;
+    if(shape == PostShape::LIST)
+    {
+        post += std::format("## {}\n\n", sentence(3, rng));
+    }
+    for(int block = 0; post.size() < size; block++)
+    {
+        switch(shape)
+        {
+        case PostShape::PROSE:
+            appendProse(post, rng);
+            break;
+        case PostShape::LIST:
+            appendList(post, rng);
+            break;
+        case PostShape::MIXED:
+            appendMixed(post, block, rng);
+            break;
+        }
+    }
+    return post;
+}
+
+E<GenerateStats> generateWeeklies(const DataSourceSqlite& data,
+                                  const GenerateOptions& options)
+{
+    GenerateStats stats;
+    std::mt19937 rng(options.seed);
+    // Real weeklies vary a lot in size.
+    std::uniform_int_distribution<size_t> size_dist(
+        options.post_size / 2, options.post_size * 3 / 2);
+    std::uniform_int_distribution<int> update_delay(0, 7 * 24 - 1);
+    Time this_week = weekBegin(options.now);
+    int weeks = options.years * 52;
+
+    auto begin = std::chrono::steady_clock::now();
+    std::vector<WeeklyPost> batch;
+    batch.reserve(options.batch_size);
+    for(int u = 0; u < options.users; u++)
+    {
+        std::string name = std::format("user{}", u);
+        for(int w = 0; w < weeks; w++)
+        {
+            WeeklyPost p;
+            p.format = WeeklyPost::MARKDOWN;
+            p.raw_content = generatePost(size_dist(rng), options.shape, rng);
+            p.week_begin = this_week - std::chrono::weeks(w);
+            p.update_time = p.week_begin +
+                std::chrono::hours(update_delay(rng));
+            p.language = "en";
+            p.author = name;
+            stats.bytes += p.raw_content.size();
+            batch.push_back(std::move(p));
+            if(batch.size() >= options.batch_size)
+            {
+                stats.weeklies += batch.size();
+                DO_OR_RETURN(data.updateWeeklies(std::move(batch)));
+                batch.clear();
+            }
+        }
+    }
+    if(!batch.empty())
+    {
+        stats.weeklies += batch.size();
+        DO_OR_RETURN(data.updateWeeklies(std::move(batch)));
+    }
+    stats.elapsed = std::chrono::steady_clock::now() - begin;
+    return stats;
+}
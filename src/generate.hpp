@@ -0,0 +1,55 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <string_view>
+
+#include "data.hpp"
+#include "error.hpp"
+#include "utils.hpp"
+
+// Synthetic weeklies, for filling databases to benchmark and plan
+// capacity with.
+
+// What the Markdown of the generated weeklies looks like.
+enum class PostShape
+{
+    // Paragraphs of plain text.
+    PROSE,
+    // A heading and a bullet list, which is how most weeklies look.
+    LIST,
+    // Headings, lists, code blocks, emphasis and links.
+    MIXED,
+};
+
+E<PostShape> postShapeFromStr(std::string_view s);
+
+// Generate Markdown of about size bytes.
+std::string generatePost(size_t size, PostShape shape, std::mt19937& rng);
+
+struct GenerateOptions
+{
+    int users = 100;
+    int years = 1;
+    size_t post_size = 2000;
+    PostShape shape = PostShape::MIXED;
+    // Weeklies inserted in each transaction.
+    size_t batch_size = 1000;
+    // The weeklies go back from the week of now.
+    Time now = Clock::now();
+    unsigned seed = 1;
+};
+
+struct GenerateStats
+{
+    uint64_t weeklies = 0;
+    uint64_t bytes = 0;
+    std::chrono::duration<double> elapsed{0};
+};
+
+// Fill the data source with a weekly for every week in the years for
+// each of the users, who are named “user0”, “user1”, and so on.
+E<GenerateStats> generateWeeklies(const DataSourceSqlite& data,
+                                  const GenerateOptions& options);
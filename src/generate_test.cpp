@@ -0,0 +1,55 @@
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "data.hpp"
+#include "generate.hpp"
+#include "test_utils.hpp"
+#include "utils.hpp"
+#include "weekly.hpp"
+
+TEST(Generate, PostsHaveTheSizeAndShape)
+{
+    std::mt19937 rng(1);
+    std::string prose = generatePost(1000, PostShape::PROSE, rng);
+    EXPECT_GE(prose.size(), 1000);
+    EXPECT_LT(prose.size(), 1500);
+    EXPECT_EQ(prose.find("- "), std::string::npos);
+
+    std::string list = generatePost(1000, PostShape::LIST, rng);
+    EXPECT_TRUE(list.starts_with("## "));
+    EXPECT_NE(list.find("\n- "), std::string::npos);
+
+    std::string mixed = generatePost(1000, PostShape::MIXED, rng);
+    EXPECT_NE(mixed.find("```"), std::string::npos);
+
+    EXPECT_FALSE(postShapeFromStr("poem").has_value());
+    ASSIGN_OR_FAIL(PostShape shape, postShapeFromStr("list"));
+    EXPECT_EQ(shape, PostShape::LIST);
+}
+
+TEST(Generate, CanFillDataSource)
+{
+    ASSIGN_OR_FAIL(auto data, DataSourceSqlite::newFromMemory());
+    GenerateOptions options;
+    options.users = 3;
+    options.years = 1;
+    options.post_size = 200;
+    // Not a multiple of the number of weeklies.
+    options.batch_size = 10;
+    ASSIGN_OR_FAIL(GenerateStats stats, generateWeeklies(*data, options));
+    EXPECT_EQ(stats.weeklies, 3 * 52);
+    EXPECT_GT(stats.bytes, 3 * 52 * 100);
+
+    ASSIGN_OR_FAIL(std::vector<WeeklyPost> weeklies,
+                   data->getWeekliesOneYear("user2", options.now));
+    ASSERT_EQ(weeklies.size(), 52);
+    for(const WeeklyPost& p: weeklies)
+    {
+        EXPECT_FALSE(p.raw_content.empty());
+        EXPECT_EQ(p.author, "user2");
+    }
+}
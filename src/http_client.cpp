@@ -11,6 +11,7 @@
 #include <curl/curl.h>
 
 #include "http_client.hpp"
+#include "trace.hpp"
 
 HTTPRequest& HTTPRequest::setPayload(std::string_view data)
 {
@@ -90,31 +91,37 @@ curl_slist* headersFromReq(const HTTPRequest& req)
     return headers;
 }
 
-E<const HTTPResponse*> HTTPSession::get(const HTTPRequest& req)
+E<HTTPResponse> HTTPSession::get(const HTTPRequest& req)
 {
+    Span span("HTTPSession::get");
     prepareForNewRequest();
+    curl_slist* headers = headersFromReq(req);
     curl_easy_setopt(handle, CURLOPT_URL, req.url.c_str());
-    curl_easy_setopt(handle, CURLOPT_HTTPHEADER, headersFromReq(req));
+    curl_easy_setopt(handle, CURLOPT_HTTPHEADER, headers);
     CURLcode code = curl_easy_perform(handle);
+    curl_slist_free_all(headers);
     if(code == CURLE_OK)
     {
-        return &res;
+        return std::move(res);
     }
     return std::unexpected(runtimeError(curl_easy_strerror(code)));
 }
 
-E<const HTTPResponse*> HTTPSession::post(const HTTPRequest& req)
+E<HTTPResponse> HTTPSession::post(const HTTPRequest& req)
 {
+    Span span("HTTPSession::post");
     prepareForNewRequest();
+    curl_slist* headers = headersFromReq(req);
     curl_easy_setopt(handle, CURLOPT_URL, req.url.c_str());
-    curl_easy_setopt(handle, CURLOPT_HTTPHEADER, headersFromReq(req));
+    curl_easy_setopt(handle, CURLOPT_HTTPHEADER, headers);
     curl_easy_setopt(handle, CURLOPT_POSTFIELDS, req.request_data.data());
     curl_easy_setopt(handle, CURLOPT_POSTFIELDSIZE, req.request_data.size());
 
     CURLcode code = curl_easy_perform(handle);
+    curl_slist_free_all(headers);
     if(code == CURLE_OK)
     {
-        return &res;
+        return std::move(res);
     }
     return std::unexpected(runtimeError(curl_easy_strerror(code)));
 }
@@ -122,10 +129,13 @@ E<const HTTPResponse*> HTTPSession::post(const HTTPRequest& req)
 size_t HTTPSession::writeResponse(char *ptr, size_t size, size_t nmemb,
                                   void *res)
 {
+    // This could be called multiple times for one response, each
+    // time with a piece of the body.
     size_t realsize = size * nmemb;
     HTTPResponse* b = reinterpret_cast<HTTPResponse*>(res);
-    b->payload.resize(realsize);
-    std::memcpy(b->payload.data(), ptr, realsize);
+    size_t old_size = b->payload.size();
+    b->payload.resize(old_size + realsize);
+    std::memcpy(b->payload.data() + old_size, ptr, realsize);
     return realsize;
 }
 
@@ -189,3 +199,40 @@ size_t HTTPSession::writeHeaders(char *buffer, [[maybe_unused]] size_t size,
 
     return nitems;
 }
+
+std::unique_ptr<HTTPSession> HTTPSessionPool::acquire()
+{
+    std::lock_guard<std::mutex> l(lock);
+    if(idle.empty())
+    {
+        return std::make_unique<HTTPSession>(prototype);
+    }
+    std::unique_ptr<HTTPSession> session = std::move(idle.back());
+    idle.pop_back();
+    return session;
+}
+
+void HTTPSessionPool::release(std::unique_ptr<HTTPSession> session)
+{
+    std::lock_guard<std::mutex> l(lock);
+    if(idle.size() < max_idle_count)
+    {
+        idle.push_back(std::move(session));
+    }
+}
+
+E<HTTPResponse> HTTPSessionPool::get(const HTTPRequest& req)
+{
+    std::unique_ptr<HTTPSession> session = acquire();
+    E<HTTPResponse> res = session->get(req);
+    release(std::move(session));
+    return res;
+}
+
+E<HTTPResponse> HTTPSessionPool::post(const HTTPRequest& req)
+{
+    std::unique_ptr<HTTPSession> session = acquire();
+    E<HTTPResponse> res = session->post(req);
+    release(std::move(session));
+    return res;
+}
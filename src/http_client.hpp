@@ -4,6 +4,8 @@
 #include <string_view>
 #include <vector>
 #include <cstddef>
+#include <memory>
+#include <mutex>
 #include <span>
 #include <unordered_map>
 
@@ -42,12 +44,12 @@ class HTTPSessionInterface
 {
 public:
     virtual ~HTTPSessionInterface() = default;
-    E<const HTTPResponse*> get(const std::string& uri)
+    E<HTTPResponse> get(const std::string& uri)
     {
         return this->get(HTTPRequest(uri));
     }
-    virtual E<const HTTPResponse*> get(const HTTPRequest& req) = 0;
-    virtual E<const HTTPResponse*> post(const HTTPRequest& req) = 0;
+    virtual E<HTTPResponse> get(const HTTPRequest& req) = 0;
+    virtual E<HTTPResponse> post(const HTTPRequest& req) = 0;
 };
 
 // Threads should not share session
@@ -60,9 +62,8 @@ public:
     HTTPSession& operator=(const HTTPSession&) = delete;
 
     using HTTPSessionInterface::get;
-    // The returned pointer is garenteed to be non-null.
-    E<const HTTPResponse*> get(const HTTPRequest& req) override;
-    E<const HTTPResponse*> post(const HTTPRequest& req) override;
+    E<HTTPResponse> get(const HTTPRequest& req) override;
+    E<HTTPResponse> post(const HTTPRequest& req) override;
 
 private:
     CURL* handle = nullptr;
@@ -75,3 +76,31 @@ private:
     static size_t writeHeaders(char *buffer, size_t size, size_t nitems,
                                void *userdata);
 };
+
+// A session that can be shared by threads. Each request leases an
+// HTTPSession from a pool, so concurrent requests neither wait for
+// each other nor share a curl handle.
+class HTTPSessionPool : public HTTPSessionInterface
+{
+public:
+    // At most max_idle sessions are kept between requests.
+    explicit HTTPSessionPool(size_t max_idle = 16) : max_idle_count(max_idle) {}
+    ~HTTPSessionPool() override = default;
+    HTTPSessionPool(const HTTPSessionPool&) = delete;
+    HTTPSessionPool& operator=(const HTTPSessionPool&) = delete;
+
+    using HTTPSessionInterface::get;
+    E<HTTPResponse> get(const HTTPRequest& req) override;
+    E<HTTPResponse> post(const HTTPRequest& req) override;
+
+private:
+    std::unique_ptr<HTTPSession> acquire();
+    void release(std::unique_ptr<HTTPSession> session);
+
+    std::mutex lock;
+    // New sessions are duplicated from this one. It is never used to
+    // make requests.
+    HTTPSession prototype;
+    std::vector<std::unique_ptr<HTTPSession>> idle;
+    const size_t max_idle_count;
+};
@@ -11,8 +11,8 @@ class HTTPSessionMock : public HTTPSessionInterface
 {
 public:
     ~HTTPSessionMock() override = default;
-    MOCK_METHOD(E<const HTTPResponse*>, get, (const HTTPRequest& req),
+    MOCK_METHOD(E<HTTPResponse>, get, (const HTTPRequest& req),
                 (override));
-    MOCK_METHOD(E<const HTTPResponse*>, post, (const HTTPRequest& req),
+    MOCK_METHOD(E<HTTPResponse>, post, (const HTTPRequest& req),
                 (override));
 };
@@ -1,6 +1,7 @@
 #include <thread>
 #include <chrono>
 #include <format>
+#include <vector>
 
 #include <httplib.h>
 #include <gtest/gtest.h>
@@ -41,18 +42,18 @@ TEST(DISABLED_HTTPSession, CanGet)
     HTTPSession s;
     auto result = s.get(std::format("http://localhost:{}/", port));
     ASSERT_TRUE(result.has_value());
-    const std::vector<std::byte>& payload = (*result)->payload;
+    const std::vector<std::byte>& payload = result->payload;
     EXPECT_EQ(std::string_view(reinterpret_cast<const char*>(payload.data()),
                                payload.size()),
               "aaa");
-    EXPECT_EQ((*result)->status, 200);
-    ASSERT_TRUE((*result)->header.contains("Content-Type"));
-    EXPECT_EQ((*result)->header.at("Content-Type"), "text/plain");
+    EXPECT_EQ(result->status, 200);
+    ASSERT_TRUE(result->header.contains("Content-Type"));
+    EXPECT_EQ(result->header.at("Content-Type"), "text/plain");
 
     // HTTP error
     result = s.get(std::format("http://localhost:{}/aaa", port));
     ASSERT_TRUE(result.has_value());
-    EXPECT_EQ((*result)->status, 404);
+    EXPECT_EQ(result->status, 404);
 
     // cURL error
     result = s.get("http://bad.invalid/");
@@ -91,12 +92,12 @@ TEST(DISABLED_HTTPSession, CanPost)
 
     HTTPSession s;
     {
-        E<const HTTPResponse*> result = s.post(
+        E<HTTPResponse> result = s.post(
             HTTPRequest(std::format("http://localhost:{}/", port))
             .setPayload("aaa")
             .setContentType("text/plain"));
         ASSERT_TRUE(result.has_value());
-        const HTTPResponse& res = **result;
+        const HTTPResponse& res = *result;
         EXPECT_EQ(res.status, 200);
         ASSERT_TRUE(res.header.contains("Content-Type"));
         EXPECT_EQ(res.header.at("Content-Type"), "text/plain");
@@ -106,11 +107,11 @@ TEST(DISABLED_HTTPSession, CanPost)
                   "bbb");
     }
     {
-        E<const HTTPResponse*> result = s.post(
+        E<HTTPResponse> result = s.post(
             HTTPRequest(std::format("http://localhost:{}/", port))
             .addHeader("Content-Type", "text/plain").setPayload("nonono"));
         ASSERT_TRUE(result.has_value());
-        const HTTPResponse& res = **result;
+        const HTTPResponse& res = *result;
         EXPECT_EQ(res.status, 401);
         ASSERT_TRUE(res.header.contains("Content-Type"));
         EXPECT_EQ(res.header.at("Content-Type"), "text/plain");
@@ -121,6 +122,47 @@ TEST(DISABLED_HTTPSession, CanPost)
     }
 
 
+    server.stop();
+    t.join();
+}
+
+TEST(DISABLED_HTTPSessionPool, CanGetConcurrently)
+{
+    httplib::Server server;
+    server.Get("/:n", [](const httplib::Request& req, httplib::Response& res) {
+        res.set_content(req.path_params.at("n"), "text/plain");
+    });
+    int port;
+    std::thread t([&]()
+    {
+        port = server.bind_to_any_port("localhost");
+        server.listen_after_bind();
+    });
+    server.wait_until_ready();
+
+    HTTPSessionPool pool(2);
+    std::vector<std::string> bodies(8);
+    std::vector<std::thread> clients;
+    for(size_t i = 0; i < bodies.size(); i++)
+    {
+        clients.emplace_back([&, i]()
+        {
+            auto result = pool.get(std::format("http://localhost:{}/{}", port, i));
+            if(result.has_value())
+            {
+                bodies[i] = result->payloadAsStr();
+            }
+        });
+    }
+    for(auto& c: clients)
+    {
+        c.join();
+    }
+    for(size_t i = 0; i < bodies.size(); i++)
+    {
+        EXPECT_EQ(bodies[i], std::to_string(i));
+    }
+
     server.stop();
     t.join();
 }
@@ -0,0 +1,184 @@
+#include <algorithm>
+#include <chrono>
+#include <exception>
+#include <format>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+#include "data.hpp"
+#include "error.hpp"
+#include "importer.hpp"
+#include "trace.hpp"
+#include "utils.hpp"
+#include "weekly.hpp"
+
+namespace
+{
+
+E<std::string> getString(const nlohmann::json& object, const char* key)
+{
+    auto it = object.find(key);
+    if(it == std::end(object) || !it->is_string())
+    {
+        return std::unexpected(httpError(400, std::format(
+            "Missing or invalid {}", key)));
+    }
+    return it->get<std::string>();
+}
+
+E<WeeklyPost> weeklyFromJSON(std::string_view line)
+{
+    nlohmann::json object = nlohmann::json::parse(line, nullptr, false);
+    if(!object.is_object())
+    {
+        return std::unexpected(httpError(400, "Invalid JSON object"));
+    }
+    WeeklyPost p;
+    p.format = WeeklyPost::MARKDOWN;
+    ASSIGN_OR_RETURN(p.author, getString(object, "author"));
+    if(!isValidUsername(p.author))
+    {
+        return std::unexpected(httpError(400, std::format(
+            "Invalid author {}", nlohmann::json(p.author).dump(
+                -1, ' ', false, nlohmann::json::error_handler_t::replace))));
+    }
+    ASSIGN_OR_RETURN(p.raw_content, getString(object, "markdown"));
+    ASSIGN_OR_RETURN(std::string week, getString(object, "week_begin"));
+    E<Time> week_begin = strToDate(week);
+    if(!week_begin.has_value() || weekBegin(*week_begin) != *week_begin)
+    {
+        return std::unexpected(httpError(400, std::format(
+            "Invalid week_begin {}, which should be a Monday", week)));
+    }
+    p.week_begin = *week_begin;
+    p.update_time = Clock::now();
+    if(object.contains("update_time"))
+    {
+        ASSIGN_OR_RETURN(std::string time, getString(object, "update_time"));
+        E<Time> update_time = rfc3339ToTime(time);
+        if(!update_time.has_value())
+        {
+            return std::unexpected(httpError(400, std::format(
+                "Invalid update_time {}", time)));
+        }
+        p.update_time = *update_time;
+    }
+    if(object.contains("language"))
+    {
+        ASSIGN_OR_RETURN(p.language, getString(object, "language"));
+    }
+    if(object.contains("format"))
+    {
+        ASSIGN_OR_RETURN(std::string format, getString(object, "format"));
+        if(format != WeeklyPost::formatName(WeeklyPost::MARKDOWN))
+        {
+            return std::unexpected(httpError(400, std::format(
+                "Unsupported format {}", format)));
+        }
+    }
+    return p;
+}
+
+} // namespace
+
+WeeklyImporter::WeeklyImporter(const DataSourceInterface& data,
+                               size_t batch_size, size_t max_line_bytes)
+        : data(data), batch_size(batch_size), max_line_bytes(max_line_bytes),
+          begin(std::chrono::steady_clock::now())
+{
+    batch.reserve(batch_size);
+}
+
+E<void> WeeklyImporter::feed(std::string_view input)
+{
+    while(!input.empty())
+    {
+        size_t newline = input.find('\n');
+        size_t size = std::min(newline, input.size());
+        DO_OR_RETURN(checkLineSize(partial_line.size() + size));
+        if(newline == std::string_view::npos)
+        {
+            partial_line.append(input);
+            break;
+        }
+        if(partial_line.empty())
+        {
+            DO_OR_RETURN(importLine(input.substr(0, newline)));
+        }
+        else
+        {
+            partial_line.append(input.substr(0, newline));
+            DO_OR_RETURN(importLine(partial_line));
+            partial_line.clear();
+        }
+        input.remove_prefix(newline + 1);
+    }
+    return {};
+}
+
+E<ImportStats> WeeklyImporter::finish()
+{
+    if(!partial_line.empty())
+    {
+        DO_OR_RETURN(importLine(partial_line));
+        partial_line.clear();
+    }
+    DO_OR_RETURN(writeBatch());
+    stats.elapsed = std::chrono::steady_clock::now() - begin;
+    return stats;
+}
+
+E<void> WeeklyImporter::checkLineSize(size_t size) const
+{
+    if(size > max_line_bytes)
+    {
+        return std::unexpected(httpError(400, std::format(
+            "Line {}: Longer than {} bytes", line_number + 1,
+            max_line_bytes)));
+    }
+    return {};
+}
+
+E<void> WeeklyImporter::importLine(std::string_view line)
+{
+    line_number++;
+    if(!line.empty() && line.back() == '\r')
+    {
+        line.remove_suffix(1);
+    }
+    if(line.find_first_not_of(" \t") == std::string_view::npos)
+    {
+        return {};
+    }
+    E<WeeklyPost> p = weeklyFromJSON(line);
+    if(!p.has_value())
+    {
+        return std::unexpected(httpError(400, std::format(
+            "Line {}: {}", line_number, errorMsg(p.error()))));
+    }
+    stats.bytes += p->raw_content.size();
+    batch.push_back(*std::move(p));
+    if(batch.size() >= batch_size)
+    {
+        return writeBatch();
+    }
+    return {};
+}
+
+E<void> WeeklyImporter::writeBatch()
+{
+    if(batch.empty())
+    {
+        return {};
+    }
+    Span span("WeeklyImporter::writeBatch");
+    size_t size = batch.size();
+    DO_OR_RETURN(data.updateWeeklies(std::move(batch), &user_ids));
+    stats.weeklies += size;
+    batch.clear();
+    batch.reserve(batch_size);
+    return {};
+}
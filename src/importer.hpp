@@ -0,0 +1,60 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "data.hpp"
+#include "error.hpp"
+#include "weekly.hpp"
+
+struct ImportStats
+{
+    uint64_t weeklies = 0;
+    uint64_t bytes = 0;
+    std::chrono::duration<double> elapsed{0};
+};
+
+// Imports weeklies from NDJSON, i.e. one JSON object on each line,
+// in the format of the weeklies from the JSON API: “author”,
+// “week_begin” (YYYY-MM-DD, a Monday) and “markdown” are required,
+// and “language”, “format” and “update_time” are optional. Other keys
+// are ignored.
+//
+// The input can be fed in pieces of any size, so it never has to be
+// in memory as a whole. Lines longer than max_line_bytes are errors,
+// so that neither does an input without newlines. The weeklies are
+// written in transactions of batch_size weeklies. If the import fails
+// halfway, the batches before are kept.
+class WeeklyImporter
+{
+public:
+    static constexpr size_t MAX_LINE_BYTES = 4 * 1024 * 1024;
+
+    WeeklyImporter(const DataSourceInterface& data, size_t batch_size,
+                   size_t max_line_bytes = MAX_LINE_BYTES);
+
+    // Import the complete lines in data. The rest is kept until the
+    // next call.
+    E<void> feed(std::string_view data);
+    // Import what is left, and return the stats of the whole import.
+    E<ImportStats> finish();
+
+private:
+    E<void> importLine(std::string_view line);
+    E<void> checkLineSize(size_t size) const;
+    E<void> writeBatch();
+
+    const DataSourceInterface& data;
+    const size_t batch_size;
+    const size_t max_line_bytes;
+    // The incomplete last line of the input fed so far.
+    std::string partial_line;
+    std::vector<WeeklyPost> batch;
+    DataSourceInterface::UserIDs user_ids;
+    uint64_t line_number = 0;
+    ImportStats stats;
+    std::chrono::steady_clock::time_point begin;
+};
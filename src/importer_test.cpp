@@ -0,0 +1,92 @@
+#include <chrono>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "data.hpp"
+#include "importer.hpp"
+#include "test_utils.hpp"
+#include "utils.hpp"
+#include "weekly.hpp"
+
+TEST(Importer, CanImportNDJSON)
+{
+    ASSIGN_OR_FAIL(auto data, DataSourceSqlite::newFromMemory());
+    std::string input =
+        R"({"author":"mw","week_begin":"2000-01-03","markdown":"a",)"
+        R"("language":"en","format":"markdown",)"
+        R"("update_time":"2000-01-04T05:06:07Z","html":"<p>a</p>"})" "\n"
+        "\n"
+        R"({"author":"mw","week_begin":"2000-01-10","markdown":"bb"})" "\r\n"
+        R"({"author":"someone","week_begin":"2000-01-10","markdown":"ccc"})";
+    // Feed it in pieces that split lines, with batches smaller than
+    // the input.
+    WeeklyImporter importer(*data, 2);
+    for(size_t i = 0; i < input.size(); i += 7)
+    {
+        ASSERT_TRUE(isExpected(importer.feed(
+            std::string_view(input).substr(i, 7))));
+    }
+    ASSIGN_OR_FAIL(ImportStats stats, importer.finish());
+    EXPECT_EQ(stats.weeklies, 3);
+    EXPECT_EQ(stats.bytes, 6);
+
+    Time week1 = std::chrono::sys_days(std::chrono::January / 3 / 2000);
+    Time week3 = std::chrono::sys_days(std::chrono::January / 17 / 2000);
+    ASSIGN_OR_FAIL(std::vector<WeeklyPost> ps,
+                   data->getWeeklies("mw", week1, week3));
+    ASSERT_EQ(ps.size(), 2);
+    EXPECT_EQ(ps[0].raw_content, "a");
+    EXPECT_EQ(ps[0].language, "en");
+    EXPECT_EQ(timeToRFC3339(ps[0].update_time), "2000-01-04T05:06:07Z");
+    EXPECT_EQ(ps[1].raw_content, "bb");
+    ASSIGN_OR_FAIL(ps, data->getWeeklies("someone", week1, week3));
+    ASSERT_EQ(ps.size(), 2);
+    EXPECT_EQ(ps[1].raw_content, "ccc");
+}
+
+TEST(Importer, InvalidLinesAreErrors)
+{
+    ASSIGN_OR_FAIL(auto data, DataSourceSqlite::newFromMemory());
+    for(std::string_view line: {
+            R"({"author":"mw","markdown":"a"})",
+            R"({"author":"mw","week_begin":"2000-01-04","markdown":"a"})",
+            R"({"author":"mw","week_begin":"2000-01-03","markdown":1})",
+            R"({"author":"mw","week_begin":"2000-01-03","markdown":"a",)"
+            R"("format":"html"})",
+            R"({"author":"","week_begin":"2000-01-03","markdown":"a"})",
+            R"({"author":"a/b","week_begin":"2000-01-03","markdown":"a"})",
+            R"({"author":"mw")"})
+    {
+        WeeklyImporter importer(*data, 10);
+        ASSERT_TRUE(isExpected(importer.feed(
+            R"({"author":"mw","week_begin":"2000-01-03","markdown":"a"})"
+            "\n")));
+        ASSERT_TRUE(isExpected(importer.feed(line)));
+        E<ImportStats> stats = importer.finish();
+        ASSERT_FALSE(stats.has_value()) << line;
+        EXPECT_TRUE(errorMsg(stats.error()).starts_with("Line 2: "))
+            << errorMsg(stats.error());
+    }
+}
+
+TEST(Importer, LongLinesAreErrors)
+{
+    ASSIGN_OR_FAIL(auto data, DataSourceSqlite::newFromMemory());
+    WeeklyImporter importer(*data, 10, 64);
+    ASSERT_TRUE(isExpected(importer.feed(
+        R"({"author":"mw","week_begin":"2000-01-03","markdown":"a"})"
+        "\n")));
+    // Without a newline, the line is only kept up to the limit.
+    std::string piece(16, ' ');
+    E<void> result;
+    for(int i = 0; i < 8 && result.has_value(); i++)
+    {
+        result = importer.feed(piece);
+    }
+    ASSERT_FALSE(result.has_value());
+    EXPECT_TRUE(errorMsg(result.error()).starts_with("Line 2: "))
+        << errorMsg(result.error());
+}
@@ -0,0 +1,139 @@
+#include <cstdint>
+#include <format>
+#include <iterator>
+#include <string>
+#include <string_view>
+
+#include "json_writer.hpp"
+
+JSONWriter& JSONWriter::beginObject()
+{
+    separate();
+    buffer += '{';
+    has_value.push_back(false);
+    return *this;
+}
+
+JSONWriter& JSONWriter::endObject()
+{
+    buffer += '}';
+    has_value.pop_back();
+    return *this;
+}
+
+JSONWriter& JSONWriter::beginArray()
+{
+    separate();
+    buffer += '[';
+    has_value.push_back(false);
+    return *this;
+}
+
+JSONWriter& JSONWriter::endArray()
+{
+    buffer += ']';
+    has_value.pop_back();
+    return *this;
+}
+
+JSONWriter& JSONWriter::key(std::string_view name)
+{
+    separate();
+    writeString(name);
+    buffer += ':';
+    after_key = true;
+    return *this;
+}
+
+JSONWriter& JSONWriter::value(std::string_view s)
+{
+    separate();
+    writeString(s);
+    return *this;
+}
+
+JSONWriter& JSONWriter::value(int64_t i)
+{
+    separate();
+    std::format_to(std::back_inserter(buffer), "{}", i);
+    return *this;
+}
+
+JSONWriter& JSONWriter::value(bool b)
+{
+    separate();
+    buffer += b ? "true" : "false";
+    return *this;
+}
+
+JSONWriter& JSONWriter::null()
+{
+    separate();
+    buffer += "null";
+    return *this;
+}
+
+std::string JSONWriter::take()
+{
+    std::string result;
+    result.swap(buffer);
+    return result;
+}
+
+void JSONWriter::separate()
+{
+    if(after_key)
+    {
+        after_key = false;
+        return;
+    }
+    if(has_value.empty())
+    {
+        return;
+    }
+    if(has_value.back())
+    {
+        buffer += ',';
+    }
+    has_value.back() = true;
+}
+
+void JSONWriter::writeString(std::string_view s)
+{
+    buffer += '"';
+    // Copy the runs of characters that need no escaping at once.
+    size_t begin = 0;
+    for(size_t i = 0; i < s.size(); i++)
+    {
+        unsigned char c = s[i];
+        if(c >= 0x20 && c != '"' && c != '\\')
+        {
+            continue;
+        }
+        buffer.append(s.substr(begin, i - begin));
+        begin = i + 1;
+        switch(c)
+        {
+        case '"':
+            buffer += "\\\"";
+            break;
+        case '\\':
+            buffer += "\\\\";
+            break;
+        case '\n':
+            buffer += "\\n";
+            break;
+        case '\r':
+            buffer += "\\r";
+            break;
+        case '\t':
+            buffer += "\\t";
+            break;
+        default:
+            std::format_to(std::back_inserter(buffer), "\\u{:04x}",
+                           static_cast<unsigned>(c));
+        }
+    }
+    buffer.append(s.substr(begin));
+    buffer += '"';
+}
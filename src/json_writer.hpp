@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Writes JSON text into a buffer as it goes, without building a
+// document first. The text written so far can be taken at any time,
+// e.g. to send it as a chunk of a response. Commas are added between
+// values; it is up to the caller to close what it opens, and to write
+// a key before each value in an object.
+class JSONWriter
+{
+public:
+    JSONWriter& beginObject();
+    JSONWriter& endObject();
+    JSONWriter& beginArray();
+    JSONWriter& endArray();
+    JSONWriter& key(std::string_view name);
+    // Strings are written as they are, and should be UTF-8.
+    JSONWriter& value(std::string_view s);
+    JSONWriter& value(const char* s) { return value(std::string_view(s)); }
+    JSONWriter& value(int64_t i);
+    JSONWriter& value(int i) { return value(static_cast<int64_t>(i)); }
+    JSONWriter& value(bool b);
+    JSONWriter& null();
+
+    // Return the text written since the last call, and clear it.
+    std::string take();
+    // Size of the text that is not taken yet.
+    size_t size() const { return buffer.size(); }
+
+private:
+    // Write a comma if a value came before in the same array or
+    // object.
+    void separate();
+    void writeString(std::string_view s);
+
+    std::string buffer;
+    // For each open array or object, whether it has a value yet.
+    std::vector<bool> has_value;
+    // Whether a key was just written, so the value needs no comma.
+    bool after_key = false;
+};
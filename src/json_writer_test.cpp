@@ -0,0 +1,47 @@
+#include <string>
+
+#include <gtest/gtest.h>
+#include <nlohmann/json.hpp>
+
+#include "json_writer.hpp"
+
+TEST(JSONWriter, CanWriteNestedValues)
+{
+    JSONWriter w;
+    w.beginObject()
+        .key("name").value("mw")
+        .key("count").value(2)
+        .key("ok").value(true)
+        .key("nothing").null()
+        .key("list").beginArray()
+            .value(int64_t(1))
+            .beginObject().key("a").value("b").endObject()
+            .beginArray().endArray()
+        .endArray()
+        .endObject();
+    std::string text = w.take();
+    EXPECT_EQ(text, R"({"name":"mw","count":2,"ok":true,"nothing":null,)"
+              R"("list":[1,{"a":"b"},[]]})");
+    EXPECT_EQ(w.size(), 0);
+    EXPECT_EQ(nlohmann::json::parse(text)["list"][1]["a"], "b");
+}
+
+TEST(JSONWriter, EscapesStrings)
+{
+    std::string s = "a\"b\\c\nd\te\x01 – 中";
+    JSONWriter w;
+    w.value(s);
+    std::string text = w.take();
+    EXPECT_EQ(text, "\"a\\\"b\\\\c\\nd\\te\\u0001 – 中\"");
+    EXPECT_EQ(nlohmann::json::parse(text).get<std::string>(), s);
+}
+
+TEST(JSONWriter, CanBeTakenInPieces)
+{
+    JSONWriter w;
+    w.beginArray().value("a");
+    std::string text = w.take();
+    w.value("b").endArray();
+    text += w.take();
+    EXPECT_EQ(text, R"(["a","b"])");
+}
@@ -0,0 +1,323 @@
+#include <array>
+#include <cstdint>
+#include <expected>
+#include <format>
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include <nlohmann/json.hpp>
+#include <openssl/bn.h>
+#include <openssl/core_names.h>
+#include <openssl/ecdsa.h>
+#include <openssl/evp.h>
+#include <openssl/param_build.h>
+#include <spdlog/spdlog.h>
+
+#include "error.hpp"
+#include "jwt.hpp"
+#include "utils.hpp"
+
+namespace
+{
+
+struct BNDeleter
+{
+    void operator()(BIGNUM* n) const { BN_free(n); }
+};
+using BN = std::unique_ptr<BIGNUM, BNDeleter>;
+
+struct ParamBuildDeleter
+{
+    void operator()(OSSL_PARAM_BLD* b) const { OSSL_PARAM_BLD_free(b); }
+};
+
+struct ParamDeleter
+{
+    void operator()(OSSL_PARAM* p) const { OSSL_PARAM_free(p); }
+};
+
+struct PKeyCtxDeleter
+{
+    void operator()(EVP_PKEY_CTX* c) const { EVP_PKEY_CTX_free(c); }
+};
+
+struct MDCtxDeleter
+{
+    void operator()(EVP_MD_CTX* c) const { EVP_MD_CTX_free(c); }
+};
+
+struct ECDSASigDeleter
+{
+    void operator()(ECDSA_SIG* s) const { ECDSA_SIG_free(s); }
+};
+
+BN bnFromBytes(std::string_view bytes)
+{
+    return BN(BN_bin2bn(reinterpret_cast<const unsigned char*>(bytes.data()),
+                        bytes.size(), nullptr));
+}
+
+E<std::string> getBase64Property(const nlohmann::json& jwk,
+                                 std::string_view property)
+{
+    if(!jwk.contains(property) || !jwk[property].is_string())
+    {
+        return std::unexpected(runtimeError(
+            std::format("Invalid value of {} in JWK", property)));
+    }
+    return base64URLDecode(jwk[property].get_ref<const std::string&>());
+}
+
+// Build a public key from the parameters in the builder.
+E<EVPKey> keyFromParams(const char* type, OSSL_PARAM_BLD* builder)
+{
+    std::unique_ptr<OSSL_PARAM, ParamDeleter> params(
+        OSSL_PARAM_BLD_to_param(builder));
+    std::unique_ptr<EVP_PKEY_CTX, PKeyCtxDeleter> ctx(
+        EVP_PKEY_CTX_new_from_name(nullptr, type, nullptr));
+    EVP_PKEY* key = nullptr;
+    if(params == nullptr || ctx == nullptr ||
+       EVP_PKEY_fromdata_init(ctx.get()) <= 0 ||
+       EVP_PKEY_fromdata(ctx.get(), &key, EVP_PKEY_PUBLIC_KEY,
+                         params.get()) <= 0)
+    {
+        return std::unexpected(runtimeError(
+            std::format("Failed to load {} key", type)));
+    }
+    return EVPKey(key);
+}
+
+E<EVPKey> rsaKeyFromJWK(const nlohmann::json& jwk)
+{
+    ASSIGN_OR_RETURN(std::string n, getBase64Property(jwk, "n"));
+    ASSIGN_OR_RETURN(std::string e, getBase64Property(jwk, "e"));
+    BN bn_n = bnFromBytes(n);
+    BN bn_e = bnFromBytes(e);
+    std::unique_ptr<OSSL_PARAM_BLD, ParamBuildDeleter> builder(
+        OSSL_PARAM_BLD_new());
+    if(bn_n == nullptr || bn_e == nullptr || builder == nullptr ||
+       !OSSL_PARAM_BLD_push_BN(builder.get(), OSSL_PKEY_PARAM_RSA_N,
+                               bn_n.get()) ||
+       !OSSL_PARAM_BLD_push_BN(builder.get(), OSSL_PKEY_PARAM_RSA_E,
+                               bn_e.get()))
+    {
+        return std::unexpected(runtimeError("Invalid RSA key"));
+    }
+    return keyFromParams("RSA", builder.get());
+}
+
+E<EVPKey> ecKeyFromJWK(const nlohmann::json& jwk)
+{
+    if(!jwk.contains("crv") || jwk["crv"] != "P-256")
+    {
+        return std::unexpected(runtimeError("Unsupported EC curve"));
+    }
+    ASSIGN_OR_RETURN(std::string x, getBase64Property(jwk, "x"));
+    ASSIGN_OR_RETURN(std::string y, getBase64Property(jwk, "y"));
+    if(x.size() != 32 || y.size() != 32)
+    {
+        return std::unexpected(runtimeError("Invalid EC key"));
+    }
+    // Uncompressed point encoding.
+    std::string point = "\x04" + x + y;
+    std::unique_ptr<OSSL_PARAM_BLD, ParamBuildDeleter> builder(
+        OSSL_PARAM_BLD_new());
+    if(builder == nullptr ||
+       !OSSL_PARAM_BLD_push_utf8_string(
+           builder.get(), OSSL_PKEY_PARAM_GROUP_NAME, "prime256v1", 0) ||
+       !OSSL_PARAM_BLD_push_octet_string(
+           builder.get(), OSSL_PKEY_PARAM_PUB_KEY, point.data(), point.size()))
+    {
+        return std::unexpected(runtimeError("Invalid EC key"));
+    }
+    return keyFromParams("EC", builder.get());
+}
+
+// JWS uses the raw “r || s” form of ECDSA signatures, but OpenSSL
+// wants DER.
+E<std::string> ecdsaRawToDER(std::string_view raw)
+{
+    if(raw.size() != 64)
+    {
+        return std::unexpected(runtimeError("Invalid ES256 signature"));
+    }
+    std::unique_ptr<ECDSA_SIG, ECDSASigDeleter> sig(ECDSA_SIG_new());
+    BN r = bnFromBytes(raw.substr(0, 32));
+    BN s = bnFromBytes(raw.substr(32));
+    if(sig == nullptr || r == nullptr || s == nullptr ||
+       !ECDSA_SIG_set0(sig.get(), r.get(), s.get()))
+    {
+        return std::unexpected(runtimeError("Invalid ES256 signature"));
+    }
+    // The signature owns r and s now.
+    r.release();
+    s.release();
+    int size = i2d_ECDSA_SIG(sig.get(), nullptr);
+    if(size <= 0)
+    {
+        return std::unexpected(runtimeError("Invalid ES256 signature"));
+    }
+    std::string der(size, '\0');
+    unsigned char* p = reinterpret_cast<unsigned char*>(der.data());
+    i2d_ECDSA_SIG(sig.get(), &p);
+    return der;
+}
+
+} // namespace
+
+E<JWKS> JWKS::fromJSON(std::string_view json_str)
+{
+    nlohmann::json data = parseJSON(json_str);
+    if(data.is_discarded() || !data.contains("keys") ||
+       !data["keys"].is_array())
+    {
+        return std::unexpected(runtimeError("Invalid JWKS"));
+    }
+
+    JWKS result;
+    for(const nlohmann::json& jwk: data["keys"])
+    {
+        if(!jwk.is_object() || !jwk.contains("kty") ||
+           !jwk["kty"].is_string())
+        {
+            continue;
+        }
+        // Skip encryption keys.
+        if(jwk.contains("use") && jwk["use"] != "sig")
+        {
+            continue;
+        }
+        std::string kid;
+        if(jwk.contains("kid") && jwk["kid"].is_string())
+        {
+            kid = jwk["kid"].get<std::string>();
+        }
+
+        const std::string& kty = jwk["kty"].get_ref<const std::string&>();
+        E<EVPKey> key;
+        if(kty == "RSA")
+        {
+            key = rsaKeyFromJWK(jwk);
+        }
+        else if(kty == "EC")
+        {
+            key = ecKeyFromJWK(jwk);
+        }
+        else
+        {
+            continue;
+        }
+        if(!key.has_value())
+        {
+            // E.g. an EC key on another curve. This should not fail
+            // the keys that can be used.
+            spdlog::warn("Skipping signing key {}: {}", kid,
+                         errorMsg(key.error()));
+            continue;
+        }
+        result.keys.insert_or_assign(std::move(kid), *std::move(key));
+    }
+    if(result.keys.empty())
+    {
+        return std::unexpected(runtimeError("No usable key in JWKS"));
+    }
+    return result;
+}
+
+EVP_PKEY* JWKS::key(const std::string& kid) const
+{
+    if(kid.empty() && keys.size() == 1)
+    {
+        return std::begin(keys)->second.get();
+    }
+    if(auto it = keys.find(kid); it != std::end(keys))
+    {
+        return it->second.get();
+    }
+    return nullptr;
+}
+
+E<JWT> JWT::parse(std::string_view token)
+{
+    size_t dot1 = token.find('.');
+    if(dot1 == std::string_view::npos)
+    {
+        return std::unexpected(runtimeError("Invalid JWT"));
+    }
+    size_t dot2 = token.find('.', dot1 + 1);
+    if(dot2 == std::string_view::npos ||
+       token.find('.', dot2 + 1) != std::string_view::npos)
+    {
+        return std::unexpected(runtimeError("Invalid JWT"));
+    }
+
+    ASSIGN_OR_RETURN(std::string header_str,
+                     base64URLDecode(token.substr(0, dot1)));
+    ASSIGN_OR_RETURN(std::string payload_str, base64URLDecode(
+        token.substr(dot1 + 1, dot2 - dot1 - 1)));
+    nlohmann::json header = parseJSON(header_str);
+    if(header.is_discarded() || !header.is_object() ||
+       !header.contains("alg") || !header["alg"].is_string())
+    {
+        return std::unexpected(runtimeError("Invalid JWT header"));
+    }
+
+    JWT jwt;
+    jwt.alg = header["alg"].get<std::string>();
+    if(header.contains("kid") && header["kid"].is_string())
+    {
+        jwt.kid = header["kid"].get<std::string>();
+    }
+    jwt.claims = parseJSON(payload_str);
+    if(jwt.claims.is_discarded() || !jwt.claims.is_object())
+    {
+        return std::unexpected(runtimeError("Invalid JWT payload"));
+    }
+    jwt.signing_input = token.substr(0, dot2);
+    ASSIGN_OR_RETURN(jwt.signature, base64URLDecode(token.substr(dot2 + 1)));
+    return jwt;
+}
+
+E<void> JWT::verify(EVP_PKEY* key) const
+{
+    std::string sig;
+    if(alg == "RS256")
+    {
+        if(!EVP_PKEY_is_a(key, "RSA"))
+        {
+            return std::unexpected(runtimeError("Key is not an RSA key"));
+        }
+        sig = signature;
+    }
+    else if(alg == "ES256")
+    {
+        if(!EVP_PKEY_is_a(key, "EC"))
+        {
+            return std::unexpected(runtimeError("Key is not an EC key"));
+        }
+        ASSIGN_OR_RETURN(sig, ecdsaRawToDER(signature));
+    }
+    else
+    {
+        return std::unexpected(runtimeError(
+            std::format("Unsupported JWT algorithm: {}", alg)));
+    }
+
+    std::unique_ptr<EVP_MD_CTX, MDCtxDeleter> ctx(EVP_MD_CTX_new());
+    if(ctx == nullptr ||
+       EVP_DigestVerifyInit(ctx.get(), nullptr, EVP_sha256(), nullptr,
+                            key) != 1)
+    {
+        return std::unexpected(runtimeError("Failed to verify JWT"));
+    }
+    if(EVP_DigestVerify(
+           ctx.get(), reinterpret_cast<const unsigned char*>(sig.data()),
+           sig.size(),
+           reinterpret_cast<const unsigned char*>(signing_input.data()),
+           signing_input.size()) != 1)
+    {
+        return std::unexpected(runtimeError("Invalid JWT signature"));
+    }
+    return {};
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include <nlohmann/json.hpp>
+#include <openssl/evp.h>
+
+#include "error.hpp"
+
+struct EVPKeyDeleter
+{
+    void operator()(EVP_PKEY* key) const { EVP_PKEY_free(key); }
+};
+using EVPKey = std::unique_ptr<EVP_PKEY, EVPKeyDeleter>;
+
+// The public signing keys of an OpenID Connect provider, from its
+// JWKS document (RFC 7517). Only RSA keys and EC keys on P-256 are
+// supported. Keys of other types, and keys that cannot be parsed, are
+// skipped.
+class JWKS
+{
+public:
+    static E<JWKS> fromJSON(std::string_view json_str);
+
+    // Return the key with the key ID, or null if not found. If kid is
+    // empty and there is only one key, return that key.
+    EVP_PKEY* key(const std::string& kid) const;
+    size_t size() const { return keys.size(); }
+
+private:
+    std::unordered_map<std::string, EVPKey> keys;
+};
+
+// A signed JWT (JWS compact serialization).
+struct JWT
+{
+    std::string alg;
+    std::string kid;
+    nlohmann::json claims;
+    // The “header.payload” part that the signature covers.
+    std::string signing_input;
+    std::string signature;
+
+    // This does not check the signature.
+    static E<JWT> parse(std::string_view token);
+
+    // Check the signature against the key. Only RS256 and ES256 are
+    // supported, and the key type has to match the algorithm.
+    E<void> verify(EVP_PKEY* key) const;
+};
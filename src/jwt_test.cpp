@@ -0,0 +1,66 @@
+#include <string>
+
+#include <gtest/gtest.h>
+#include <nlohmann/json.hpp>
+
+#include "jwt.hpp"
+#include "test_keys.hpp"
+#include "test_utils.hpp"
+#include "utils.hpp"
+
+TEST(JWT, CanVerifyRS256AndES256)
+{
+    TestKey rsa = TestKey::rsa();
+    TestKey ec = TestKey::ec();
+    nlohmann::json jwks{{"keys", {rsa.jwk("r"), ec.jwk("e")}}};
+    ASSIGN_OR_FAIL(JWKS keys, JWKS::fromJSON(jwks.dump()));
+    EXPECT_EQ(keys.size(), 2);
+
+    nlohmann::json claims{{"sub", "aaa"}};
+    ASSIGN_OR_FAIL(JWT rs, JWT::parse(rsa.sign("r", claims)));
+    EXPECT_EQ(rs.alg, "RS256");
+    EXPECT_EQ(rs.kid, "r");
+    EXPECT_EQ(rs.claims, claims);
+    ASSERT_NE(keys.key("r"), nullptr);
+    EXPECT_TRUE(isExpected(rs.verify(keys.key("r"))));
+    // Key type has to match the algorithm.
+    EXPECT_FALSE(rs.verify(keys.key("e")).has_value());
+
+    ASSIGN_OR_FAIL(JWT es, JWT::parse(ec.sign("e", claims)));
+    EXPECT_EQ(es.alg, "ES256");
+    EXPECT_TRUE(isExpected(es.verify(keys.key("e"))));
+
+    EXPECT_EQ(keys.key("unknown"), nullptr);
+}
+
+TEST(JWT, SkipsKeysThatCannotBeParsed)
+{
+    TestKey rsa = TestKey::rsa();
+    nlohmann::json bad_ec{{"kty", "EC"}, {"kid", "p384"}, {"crv", "P-384"},
+                          {"x", "AAAA"}, {"y", "AAAA"}};
+    nlohmann::json bad_rsa{{"kty", "RSA"}, {"kid", "bad"}, {"n", "!"},
+                           {"e", "AQAB"}};
+    nlohmann::json jwks{{"keys", {bad_ec, rsa.jwk("r"), bad_rsa}}};
+    ASSIGN_OR_FAIL(JWKS keys, JWKS::fromJSON(jwks.dump()));
+    EXPECT_EQ(keys.size(), 1);
+    EXPECT_NE(keys.key("r"), nullptr);
+
+    nlohmann::json unusable{{"keys", {bad_ec, bad_rsa}}};
+    EXPECT_FALSE(JWKS::fromJSON(unusable.dump()).has_value());
+}
+
+TEST(JWT, RejectsTamperedToken)
+{
+    TestKey rsa = TestKey::rsa();
+    nlohmann::json jwks{{"keys", {rsa.jwk("r")}}};
+    ASSIGN_OR_FAIL(JWKS keys, JWKS::fromJSON(jwks.dump()));
+
+    std::string token = rsa.sign("r", {{"sub", "aaa"}});
+    size_t dot = token.find('.');
+    std::string forged = token.substr(0, dot + 1) +
+        base64URLEncode(R"({"sub":"bbb"})") + token.substr(token.rfind('.'));
+    ASSIGN_OR_FAIL(JWT jwt, JWT::parse(forged));
+    EXPECT_FALSE(jwt.verify(keys.key("r")).has_value());
+
+    EXPECT_FALSE(JWT::parse("aaa.bbb").has_value());
+}
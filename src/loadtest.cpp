@@ -0,0 +1,429 @@
+// An end-to-end load test. It starts App on a loopback port with a
+// file-backed database and a stand-in OpenID Connect service, drives
+// mixed traffic at it from keep-alive clients, and reports the
+// throughput and latency percentiles. Run it with different --workers
+// to see how the server scales.
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <format>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+#include <cxxopts.hpp>
+#include <httplib.h>
+#include <nlohmann/json.hpp>
+#include <spdlog/spdlog.h>
+
+#include "app.hpp"
+#include "auth.hpp"
+#include "config.hpp"
+#include "data.hpp"
+#include "error.hpp"
+#include "generate.hpp"
+#include "http_client.hpp"
+#include "utils.hpp"
+
+namespace
+{
+
+using namespace std::chrono_literals;
+
+// A stand-in OpenID Connect service. Access tokens are “token-” and
+// the username. Every response is delayed by the latency, to act like
+// a remote service.
+class MockOpenIDProvider
+{
+public:
+    explicit MockOpenIDProvider(std::chrono::milliseconds latency)
+            : latency(latency)
+    {
+        // The requests mostly sleep, so there can be many of them.
+        server.new_task_queue = [] { return new httplib::ThreadPool(64); };
+        server.Get("/.well-known/openid-configuration",
+                   [this](const httplib::Request&, httplib::Response& res)
+        {
+            std::string prefix = std::format("http://127.0.0.1:{}", port);
+            nlohmann::json config = {
+                {"issuer", prefix},
+                {"authorization_endpoint", prefix + "/auth"},
+                {"token_endpoint", prefix + "/token"},
+                {"introspection_endpoint", prefix + "/introspect"},
+                {"userinfo_endpoint", prefix + "/userinfo"},
+            };
+            res.set_content(config.dump(), "application/json");
+        });
+        server.Get("/userinfo", [this](const httplib::Request& req,
+                                       httplib::Response& res)
+        {
+            std::this_thread::sleep_for(this->latency);
+            std::string auth = req.get_header_value("Authorization");
+            constexpr std::string_view prefix = "Bearer token-";
+            if(!auth.starts_with(prefix))
+            {
+                res.status = 401;
+                return;
+            }
+            nlohmann::json user = {
+                {"preferred_username", auth.substr(prefix.size())},
+            };
+            res.set_content(user.dump(), "application/json");
+        });
+    }
+
+    ~MockOpenIDProvider()
+    {
+        server.stop();
+        if(thread.joinable())
+        {
+            thread.join();
+        }
+    }
+
+    // Return the URL prefix of the service.
+    E<std::string> start()
+    {
+        port = server.bind_to_any_port("127.0.0.1");
+        if(port < 0)
+        {
+            return std::unexpected(runtimeError(
+                "Failed to bind the mock OpenID Connect service"));
+        }
+        thread = std::thread([this] { server.listen_after_bind(); });
+        return std::format("http://127.0.0.1:{}", port);
+    }
+
+private:
+    const std::chrono::milliseconds latency;
+    httplib::Server server;
+    int port = -1;
+    std::thread thread;
+};
+
+enum class Operation
+{
+    // A visitor without a session views the weeklies of a user.
+    GUEST_READ,
+    // A user views their own weeklies.
+    SESSION_READ,
+    // A user edits the weekly of this week.
+    EDIT,
+};
+
+constexpr size_t OPERATION_NUM = 3;
+
+std::string_view operationName(Operation op)
+{
+    switch(op)
+    {
+    case Operation::GUEST_READ:
+        return "guest read";
+    case Operation::SESSION_READ:
+        return "session read";
+    case Operation::EDIT:
+        return "edit";
+    }
+    return "";
+}
+
+struct Sample
+{
+    Operation op;
+    std::chrono::nanoseconds latency;
+};
+
+struct ClientResult
+{
+    std::vector<Sample> samples;
+    // Connection failures and unexpected statuses.
+    uint64_t errors = 0;
+    // 503s from load shedding.
+    uint64_t shed = 0;
+};
+
+struct LoadOptions
+{
+    int clients;
+    int users;
+    std::chrono::seconds duration;
+    double edit_ratio;
+    double session_ratio;
+};
+
+ClientResult runClient(int port, const LoadOptions& options, unsigned seed,
+                       std::chrono::steady_clock::time_point deadline)
+{
+    ClientResult result;
+    httplib::Client client("127.0.0.1", port);
+    client.set_keep_alive(true);
+    std::mt19937 rng(seed);
+    std::uniform_int_distribution<int> user_dist(0, options.users - 1);
+    std::uniform_real_distribution<double> ratio(0, 1);
+    std::string this_week = std::format(
+        "{}", std::chrono::floor<std::chrono::days>(weekBegin(Clock::now())));
+
+    while(std::chrono::steady_clock::now() < deadline)
+    {
+        std::string user = std::format("user{}", user_dist(rng));
+        httplib::Headers session = {{"Cookie", "access-token=token-" + user}};
+        double x = ratio(rng);
+        Operation op = x < options.edit_ratio ? Operation::EDIT :
+            x < options.edit_ratio + options.session_ratio ?
+            Operation::SESSION_READ : Operation::GUEST_READ;
+
+        auto begin = std::chrono::steady_clock::now();
+        httplib::Result res = op == Operation::GUEST_READ ?
+            client.Get("/weekly/" + user) :
+            op == Operation::SESSION_READ ?
+            client.Get("/weekly/" + user, session) :
+            client.Post(std::format("/edit/{}/{}", user, this_week), session,
+                        std::format("content=Edited+at+{}",
+                                    begin.time_since_epoch().count()),
+                        "application/x-www-form-urlencoded");
+        auto latency = std::chrono::steady_clock::now() - begin;
+
+        if(!res)
+        {
+            result.errors++;
+            continue;
+        }
+        if(res->status == 503)
+        {
+            result.shed++;
+            continue;
+        }
+        // Edits redirect to the index.
+        if(res->status != 200 && res->status != 302)
+        {
+            result.errors++;
+            continue;
+        }
+        result.samples.push_back({op, latency});
+    }
+    return result;
+}
+
+std::string percentiles(std::vector<std::chrono::nanoseconds>& latencies)
+{
+    if(latencies.empty())
+    {
+        return "no samples";
+    }
+    std::sort(std::begin(latencies), std::end(latencies));
+    auto at = [&](double p)
+    {
+        size_t i = std::min(latencies.size() - 1,
+                            static_cast<size_t>(p * latencies.size()));
+        return std::chrono::duration<double, std::milli>(latencies[i]).count();
+    };
+    return std::format("p50 {:.2f} ms, p99 {:.2f} ms, p999 {:.2f} ms, "
+                       "max {:.2f} ms", at(0.5), at(0.99), at(0.999),
+                       at(1.0));
+}
+
+E<std::unique_ptr<DataSourceSqlite>> prepareData(
+    const std::filesystem::path& db_file, int users, int years,
+    size_t read_connections)
+{
+    ASSIGN_OR_RETURN(auto data, DataSourceSqlite::fromFile(
+        db_file.string(), read_connections));
+    GenerateOptions options;
+    options.users = users;
+    options.years = years;
+    options.post_size = 1000;
+    DO_OR_RETURN(generateWeeklies(*data, options));
+    return data;
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    cxxopts::Options cmd_options("nsweekly_loadtest",
+                                 "End-to-end load test of NSWeekly");
+    cmd_options.add_options()
+        ("workers", "Worker threads of the server",
+         cxxopts::value<int>()->default_value("8"))
+        ("max-queued", "Max queued connections of the server",
+         cxxopts::value<int>()->default_value("128"))
+        ("clients", "Concurrent keep-alive clients",
+         cxxopts::value<int>()->default_value("32"))
+        ("duration", "Seconds to run",
+         cxxopts::value<int>()->default_value("10"))
+        ("users", "Number of users",
+         cxxopts::value<int>()->default_value("50"))
+        ("years", "Years of weeklies of each user",
+         cxxopts::value<int>()->default_value("1"))
+        ("edit-ratio", "Fraction of requests that are edits",
+         cxxopts::value<double>()->default_value("0.05"))
+        ("session-ratio", "Fraction of requests that are reads with a session",
+         cxxopts::value<double>()->default_value("0.3"))
+        ("oidc-latency", "Milliseconds the OpenID Connect service takes",
+         cxxopts::value<int>()->default_value("20"))
+        ("session-cache-size", "Session cache size of the server",
+         cxxopts::value<int>()->default_value("1024"))
+        ("port", "Port of the server",
+         cxxopts::value<int>()->default_value("18080"))
+        ("h,help", "Print this message.");
+    auto opts = cmd_options.parse(argc, argv);
+    if(opts.count("help"))
+    {
+        std::cout << cmd_options.help() << std::endl;
+        return 0;
+    }
+    spdlog::set_level(spdlog::level::warn);
+
+    LoadOptions load;
+    load.clients = opts["clients"].as<int>();
+    load.users = opts["users"].as<int>();
+    load.duration = std::chrono::seconds(opts["duration"].as<int>());
+    load.edit_ratio = opts["edit-ratio"].as<double>();
+    load.session_ratio = opts["session-ratio"].as<double>();
+    if(load.clients <= 0 || load.users <= 0 ||
+       load.edit_ratio + load.session_ratio > 1)
+    {
+        std::cerr << "Invalid options" << std::endl;
+        return 1;
+    }
+
+    MockOpenIDProvider provider(
+        std::chrono::milliseconds(opts["oidc-latency"].as<int>()));
+    E<std::string> provider_url = provider.start();
+    if(!provider_url.has_value())
+    {
+        std::cerr << errorMsg(provider_url.error()) << std::endl;
+        return 1;
+    }
+
+    Configuration config;
+    config.data_dir = NSWEEKLY_SOURCE_DIR;
+    config.listen_address = "127.0.0.1";
+    config.listen_port = opts["port"].as<int>();
+    config.client_id = "nsweekly";
+    config.client_secret = "secret";
+    config.openid_url_prefix = *provider_url;
+    config.url_prefix = std::format("http://127.0.0.1:{}", config.listen_port);
+    config.guest_index = GuestIndex::USER_WEEKLY;
+    config.guest_index_user = "user0";
+    config.default_lang = "en";
+    config.server_threads = opts["workers"].as<int>();
+    config.server_max_queued = opts["max-queued"].as<int>();
+    config.session_cache_size = opts["session-cache-size"].as<int>();
+    // Logging every slow request would measure the logger.
+    config.slow_request_threshold = 0;
+
+    auto auth = AuthOpenIDConnect::create(
+        config, config.url_prefix + "/openid-redirect",
+        std::make_unique<HTTPSessionPool>());
+    if(!auth.has_value())
+    {
+        std::cerr << "Failed to create authentication module: "
+                  << errorMsg(auth.error()) << std::endl;
+        return 1;
+    }
+
+    std::filesystem::path db_file = std::filesystem::temp_directory_path() /
+        std::format("nsweekly-loadtest-{}.db", getpid());
+    std::cout << "Preparing the database..." << std::endl;
+    auto data = prepareData(db_file, load.users, opts["years"].as<int>(),
+                            config.server_threads);
+    if(!data.has_value())
+    {
+        std::cerr << "Failed to prepare the database: "
+                  << errorMsg(data.error()) << std::endl;
+        std::filesystem::remove(db_file);
+        return 1;
+    }
+
+    App app(config, *std::move(auth), *std::move(data));
+    if(auto r = app.loadTemplates(); !r.has_value())
+    {
+        std::cerr << "Failed to load templates: " << errorMsg(r.error())
+                  << std::endl;
+        return 1;
+    }
+    if(auto r = app.loadStatics(); !r.has_value())
+    {
+        std::cerr << "Failed to load static files: " << errorMsg(r.error())
+                  << std::endl;
+        return 1;
+    }
+    std::thread server_thread([&] { app.start(); });
+
+    // Wait for the server to listen.
+    {
+        httplib::Client client("127.0.0.1", config.listen_port);
+        auto give_up = std::chrono::steady_clock::now() + 10s;
+        while(!client.Get("/metrics"))
+        {
+            if(std::chrono::steady_clock::now() > give_up)
+            {
+                std::cerr << "Server did not start" << std::endl;
+                app.stop();
+                server_thread.join();
+                return 1;
+            }
+            std::this_thread::sleep_for(50ms);
+        }
+    }
+
+    std::cout << std::format(
+        "Running {} clients against {} workers for {} s...",
+        load.clients, config.server_threads, load.duration.count())
+              << std::endl;
+    auto begin = std::chrono::steady_clock::now();
+    auto deadline = begin + load.duration;
+    std::vector<ClientResult> results(load.clients);
+    {
+        std::vector<std::jthread> clients;
+        for(int i = 0; i < load.clients; i++)
+        {
+            clients.emplace_back([&, i]
+            {
+                results[i] = runClient(config.listen_port, load, i, deadline);
+            });
+        }
+    }
+    double elapsed = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - begin).count();
+    app.stop();
+    server_thread.join();
+    std::filesystem::remove(db_file);
+
+    std::vector<std::chrono::nanoseconds> all;
+    std::array<std::vector<std::chrono::nanoseconds>, OPERATION_NUM> by_op;
+    uint64_t errors = 0;
+    uint64_t shed = 0;
+    for(const ClientResult& r: results)
+    {
+        for(const Sample& s: r.samples)
+        {
+            all.push_back(s.latency);
+            by_op[static_cast<size_t>(s.op)].push_back(s.latency);
+        }
+        errors += r.errors;
+        shed += r.shed;
+    }
+    std::cout << std::format("Requests: {}, errors: {}, shed with 503: {}\n",
+                             all.size(), errors, shed);
+    std::cout << std::format("Throughput: {:.1f} requests/s\n",
+                             all.size() / elapsed);
+    std::cout << std::format("All: {}\n", percentiles(all));
+    for(size_t i = 0; i < OPERATION_NUM; i++)
+    {
+        std::cout << std::format(
+            "{}: {} requests, {}\n", operationName(static_cast<Operation>(i)),
+            by_op[i].size(), percentiles(by_op[i]));
+    }
+    return 0;
+}
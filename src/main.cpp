@@ -1,3 +1,6 @@
+#include <chrono>
+#include <fstream>
+#include <iostream>
 #include <memory>
 #include <variant>
 #include <filesystem>
@@ -9,11 +12,137 @@
 #include "auth.hpp"
 #include "config.hpp"
 #include "data.hpp"
+#include "generate.hpp"
+#include "importer.hpp"
 #include "http_client.hpp"
 #include "spdlog/spdlog.h"
 #include "utils.hpp"
 #include "url.hpp"
 
+namespace
+{
+
+// Fill a database file with synthetic weeklies, and report how fast
+// it went.
+int generate(const cxxopts::ParseResult& opts)
+{
+    const std::string db_file = opts["generate"].as<std::string>();
+    GenerateOptions options;
+    options.users = opts["users"].as<int>();
+    options.years = opts["years"].as<int>();
+    options.post_size = opts["post-size"].as<size_t>();
+    options.batch_size = opts["batch-size"].as<size_t>();
+    auto shape = postShapeFromStr(opts["post-shape"].as<std::string>());
+    if(!shape.has_value())
+    {
+        spdlog::error("{}", errorMsg(shape.error()));
+        return 1;
+    }
+    options.shape = *shape;
+    if(options.users <= 0 || options.years <= 0 || options.batch_size == 0)
+    {
+        spdlog::error("Invalid options for generating weeklies");
+        return 1;
+    }
+
+    auto data_source = DataSourceSqlite::fromFile(db_file);
+    if(!data_source.has_value())
+    {
+        spdlog::error("Failed to create data source: {}",
+                      errorMsg(data_source.error()));
+        return 2;
+    }
+    spdlog::info("Generating {} weeks of weeklies for {} users in {}...",
+                 options.years * 52, options.users, db_file);
+    auto stats = generateWeeklies(**data_source, options);
+    if(!stats.has_value())
+    {
+        spdlog::error("Failed to generate weeklies: {}",
+                      errorMsg(stats.error()));
+        return 2;
+    }
+    double seconds = stats->elapsed.count();
+    spdlog::info("Inserted {} weeklies ({:.1f} MiB of Markdown) in {:.2f} s, "
+                 "{:.0f} weeklies/s", stats->weeklies,
+                 stats->bytes / 1024.0 / 1024.0, seconds,
+                 stats->weeklies / seconds);
+    std::error_code ec;
+    auto size = std::filesystem::file_size(db_file, ec);
+    if(!ec)
+    {
+        spdlog::info("Database file is {:.1f} MiB", size / 1024.0 / 1024.0);
+    }
+    return 0;
+}
+
+// Import weeklies from an NDJSON file, or stdin if the file is “-”,
+// into the database of the configuration.
+int importWeeklies(const cxxopts::ParseResult& opts, const Configuration& conf)
+{
+    const std::string file = opts["import"].as<std::string>();
+    size_t batch_size = opts["batch-size"].as<size_t>();
+    if(batch_size == 0)
+    {
+        spdlog::error("Invalid batch size");
+        return 1;
+    }
+    std::ifstream file_stream;
+    std::istream* input = &std::cin;
+    if(file != "-")
+    {
+        file_stream.open(file, std::ios::binary);
+        if(!file_stream)
+        {
+            spdlog::error("Failed to open {}", file);
+            return 1;
+        }
+        input = &file_stream;
+    }
+
+    auto data_source = DataSourceSqlite::fromFile(
+        (std::filesystem::path(conf.data_dir) / "data.db").string(), 0,
+        conf.storage);
+    if(!data_source.has_value())
+    {
+        spdlog::error("Failed to create data source: {}",
+                      errorMsg(data_source.error()));
+        return 2;
+    }
+    WeeklyImporter importer(**data_source, batch_size);
+    std::string buffer(64 * 1024, '\0');
+    while(*input)
+    {
+        input->read(buffer.data(), buffer.size());
+        auto r = importer.feed(std::string_view(buffer.data(),
+                                                input->gcount()));
+        if(!r.has_value())
+        {
+            spdlog::error("Failed to import weeklies: {}", errorMsg(r.error()));
+            return 2;
+        }
+    }
+    if(input->bad())
+    {
+        spdlog::error("Failed to read {}", file);
+        return 2;
+    }
+    auto stats = importer.finish();
+    if(!stats.has_value())
+    {
+        spdlog::error("Failed to import weeklies: {}",
+                      errorMsg(stats.error()));
+        return 2;
+    }
+    double seconds = stats->elapsed.count();
+    spdlog::info("Imported {} weeklies ({:.1f} MiB of Markdown) in {:.2f} s, "
+                 "{:.0f} weeklies/s", stats->weeklies,
+                 stats->bytes / 1024.0 / 1024.0, seconds,
+                 stats->weeklies / seconds);
+    return 0;
+}
+
+} // namespace
+
 int main(int argc, char** argv)
 {
     cxxopts::Options cmd_options("NS Weekly", "Naively simple weekly snippet");
@@ -21,6 +150,23 @@ int main(int argc, char** argv)
         ("c,config", "Config file",
          cxxopts::value<std::string>()->default_value("/etc/nsweekly.yaml"))
         ("h,help", "Print this message.");
+    cmd_options.add_options("Generate")
+        ("generate", "Fill the database file with synthetic weeklies, "
+         "and exit.", cxxopts::value<std::string>())
+        ("users", "Number of users to generate",
+         cxxopts::value<int>()->default_value("100"))
+        ("years", "Years of weeklies of each user",
+         cxxopts::value<int>()->default_value("1"))
+        ("post-size", "Average size in bytes of the weeklies",
+         cxxopts::value<size_t>()->default_value("2000"))
+        ("post-shape", "Markdown of the weeklies: prose, list or mixed",
+         cxxopts::value<std::string>()->default_value("mixed"))
+        ("batch-size", "Weeklies inserted in each transaction",
+         cxxopts::value<size_t>()->default_value("1000"));
+    cmd_options.add_options("Import")
+        ("import", "Import weeklies from the NDJSON file into the database "
+         "of the configuration, and exit. - means the standard input.",
+         cxxopts::value<std::string>());
     auto opts = cmd_options.parse(argc, argv);
 
     if(opts.count("help"))
@@ -28,6 +174,10 @@ int main(int argc, char** argv)
         std::cout << cmd_options.help() << std::endl;
         return 0;
     }
+    if(opts.count("generate"))
+    {
+        return generate(opts);
+    }
 
     const std::string config_file = opts["config"].as<std::string>();
 
@@ -37,6 +187,10 @@ int main(int argc, char** argv)
         spdlog::error("Failed to load configuration: {}", errorMsg(conf.error()));
         return 3;
     }
+    if(opts.count("import"))
+    {
+        return importWeeklies(opts, *conf);
+    }
 
     auto url_prefix = URL::fromStr(conf->url_prefix);
     if(!url_prefix.has_value())
@@ -47,7 +201,7 @@ int main(int argc, char** argv)
 
     auto auth = AuthOpenIDConnect::create(
         *conf, url_prefix->appendPath("openid-redirect").str(),
-        std::make_unique<HTTPSession>());
+        std::make_unique<HTTPSessionPool>());
     if(!auth.has_value())
     {
         spdlog::error("Failed to create authentication module: {}",
@@ -55,20 +209,45 @@ int main(int argc, char** argv)
                                  auth.error()));
         return 1;
     }
+    size_t read_connections = conf->db_read_connections;
+    if(read_connections == 0)
+    {
+        // One for each worker thread of httplib::Server.
+        read_connections = conf->server_threads > 0 ?
+            conf->server_threads : CPPHTTPLIB_THREAD_POOL_COUNT;
+    }
     auto data_source = DataSourceSqlite::fromFile(
-        (std::filesystem::path(conf->data_dir) / "data.db").string());
+        (std::filesystem::path(conf->data_dir) / "data.db").string(),
+        read_connections, conf->storage);
     if(!data_source.has_value())
     {
         spdlog::error("Failed to create data source: {}",
                       errorMsg(data_source.error()));
         return 2;
     }
+    if(auto settings = (*data_source)->storageSettings();
+       settings.has_value())
+    {
+        spdlog::info("SQLite storage: {}", settings->str());
+    }
+    (*data_source)->setGroupCommitWindow(
+        std::chrono::milliseconds(conf->group_commit_window));
     if(!(*data_source)->createUser("mw").has_value())
     {
         spdlog::error("Failed to create user");
     }
 
     App app(*conf, *std::move(auth), *std::move(data_source));
+    if(auto r = app.loadTemplates(); !r.has_value())
+    {
+        spdlog::error("Failed to load templates: {}", errorMsg(r.error()));
+        return 5;
+    }
+    if(auto r = app.loadStatics(); !r.has_value())
+    {
+        spdlog::error("Failed to load static files: {}", errorMsg(r.error()));
+        return 6;
+    }
     app.start();
 
     return 0;
@@ -0,0 +1,175 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <format>
+#include <iterator>
+#include <mutex>
+#include <string>
+#include <string_view>
+
+#include "metrics.hpp"
+
+namespace
+{
+
+// Bucket bounds in nanoseconds, so that observing does not need
+// floating point.
+constexpr std::array<int64_t, Histogram::BOUNDS.size()> boundsInNs()
+{
+    std::array<int64_t, Histogram::BOUNDS.size()> result{};
+    for(size_t i = 0; i < result.size(); i++)
+    {
+        result[i] = static_cast<int64_t>(Histogram::BOUNDS[i] * 1e9);
+    }
+    return result;
+}
+
+constexpr std::array<int64_t, Histogram::BOUNDS.size()> BOUNDS_NS =
+    boundsInNs();
+
+std::atomic<size_t> next_thread_index = 0;
+
+size_t shardIndex()
+{
+    thread_local size_t index = next_thread_index.fetch_add(
+        1, std::memory_order_relaxed);
+    return index;
+}
+
+std::string escapeLabelValue(std::string_view value)
+{
+    std::string result;
+    for(char c: value)
+    {
+        switch(c)
+        {
+        case '\\':
+            result += "\\\\";
+            break;
+        case '"':
+            result += "\\\"";
+            break;
+        case '\n':
+            result += "\\n";
+            break;
+        default:
+            result += c;
+        }
+    }
+    return result;
+}
+
+std::string formatLabels(const MetricLabels& labels)
+{
+    std::string result;
+    for(const auto& [name, value]: labels)
+    {
+        if(!result.empty())
+        {
+            result += ',';
+        }
+        result += std::format("{}=\"{}\"", name, escapeLabelValue(value));
+    }
+    return result;
+}
+
+// Join formatted labels with one more label.
+std::string withLabel(const std::string& labels, std::string_view label)
+{
+    if(labels.empty())
+    {
+        return std::string(label);
+    }
+    return std::format("{},{}", labels, label);
+}
+
+} // namespace
+
+void Histogram::observe(std::chrono::nanoseconds duration)
+{
+    Shard& shard = shards[shardIndex() % SHARD_NUM];
+    size_t bucket = std::lower_bound(std::begin(BOUNDS_NS),
+                                     std::end(BOUNDS_NS), duration.count()) -
+        std::begin(BOUNDS_NS);
+    // Threads beyond SHARD_NUM share shards, but the counts are
+    // atomic, and snapshots need no order between them, so relaxed is
+    // enough.
+    shard.buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+    shard.sum_ns.fetch_add(duration.count(), std::memory_order_relaxed);
+}
+
+Histogram::Snapshot Histogram::snapshot() const
+{
+    Snapshot result;
+    uint64_t sum_ns = 0;
+    for(const Shard& shard: shards)
+    {
+        for(size_t i = 0; i < result.buckets.size(); i++)
+        {
+            uint64_t n = shard.buckets[i].load(std::memory_order_relaxed);
+            result.buckets[i] += n;
+            result.count += n;
+        }
+        sum_ns += shard.sum_ns.load(std::memory_order_relaxed);
+    }
+    result.sum = static_cast<double>(sum_ns) / 1e9;
+    return result;
+}
+
+Metrics& Metrics::global()
+{
+    static Metrics metrics;
+    return metrics;
+}
+
+Histogram& Metrics::histogram(const std::string& name, const std::string& help,
+                              const MetricLabels& labels)
+{
+    std::lock_guard guard(lock);
+    Family& family = families[name];
+    if(family.help.empty())
+    {
+        family.help = help;
+    }
+    std::unique_ptr<Histogram>& h = family.members[formatLabels(labels)];
+    if(h == nullptr)
+    {
+        h = std::make_unique<Histogram>();
+    }
+    return *h;
+}
+
+void Metrics::render(std::string& out) const
+{
+    std::lock_guard guard(lock);
+    for(const auto& [name, family]: families)
+    {
+        out += std::format("# HELP {} {}\n# TYPE {} histogram\n", name,
+                           family.help, name);
+        for(const auto& [labels, histogram]: family.members)
+        {
+            Histogram::Snapshot s = histogram->snapshot();
+            uint64_t cumulative = 0;
+            for(size_t i = 0; i < s.buckets.size(); i++)
+            {
+                cumulative += s.buckets[i];
+                std::string le = i < Histogram::BOUNDS.size() ?
+                    std::format("le=\"{}\"", Histogram::BOUNDS[i]) :
+                    std::string("le=\"+Inf\"");
+                out += std::format("{}_bucket{{{}}} {}\n", name,
+                                   withLabel(labels, le), cumulative);
+            }
+            std::string braced = labels.empty() ? "" :
+                std::format("{{{}}}", labels);
+            out += std::format("{}_sum{} {}\n", name, braced, s.sum);
+            out += std::format("{}_count{} {}\n", name, braced, s.count);
+        }
+    }
+}
+
+void appendMetric(std::string& out, std::string_view name,
+                  std::string_view type, std::string_view help, double value)
+{
+    out += std::format("# HELP {} {}\n# TYPE {} {}\n{} {}\n", name, help,
+                       name, type, name, value);
+}
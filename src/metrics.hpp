@@ -0,0 +1,110 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Label names and values of a metric, e.g. {{"route", "/login"}}.
+using MetricLabels = std::vector<std::pair<std::string, std::string>>;
+
+// A latency histogram in the style of Prometheus. Observations go to
+// counters owned by the observing thread (threads are spread over a
+// fixed number of shards, each on its own cache line), so recording
+// takes no lock and threads do not fight over cache lines. Reading
+// sums up the shards.
+class Histogram
+{
+public:
+    // Upper bounds of the buckets in seconds. There is also an
+    // implicit +Inf bucket.
+    static constexpr std::array<double, 14> BOUNDS = {
+        0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025, 0.05,
+        0.1, 0.25, 0.5, 1, 2.5, 5, 10,
+    };
+
+    struct Snapshot
+    {
+        // Not cumulative. The last one is the +Inf bucket.
+        std::array<uint64_t, BOUNDS.size() + 1> buckets{};
+        uint64_t count = 0;
+        double sum = 0;
+    };
+
+    Histogram() = default;
+    Histogram(const Histogram&) = delete;
+    Histogram& operator=(const Histogram&) = delete;
+
+    void observe(std::chrono::nanoseconds duration);
+    Snapshot snapshot() const;
+
+private:
+    static constexpr size_t SHARD_NUM = 32;
+
+    struct alignas(64) Shard
+    {
+        std::array<std::atomic<uint64_t>, BOUNDS.size() + 1> buckets{};
+        std::atomic<uint64_t> sum_ns = 0;
+    };
+
+    std::array<Shard, SHARD_NUM> shards;
+};
+
+// Time a scope into a histogram.
+class ScopedTimer
+{
+public:
+    explicit ScopedTimer(Histogram& histogram)
+            : histogram(histogram), begin(std::chrono::steady_clock::now()) {}
+    ~ScopedTimer()
+    {
+        histogram.observe(std::chrono::steady_clock::now() - begin);
+    }
+    ScopedTimer(const ScopedTimer&) = delete;
+    ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+private:
+    Histogram& histogram;
+    std::chrono::steady_clock::time_point begin;
+};
+
+// A set of histograms, grouped by name and told apart by labels.
+class Metrics
+{
+public:
+    // The metrics of the whole process.
+    static Metrics& global();
+
+    // Return the histogram with the name and labels, creating it if
+    // needed. This takes a lock, so callers on hot paths should look
+    // up the histogram once and keep the reference, which stays valid
+    // as long as this object.
+    Histogram& histogram(const std::string& name, const std::string& help,
+                         const MetricLabels& labels = {});
+    // Append all the histograms to out, in the text exposition format
+    // of Prometheus.
+    void render(std::string& out) const;
+
+private:
+    struct Family
+    {
+        std::string help;
+        // Keyed by the formatted labels.
+        std::map<std::string, std::unique_ptr<Histogram>> members;
+    };
+
+    mutable std::mutex lock;
+    std::map<std::string, Family> families;
+};
+
+// Append a single sample of a gauge or a counter to out, in the text
+// exposition format of Prometheus.
+void appendMetric(std::string& out, std::string_view name,
+                  std::string_view type, std::string_view help, double value);
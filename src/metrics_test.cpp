@@ -0,0 +1,83 @@
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "metrics.hpp"
+
+TEST(Metrics, HistogramCountsIntoBuckets)
+{
+    Histogram h;
+    h.observe(std::chrono::microseconds(100));
+    h.observe(std::chrono::milliseconds(1));
+    h.observe(std::chrono::milliseconds(300));
+    h.observe(std::chrono::seconds(20));
+
+    Histogram::Snapshot s = h.snapshot();
+    EXPECT_EQ(s.count, 4);
+    EXPECT_EQ(s.buckets[0], 1);
+    // The bounds are inclusive.
+    EXPECT_EQ(s.buckets[1], 1);
+    EXPECT_EQ(s.buckets[9], 1);
+    EXPECT_EQ(s.buckets.back(), 1);
+    EXPECT_NEAR(s.sum, 20.3011, 1e-9);
+}
+
+TEST(Metrics, HistogramCountsFromManyThreads)
+{
+    Histogram h;
+    std::vector<std::thread> threads;
+    for(int i = 0; i < 64; i++)
+    {
+        threads.emplace_back([&]
+        {
+            for(int j = 0; j < 1000; j++)
+            {
+                h.observe(std::chrono::milliseconds(2));
+            }
+        });
+    }
+    for(std::thread& t: threads)
+    {
+        t.join();
+    }
+    Histogram::Snapshot s = h.snapshot();
+    EXPECT_EQ(s.count, 64000);
+    EXPECT_EQ(s.buckets[2], 64000);
+}
+
+TEST(Metrics, CanRender)
+{
+    Metrics metrics;
+    Histogram& h = metrics.histogram("test_seconds", "Test.",
+                                     {{"route", "/a\"b"}});
+    EXPECT_EQ(&h, &metrics.histogram("test_seconds", "Test.",
+                                     {{"route", "/a\"b"}}));
+    h.observe(std::chrono::milliseconds(2));
+    metrics.histogram("plain_seconds", "Plain.")
+        .observe(std::chrono::seconds(1));
+
+    std::string out;
+    metrics.render(out);
+    EXPECT_NE(out.find("# HELP test_seconds Test.\n"
+                       "# TYPE test_seconds histogram\n"),
+              std::string::npos);
+    EXPECT_NE(out.find("test_seconds_bucket{route=\"/a\\\"b\",le=\"0.001\"} 0\n"),
+              std::string::npos);
+    EXPECT_NE(out.find("test_seconds_bucket{route=\"/a\\\"b\",le=\"0.0025\"} 1\n"),
+              std::string::npos);
+    EXPECT_NE(out.find("test_seconds_bucket{route=\"/a\\\"b\",le=\"+Inf\"} 1\n"),
+              std::string::npos);
+    EXPECT_NE(out.find("test_seconds_count{route=\"/a\\\"b\"} 1\n"),
+              std::string::npos);
+    EXPECT_NE(out.find("plain_seconds_bucket{le=\"1\"} 1\n"),
+              std::string::npos);
+    EXPECT_NE(out.find("plain_seconds_sum 1\n"), std::string::npos);
+    EXPECT_NE(out.find("plain_seconds_count 1\n"), std::string::npos);
+
+    out.clear();
+    appendMetric(out, "queued", "gauge", "Queued.", 3);
+    EXPECT_EQ(out, "# HELP queued Queued.\n# TYPE queued gauge\nqueued 3\n");
+}
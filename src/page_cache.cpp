@@ -0,0 +1,167 @@
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "compression.hpp"
+#include "error.hpp"
+#include "page_cache.hpp"
+#include "utils.hpp"
+
+size_t PageCache::entryBytes(const std::string& key, const Entry& entry)
+{
+    size_t bytes = ENTRY_BYTES + key.size();
+    if(entry.page != nullptr)
+    {
+        bytes += entry.page->bytes();
+    }
+    return bytes;
+}
+
+PageCache::Entry& PageCache::entryOf(const std::string& key)
+{
+    auto it = entries.find(key);
+    if(it == std::end(entries))
+    {
+        lru.push_front(key);
+        it = entries.emplace(key, Entry()).first;
+        it->second.lru_it = std::begin(lru);
+        total_bytes += entryBytes(key, it->second);
+    }
+    else
+    {
+        lru.splice(std::begin(lru), lru, it->second.lru_it);
+    }
+    return it->second;
+}
+
+bool PageCache::isFresh(const Entry& entry, const std::string& tag) const
+{
+    return entry.page != nullptr && entry.page_version == entry.version &&
+        entry.tag == tag && Clock::now() - entry.render_time < max_age;
+}
+
+E<PageCache::Page> PageCache::get(const std::string& key,
+                                  const std::string& tag,
+                                  const Renderer& render)
+{
+    std::unique_lock<std::mutex> guard(lock);
+    while(true)
+    {
+        Entry& entry = entryOf(key);
+        if(isFresh(entry, tag))
+        {
+            hit_count.fetch_add(1, std::memory_order_relaxed);
+            return entry.page;
+        }
+        if(!entry.rendering)
+        {
+            break;
+        }
+        if(entry.page != nullptr)
+        {
+            stale_hit_count.fetch_add(1, std::memory_order_relaxed);
+            return entry.page;
+        }
+        // Nothing to serve yet. Wait for the other thread, and look
+        // again. If it failed, this thread will try.
+        entry.waiters++;
+        rendered.wait(guard);
+        entries.at(key).waiters--;
+    }
+
+    miss_count.fetch_add(1, std::memory_order_relaxed);
+    Entry& entry = entryOf(key);
+    entry.rendering = true;
+    uint64_t version = entry.version;
+    guard.unlock();
+
+    Page page;
+    E<std::string> html;
+    try
+    {
+        html = render();
+        if(html.has_value())
+        {
+            page = std::make_shared<const CompressedBody>(*std::move(html));
+        }
+    }
+    catch(...)
+    {
+        guard.lock();
+        finishRendering(key, version, tag, nullptr);
+        throw;
+    }
+
+    guard.lock();
+    finishRendering(key, version, tag, page);
+    if(!html.has_value())
+    {
+        return std::unexpected(html.error());
+    }
+    return page;
+}
+
+void PageCache::finishRendering(const std::string& key, uint64_t version,
+                                const std::string& tag, Page page)
+{
+    // Entries being rendered are never evicted.
+    Entry& entry = entries.at(key);
+    entry.rendering = false;
+    if(page != nullptr)
+    {
+        if(entry.page != nullptr)
+        {
+            total_bytes -= entry.page->bytes();
+        }
+        entry.page = std::move(page);
+        entry.tag = tag;
+        entry.render_time = Clock::now();
+        // If the page was invalidated during rendering, it could have
+        // been rendered from old data, so it stays stale.
+        entry.page_version = version;
+        total_bytes += entry.page->bytes();
+        evict();
+    }
+    else if(entry.page == nullptr && entry.waiters == 0)
+    {
+        // E.g. the page of a user that does not exist, which should
+        // not take any memory.
+        total_bytes -= entryBytes(key, entry);
+        lru.erase(entry.lru_it);
+        entries.erase(key);
+    }
+    rendered.notify_all();
+}
+
+void PageCache::evict()
+{
+    auto it = std::end(lru);
+    while(total_bytes > capacity && it != std::begin(lru))
+    {
+        --it;
+        Entry& entry = entries.at(*it);
+        if(entry.rendering || entry.waiters > 0)
+        {
+            continue;
+        }
+        total_bytes -= entryBytes(*it, entry);
+        entries.erase(*it);
+        it = lru.erase(it);
+    }
+}
+
+void PageCache::invalidate(const std::string& key)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    if(auto it = entries.find(key); it != std::end(entries))
+    {
+        it->second.version++;
+    }
+}
+
+size_t PageCache::bytes() const
+{
+    std::lock_guard<std::mutex> guard(lock);
+    return total_bytes;
+}
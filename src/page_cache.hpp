@@ -0,0 +1,104 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "compression.hpp"
+#include "error.hpp"
+#include "utils.hpp"
+
+// Rendered pages, keyed by e.g. the user whose page it is.
+//
+// A page is fresh if it has not been invalidated since it was
+// rendered, it was rendered for the same tag (e.g. the time window of
+// the content), and it is younger than the max age. Only one thread
+// renders a page at a time. While it does, other threads get the
+// stale page if there is one, or wait for the rendering otherwise. So
+// a flood of requests for a page that just became stale causes one
+// rendering, not a flood of database queries. Pages are stored
+// together with their compressed variants, so they are also only
+// compressed once.
+class PageCache
+{
+public:
+    using Page = std::shared_ptr<const CompressedBody>;
+    using Renderer = std::function<E<std::string>()>;
+    // Roughly the memory of an entry besides its page and key. This
+    // counts toward the capacity, so that many small pages cannot
+    // grow the cache without bound.
+    static constexpr size_t ENTRY_BYTES = 256;
+
+    PageCache(size_t capacity_bytes, std::chrono::seconds max_age)
+            : capacity(capacity_bytes), max_age(max_age) {}
+    PageCache(const PageCache&) = delete;
+    PageCache& operator=(const PageCache&) = delete;
+
+    // Return the page of the key, rendering it with render if it is
+    // not fresh. If render returns an error, the error is returned and
+    // nothing is cached.
+    E<Page> get(const std::string& key, const std::string& tag,
+                const Renderer& render);
+    // Mark the page of the key as stale.
+    void invalidate(const std::string& key);
+
+    uint64_t hits() const { return hit_count.load(std::memory_order_relaxed); }
+    // Times a stale page is returned because another thread is
+    // rendering it.
+    uint64_t staleHits() const
+    {
+        return stale_hit_count.load(std::memory_order_relaxed);
+    }
+    uint64_t misses() const
+    {
+        return miss_count.load(std::memory_order_relaxed);
+    }
+    size_t bytes() const;
+
+private:
+    struct Entry
+    {
+        Page page;
+        std::string tag;
+        Time render_time;
+        // Incremented by invalidate().
+        uint64_t version = 0;
+        // The version when the page started rendering.
+        uint64_t page_version = 0;
+        bool rendering = false;
+        // Threads waiting for the rendering. The entry is kept while
+        // there are any.
+        int waiters = 0;
+        std::list<std::string>::iterator lru_it;
+    };
+
+    static size_t entryBytes(const std::string& key, const Entry& entry);
+    // These should be called with the lock held.
+    Entry& entryOf(const std::string& key);
+    bool isFresh(const Entry& entry, const std::string& tag) const;
+    // Store the rendered page and wake up the waiting threads. The
+    // page is null if rendering failed, in which case an entry without
+    // a page is removed, unless threads are waiting for it.
+    void finishRendering(const std::string& key, uint64_t version,
+                         const std::string& tag, Page page);
+    void evict();
+
+    mutable std::mutex lock;
+    std::condition_variable rendered;
+    std::unordered_map<std::string, Entry> entries;
+    // Most recently used key at the front.
+    std::list<std::string> lru;
+    size_t total_bytes = 0;
+    const size_t capacity;
+    const std::chrono::seconds max_age;
+    std::atomic<uint64_t> hit_count = 0;
+    std::atomic<uint64_t> stale_hit_count = 0;
+    std::atomic<uint64_t> miss_count = 0;
+};
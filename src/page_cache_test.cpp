@@ -0,0 +1,135 @@
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "error.hpp"
+#include "page_cache.hpp"
+#include "test_utils.hpp"
+
+TEST(PageCache, CanCacheAndInvalidate)
+{
+    PageCache cache(1024, std::chrono::seconds(60));
+    int render_count = 0;
+    auto render = [&]() -> E<std::string>
+    {
+        render_count++;
+        return std::to_string(render_count);
+    };
+
+    ASSIGN_OR_FAIL(PageCache::Page page, cache.get("mw", "1", render));
+    EXPECT_EQ(page->raw(), "1");
+    ASSIGN_OR_FAIL(page, cache.get("mw", "1", render));
+    EXPECT_EQ(page->raw(), "1");
+    EXPECT_EQ(cache.hits(), 1);
+
+    cache.invalidate("mw");
+    ASSIGN_OR_FAIL(page, cache.get("mw", "1", render));
+    EXPECT_EQ(page->raw(), "2");
+
+    // Different tag
+    ASSIGN_OR_FAIL(page, cache.get("mw", "2", render));
+    EXPECT_EQ(page->raw(), "3");
+    EXPECT_EQ(cache.misses(), 3);
+    // The page, the key and the entry.
+    EXPECT_EQ(cache.bytes(), 1 + 2 + PageCache::ENTRY_BYTES);
+}
+
+TEST(PageCache, ErrorsAreNotCached)
+{
+    PageCache cache(1024, std::chrono::seconds(60));
+    E<PageCache::Page> page = cache.get("mw", "", []() -> E<std::string>
+    {
+        return std::unexpected(runtimeError("aaa"));
+    });
+    EXPECT_FALSE(page.has_value());
+    ASSIGN_OR_FAIL(PageCache::Page p, cache.get(
+        "mw", "", []() -> E<std::string> { return "bbb"; }));
+    EXPECT_EQ(p->raw(), "bbb");
+}
+
+TEST(PageCache, FailedPagesTakeNoMemory)
+{
+    PageCache cache(1024, std::chrono::seconds(60));
+    for(int i = 0; i < 100; i++)
+    {
+        E<PageCache::Page> page = cache.get(
+            std::to_string(i), "", []() -> E<std::string>
+            {
+                return std::unexpected(runtimeError("User not found"));
+            });
+        EXPECT_FALSE(page.has_value());
+    }
+    EXPECT_EQ(cache.bytes(), 0);
+}
+
+TEST(PageCache, EntriesCountTowardCapacity)
+{
+    PageCache cache(4 * PageCache::ENTRY_BYTES, std::chrono::seconds(60));
+    for(int i = 0; i < 100; i++)
+    {
+        ASSIGN_OR_FAIL(PageCache::Page page, cache.get(
+            std::to_string(i), "", []() -> E<std::string> { return "a"; }));
+    }
+    EXPECT_LE(cache.bytes(), 4 * PageCache::ENTRY_BYTES);
+}
+
+TEST(PageCache, RendersOnceForConcurrentMisses)
+{
+    PageCache cache(1024, std::chrono::seconds(60));
+    std::atomic<int> render_count = 0;
+    auto render = [&]() -> E<std::string>
+    {
+        render_count++;
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        return "aaa";
+    };
+
+    std::vector<std::future<E<PageCache::Page>>> results;
+    for(int i = 0; i < 8; i++)
+    {
+        results.push_back(std::async(std::launch::async, [&]()
+        {
+            return cache.get("mw", "", render);
+        }));
+    }
+    for(auto& result: results)
+    {
+        ASSIGN_OR_FAIL(PageCache::Page page, result.get());
+        EXPECT_EQ(page->raw(), "aaa");
+    }
+    EXPECT_EQ(render_count, 1);
+}
+
+TEST(PageCache, ServesStalePageWhileRendering)
+{
+    PageCache cache(1024, std::chrono::seconds(60));
+    ASSIGN_OR_FAIL(PageCache::Page page, cache.get(
+        "mw", "", []() -> E<std::string> { return "old"; }));
+    cache.invalidate("mw");
+
+    std::promise<void> started;
+    std::promise<void> finish;
+    auto slow_render = std::async(std::launch::async, [&]()
+    {
+        return cache.get("mw", "", [&]() -> E<std::string>
+        {
+            started.set_value();
+            finish.get_future().wait();
+            return "new";
+        });
+    });
+    started.get_future().wait();
+    ASSIGN_OR_FAIL(page, cache.get(
+        "mw", "", []() -> E<std::string> { return "unexpected"; }));
+    EXPECT_EQ(page->raw(), "old");
+    EXPECT_EQ(cache.staleHits(), 1);
+
+    finish.set_value();
+    ASSIGN_OR_FAIL(page, slow_render.get());
+    EXPECT_EQ(page->raw(), "new");
+}
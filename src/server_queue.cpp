@@ -0,0 +1,154 @@
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+#include <spdlog/spdlog.h>
+
+#include "server_queue.hpp"
+
+namespace
+{
+
+thread_local bool is_shedding = false;
+
+} // namespace
+
+ServerQueue::ServerQueue(size_t workers, size_t max_queued,
+                         ServerQueueStats& stats)
+        : max_queued(max_queued), stats(stats)
+{
+    for(size_t i = 0; i < workers; i++)
+    {
+        threads.emplace_back([this] { run(work_lane, false); });
+    }
+    if(max_queued > 0)
+    {
+        threads.emplace_back([this] { run(shed_lane, true); });
+    }
+}
+
+ServerQueue::~ServerQueue()
+{
+    shutdown();
+}
+
+bool ServerQueue::enqueue(std::function<void()> task)
+{
+    {
+        std::lock_guard guard(lock);
+        if(stopping)
+        {
+            return false;
+        }
+        if(max_queued == 0 || work_lane.tasks.size() < max_queued)
+        {
+            if(was_full)
+            {
+                spdlog::info("Server queue has room again.");
+                was_full = false;
+            }
+            work_lane.tasks.push_back(std::move(task));
+            stats.queued.store(work_lane.tasks.size(),
+                               std::memory_order_relaxed);
+            work_lane.cv.notify_one();
+            return true;
+        }
+        if(!was_full)
+        {
+            spdlog::warn("Server queue is full with {} connections, "
+                         "answering new ones with 503.",
+                         work_lane.tasks.size());
+            was_full = true;
+        }
+        // The 503s are quick, so the same bound is plenty for them.
+        if(shed_lane.tasks.size() < max_queued)
+        {
+            shed_lane.tasks.push_back(std::move(task));
+            stats.shed.fetch_add(1, std::memory_order_relaxed);
+            shed_lane.cv.notify_one();
+            return true;
+        }
+    }
+    stats.dropped.fetch_add(1, std::memory_order_relaxed);
+    return false;
+}
+
+void ServerQueue::shutdown()
+{
+    {
+        std::lock_guard guard(lock);
+        if(stopping)
+        {
+            return;
+        }
+        stopping = true;
+    }
+    work_lane.cv.notify_all();
+    shed_lane.cv.notify_all();
+    for(std::thread& t: threads)
+    {
+        t.join();
+    }
+}
+
+bool ServerQueue::isShedding()
+{
+    return is_shedding;
+}
+
+void ServerQueue::run(Lane& lane, bool shedding)
+{
+    is_shedding = shedding;
+    while(true)
+    {
+        std::function<void()> task;
+        {
+            std::unique_lock guard(lock);
+            lane.cv.wait(guard, [&] { return stopping || !lane.tasks.empty(); });
+            // Queued tasks are still run when stopping.
+            if(lane.tasks.empty())
+            {
+                return;
+            }
+            task = std::move(lane.tasks.front());
+            lane.tasks.pop_front();
+            if(!shedding)
+            {
+                stats.queued.store(lane.tasks.size(),
+                                   std::memory_order_relaxed);
+            }
+        }
+        if(shedding)
+        {
+            task();
+            continue;
+        }
+        stats.active.fetch_add(1, std::memory_order_relaxed);
+        task();
+        stats.active.fetch_sub(1, std::memory_order_relaxed);
+    }
+}
+
+bool SheddingServer::process_and_close_socket(socket_t sock)
+{
+    const bool shedding = ServerQueue::isShedding();
+    // With one request, httplib answers with "Connection: close", so
+    // the client cannot keep the connection.
+    bool result = httplib::detail::process_server_socket(
+        svr_sock_, sock, shedding ? 1 : keep_alive_max_count_,
+        shedding ? SHED_TIMEOUT_SEC : keep_alive_timeout_sec_,
+        shedding ? SHED_TIMEOUT_SEC : read_timeout_sec_,
+        shedding ? 0 : read_timeout_usec_,
+        shedding ? SHED_TIMEOUT_SEC : write_timeout_sec_,
+        shedding ? 0 : write_timeout_usec_,
+        [this](httplib::Stream& strm, bool close_connection,
+               bool& connection_closed)
+        {
+            return process_request(strm, close_connection,
+                                   connection_closed, nullptr);
+        });
+    httplib::detail::shutdown_socket(sock);
+    httplib::detail::close_socket(sock);
+    return result;
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <httplib.h>
+
+// Load counters of a ServerQueue. The queue is owned by
+// httplib::Server and only lives while it listens, so the counters
+// are kept outside of it.
+struct ServerQueueStats
+{
+    // Connections waiting for a worker.
+    std::atomic<size_t> queued = 0;
+    // Connections being handled by workers.
+    std::atomic<size_t> active = 0;
+    // Connections answered with 503 because the queue was full.
+    std::atomic<uint64_t> shed = 0;
+    // Connections closed without an answer, because even the 503s
+    // could not keep up.
+    std::atomic<uint64_t> dropped = 0;
+};
+
+// The task queue of the server. A fixed number of workers take
+// connections from a bounded queue. When the queue is full, new
+// connections go to a separate thread instead, where isShedding() is
+// true, so that they can be answered with 503 quickly however busy
+// the workers are. Use it with SheddingServer, so that slow clients
+// cannot hold that thread for long.
+class ServerQueue : public httplib::TaskQueue
+{
+public:
+    // If max_queued is 0 the queue is unbounded, and nothing is shed.
+    ServerQueue(size_t workers, size_t max_queued, ServerQueueStats& stats);
+    ~ServerQueue() override;
+    ServerQueue(const ServerQueue&) = delete;
+    ServerQueue& operator=(const ServerQueue&) = delete;
+
+    // Return false if the task cannot be run at all, in which case
+    // httplib closes the connection.
+    bool enqueue(std::function<void()> task) override;
+    // Run the tasks that are already queued, and stop the threads.
+    void shutdown() override;
+
+    // Whether the current thread is answering connections that do not
+    // fit in the queue.
+    static bool isShedding();
+
+private:
+    struct Lane
+    {
+        std::deque<std::function<void()>> tasks;
+        std::condition_variable cv;
+    };
+
+    void run(Lane& lane, bool shedding);
+
+    const size_t max_queued;
+    ServerQueueStats& stats;
+    std::mutex lock;
+    Lane work_lane;
+    Lane shed_lane;
+    bool stopping = false;
+    // Whether the last enqueued connection was shed. This is only for
+    // logging when shedding starts and stops.
+    bool was_full = false;
+    std::vector<std::thread> threads;
+};
+
+// A server that serves connections on the shedding thread of
+// ServerQueue with only one request, and timeouts of SHED_TIMEOUT_SEC
+// instead of the configured ones. Other connections are served as by
+// httplib::Server.
+class SheddingServer : public httplib::Server
+{
+public:
+    static constexpr time_t SHED_TIMEOUT_SEC = 1;
+
+private:
+    bool process_and_close_socket(socket_t sock) override;
+};
@@ -0,0 +1,79 @@
+#include <atomic>
+#include <future>
+
+#include <gtest/gtest.h>
+
+#include "server_queue.hpp"
+
+TEST(ServerQueue, CanRunTasks)
+{
+    ServerQueueStats stats;
+    std::atomic<int> count = 0;
+    {
+        ServerQueue queue(2, 4, stats);
+        for(int i = 0; i < 4; i++)
+        {
+            EXPECT_TRUE(queue.enqueue([&] { count++; }));
+        }
+        queue.shutdown();
+        EXPECT_FALSE(queue.enqueue([&] { count++; }));
+    }
+    EXPECT_EQ(count, 4);
+    EXPECT_EQ(stats.queued, 0);
+    EXPECT_EQ(stats.active, 0);
+    EXPECT_EQ(stats.shed, 0);
+}
+
+TEST(ServerQueue, ShedsWhenFull)
+{
+    ServerQueueStats stats;
+    ServerQueue queue(1, 1, stats);
+    std::promise<void> started;
+    std::promise<void> release;
+    std::shared_future<void> released = release.get_future().share();
+    std::atomic<int> shedding_count = 0;
+    auto task = [&]
+    {
+        if(ServerQueue::isShedding())
+        {
+            shedding_count++;
+        }
+    };
+
+    // Keep the only worker busy.
+    ASSERT_TRUE(queue.enqueue([&]
+    {
+        started.set_value();
+        released.wait();
+    }));
+    started.get_future().wait();
+    EXPECT_EQ(stats.active, 1);
+
+    ASSERT_TRUE(queue.enqueue(task));
+    EXPECT_EQ(stats.queued, 1);
+    // The queue is full, but the shedding thread still takes these.
+    ASSERT_TRUE(queue.enqueue(task));
+    EXPECT_EQ(stats.shed, 1);
+
+    release.set_value();
+    queue.shutdown();
+    EXPECT_EQ(shedding_count, 1);
+    EXPECT_FALSE(ServerQueue::isShedding());
+}
+
+TEST(ServerQueue, UnboundedQueueDoesNotShed)
+{
+    ServerQueueStats stats;
+    ServerQueue queue(1, 0, stats);
+    std::promise<void> release;
+    std::shared_future<void> released = release.get_future().share();
+    ASSERT_TRUE(queue.enqueue([&] { released.wait(); }));
+    for(int i = 0; i < 100; i++)
+    {
+        ASSERT_TRUE(queue.enqueue([] {}));
+    }
+    EXPECT_EQ(stats.shed, 0);
+    release.set_value();
+    queue.shutdown();
+    EXPECT_EQ(stats.queued, 0);
+}
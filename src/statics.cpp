@@ -0,0 +1,171 @@
+#include <algorithm>
+#include <filesystem>
+#include <format>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "compression.hpp"
+#include "error.hpp"
+#include "statics.hpp"
+#include "utils.hpp"
+
+namespace
+{
+
+std::string mimeType(const std::filesystem::path& path)
+{
+    static const std::unordered_map<std::string, std::string> types = {
+        {".css", "text/css"},
+        {".js", "text/javascript"},
+        {".html", "text/html"},
+        {".txt", "text/plain"},
+        {".json", "application/json"},
+        {".svg", "image/svg+xml"},
+        {".png", "image/png"},
+        {".jpg", "image/jpeg"},
+        {".jpeg", "image/jpeg"},
+        {".webp", "image/webp"},
+        {".ico", "image/x-icon"},
+        {".woff2", "font/woff2"},
+    };
+    if(auto it = types.find(path.extension().string()); it != std::end(types))
+    {
+        return it->second;
+    }
+    return "application/octet-stream";
+}
+
+// A short digest of the content, for URLs.
+std::string contentHash(std::string_view content)
+{
+    return base64URLEncode(sha256(content)).substr(0, 16);
+}
+
+} // namespace
+
+MappedFile::~MappedFile()
+{
+    if(addr != nullptr)
+    {
+        munmap(addr, size);
+    }
+}
+
+MappedFile::MappedFile(MappedFile&& rhs) noexcept
+        : addr(std::exchange(rhs.addr, nullptr)),
+          size(std::exchange(rhs.size, 0))
+{
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& rhs) noexcept
+{
+    std::swap(addr, rhs.addr);
+    std::swap(size, rhs.size);
+    return *this;
+}
+
+E<MappedFile> MappedFile::open(const std::filesystem::path& path)
+{
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if(fd < 0)
+    {
+        return std::unexpected(runtimeError(
+            std::format("Failed to open {}", path.string())));
+    }
+    struct stat st;
+    if(fstat(fd, &st) != 0 || st.st_size == 0)
+    {
+        close(fd);
+        return std::unexpected(runtimeError(
+            std::format("Failed to map {}", path.string())));
+    }
+    void* addr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    // The map stays valid after the file is closed.
+    close(fd);
+    if(addr == MAP_FAILED)
+    {
+        return std::unexpected(runtimeError(
+            std::format("Failed to map {}", path.string())));
+    }
+    MappedFile result;
+    result.addr = addr;
+    result.size = st.st_size;
+    return result;
+}
+
+E<std::unique_ptr<StaticFiles>> StaticFiles::load(
+    const std::filesystem::path& dir, size_t mmap_threshold)
+{
+    std::error_code ec;
+    std::filesystem::recursive_directory_iterator entries(dir, ec);
+    if(ec)
+    {
+        return std::unexpected(runtimeError(std::format(
+            "Failed to list static files in {}: {}", dir.string(),
+            ec.message())));
+    }
+
+    std::unique_ptr<StaticFiles> result(new StaticFiles());
+    std::vector<std::string> names;
+    for(const auto& entry: entries)
+    {
+        if(!entry.is_regular_file())
+        {
+            continue;
+        }
+        std::string name = std::filesystem::relative(entry.path(), dir)
+            .generic_string();
+        File file;
+        file.type = mimeType(entry.path());
+        file.last_modified = std::chrono::floor<std::chrono::seconds>(
+            std::chrono::file_clock::to_sys(entry.last_write_time()));
+        if(entry.file_size() > mmap_threshold)
+        {
+            ASSIGN_OR_RETURN(file.mapped, MappedFile::open(entry.path()));
+            file.hash = contentHash(file.mapped.data());
+        }
+        else
+        {
+            ASSIGN_OR_RETURN(std::string content, readFile(entry.path()));
+            file.hash = contentHash(content);
+            file.body = std::make_unique<const CompressedBody>(
+                std::move(content), isCompressible(file.type));
+        }
+        result->last_modified = std::max(result->last_modified,
+                                          file.last_modified);
+        result->files.emplace(name, std::move(file));
+        names.push_back(std::move(name));
+    }
+
+    // The order of directory entries is unspecified, but the version
+    // should not depend on it.
+    std::sort(std::begin(names), std::end(names));
+    std::string all_hashes;
+    for(const std::string& name: names)
+    {
+        all_hashes += name;
+        all_hashes += '\0';
+        all_hashes += result->files.at(name).hash;
+        all_hashes += '\0';
+    }
+    result->all_hash = contentHash(all_hashes);
+    return result;
+}
+
+const StaticFiles::File* StaticFiles::find(const std::string& name) const
+{
+    if(auto it = files.find(name); it != std::end(files))
+    {
+        return &it->second;
+    }
+    return nullptr;
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include "compression.hpp"
+#include "error.hpp"
+#include "utils.hpp"
+
+// A read-only memory map of a whole file.
+class MappedFile
+{
+public:
+    MappedFile() = default;
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    MappedFile(MappedFile&& rhs) noexcept;
+    MappedFile& operator=(MappedFile&& rhs) noexcept;
+
+    static E<MappedFile> open(const std::filesystem::path& path);
+
+    std::string_view data() const
+    {
+        return {static_cast<const char*>(addr), size};
+    }
+
+private:
+    void* addr = nullptr;
+    size_t size = 0;
+};
+
+// The static files in a directory, loaded into memory once. Each
+// file has a hash of its content, which goes into its URL, so that
+// the URLs can be cached forever. The files are not expected to
+// change while the server is running.
+class StaticFiles
+{
+public:
+    struct File
+    {
+        std::string type;
+        // URL-safe.
+        std::string hash;
+        Time last_modified;
+        // Files larger than the mmap threshold are memory mapped,
+        // and have no body.
+        std::unique_ptr<const CompressedBody> body;
+        MappedFile mapped;
+    };
+
+    // Load all the files in dir recursively. Files larger than
+    // mmap_threshold bytes are memory mapped instead of read.
+    static E<std::unique_ptr<StaticFiles>> load(
+        const std::filesystem::path& dir, size_t mmap_threshold);
+
+    // Find a file by its path relative to the directory. Return null
+    // if not found.
+    const File* find(const std::string& name) const;
+    // Changes whenever the content of any file changes.
+    const std::string& version() const { return all_hash; }
+    // The latest modification time of the files.
+    Time lastModified() const { return last_modified; }
+
+private:
+    StaticFiles() = default;
+
+    std::unordered_map<std::string, File> files;
+    std::string all_hash;
+    Time last_modified;
+};
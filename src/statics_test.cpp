@@ -0,0 +1,41 @@
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+#include <gtest/gtest.h>
+
+#include "compression.hpp"
+#include "statics.hpp"
+#include "test_utils.hpp"
+
+TEST(StaticFiles, CanLoadAndMapFiles)
+{
+    std::filesystem::path dir = std::filesystem::temp_directory_path() /
+        "nsweekly-statics-test";
+    std::filesystem::remove_all(dir);
+    std::filesystem::create_directories(dir / "fonts");
+    std::ofstream(dir / "style.css") << "body { color: black; }";
+    std::ofstream(dir / "fonts" / "big.woff2") << std::string(100, 'a');
+
+    ASSIGN_OR_FAIL(auto statics, StaticFiles::load(dir, 50));
+    const StaticFiles::File* css = statics->find("style.css");
+    ASSERT_NE(css, nullptr);
+    EXPECT_EQ(css->type, "text/css");
+    ASSERT_NE(css->body, nullptr);
+    ContentEncoding encoding = ContentEncoding::IDENTITY;
+    EXPECT_EQ(css->body->get(encoding), "body { color: black; }");
+
+    const StaticFiles::File* font = statics->find("fonts/big.woff2");
+    ASSERT_NE(font, nullptr);
+    EXPECT_EQ(font->body, nullptr);
+    EXPECT_EQ(font->mapped.data(), std::string(100, 'a'));
+    EXPECT_NE(font->hash, css->hash);
+    EXPECT_EQ(statics->find("nonexistent.css"), nullptr);
+
+    std::string version = statics->version();
+    std::ofstream(dir / "style.css") << "body { color: white; }";
+    ASSIGN_OR_FAIL(auto new_statics, StaticFiles::load(dir, 50));
+    EXPECT_NE(new_statics->find("style.css")->hash, css->hash);
+    EXPECT_NE(new_statics->version(), version);
+    std::filesystem::remove_all(dir);
+}
@@ -0,0 +1,205 @@
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <exception>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <inja.hpp>
+#include <nlohmann/json.hpp>
+#include <poll.h>
+#include <spdlog/spdlog.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include "error.hpp"
+#include "templates.hpp"
+#include "utils.hpp"
+
+Templates::~Templates()
+{
+    if(watcher.joinable())
+    {
+        watcher.request_stop();
+        watcher.join();
+    }
+    if(inotify_fd >= 0)
+    {
+        close(inotify_fd);
+    }
+}
+
+E<std::unique_ptr<Templates>> Templates::load(const std::filesystem::path& dir,
+                                              Setup setup)
+{
+    std::unique_ptr<Templates> result(new Templates(dir, std::move(setup)));
+    DO_OR_RETURN(result->reload());
+    return result;
+}
+
+E<std::shared_ptr<Templates::Compiled>> Templates::compile() const
+{
+    // Inja wants the trailing slash.
+    auto result = std::make_shared<Compiled>((dir / "").string());
+    if(setup)
+    {
+        setup(result->env);
+    }
+
+    std::error_code ec;
+    std::filesystem::directory_iterator files(dir, ec);
+    if(ec)
+    {
+        return std::unexpected(runtimeError(std::format(
+            "Failed to list templates in {}: {}", dir.string(),
+            ec.message())));
+    }
+    std::vector<std::filesystem::directory_entry> entries;
+    std::copy_if(std::filesystem::begin(files), std::filesystem::end(files),
+                 std::back_inserter(entries), [](const auto& file)
+                 {
+                     return file.is_regular_file() &&
+                         file.path().extension() == ".html";
+                 });
+    // The order of directory entries is unspecified, but the version
+    // should not depend on it.
+    std::sort(std::begin(entries), std::end(entries));
+
+    // All the names and contents of the templates, to derive the
+    // version from.
+    std::string all_content;
+    for(const auto& file: entries)
+    {
+        std::string name = file.path().filename().string();
+        std::ifstream f(file.path(), std::ios::binary);
+        std::ostringstream content;
+        content << f.rdbuf();
+        all_content += name;
+        all_content += '\0';
+        all_content += content.str();
+        all_content += '\0';
+        Time mtime = std::chrono::floor<std::chrono::seconds>(
+            std::chrono::file_clock::to_sys(file.last_write_time()));
+        result->last_modified = std::max(result->last_modified, mtime);
+        try
+        {
+            result->templates.emplace(name, result->env.parse_template(name));
+        }
+        catch(const std::exception& e)
+        {
+            return std::unexpected(runtimeError(std::format(
+                "Failed to parse template {}: {}", name, e.what())));
+        }
+    }
+    result->version = base64URLEncode(sha256(all_content));
+    return result;
+}
+
+std::shared_ptr<Templates::Compiled> Templates::current() const
+{
+    std::lock_guard<std::mutex> guard(lock);
+    return compiled;
+}
+
+std::string Templates::version() const
+{
+    return current()->version;
+}
+
+Time Templates::lastModified() const
+{
+    return current()->last_modified;
+}
+
+E<std::string> Templates::render(const std::string& name,
+                                 const nlohmann::json& data) const
+{
+    std::shared_ptr<Compiled> templates = current();
+    auto it = templates->templates.find(name);
+    if(it == std::end(templates->templates))
+    {
+        return std::unexpected(runtimeError(
+            std::format("Template {} not found", name)));
+    }
+    try
+    {
+        return templates->env.render(it->second, data);
+    }
+    catch(const std::exception& e)
+    {
+        return std::unexpected(runtimeError(std::format(
+            "Failed to render template {}: {}", name, e.what())));
+    }
+}
+
+E<void> Templates::reload()
+{
+    ASSIGN_OR_RETURN(std::shared_ptr<Compiled> new_templates, compile());
+    std::lock_guard<std::mutex> guard(lock);
+    compiled = std::move(new_templates);
+    return {};
+}
+
+E<void> Templates::watch()
+{
+    if(watcher.joinable())
+    {
+        return {};
+    }
+    inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if(inotify_fd < 0)
+    {
+        return std::unexpected(runtimeError("Failed to initialize inotify"));
+    }
+    if(inotify_add_watch(inotify_fd, dir.c_str(),
+                         IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_DELETE)
+       < 0)
+    {
+        return std::unexpected(runtimeError(
+            std::format("Failed to watch {}", dir.string())));
+    }
+    watcher = std::jthread([this](std::stop_token stop) { watchLoop(stop); });
+    spdlog::info("Watching templates in {}...", dir.string());
+    return {};
+}
+
+void Templates::watchLoop(std::stop_token stop)
+{
+    std::array<char, 4096> buffer;
+    // What changed does not matter, as all the templates are parsed
+    // again anyway.
+    auto drain = [&]()
+    {
+        while(read(inotify_fd, buffer.data(), buffer.size()) > 0) {}
+    };
+
+    pollfd fd{inotify_fd, POLLIN, 0};
+    while(!stop.stop_requested())
+    {
+        // Wake up once in a while to check the stop token.
+        if(poll(&fd, 1, 200) <= 0)
+        {
+            continue;
+        }
+        drain();
+        // Editors tend to save a file in several steps. Give them
+        // some time to finish.
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        drain();
+        if(auto r = reload(); !r.has_value())
+        {
+            spdlog::error("Failed to reload templates: {}",
+                          errorMsg(r.error()));
+            continue;
+        }
+        spdlog::info("Reloaded templates in {}.", dir.string());
+    }
+}
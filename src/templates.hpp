@@ -0,0 +1,76 @@
+#pragma once
+
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stop_token>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+#include <inja.hpp>
+#include <nlohmann/json.hpp>
+
+#include "error.hpp"
+#include "utils.hpp"
+
+// The inja templates in a directory, parsed once. Rendering is
+// thread-safe. If watched, the templates are parsed again when files
+// in the directory change, and the new templates replace the old ones
+// atomically. Requests being rendered keep using the old ones.
+class Templates
+{
+public:
+    // Called on each new inja environment before parsing, e.g. to add
+    // callbacks.
+    using Setup = std::function<void(inja::Environment&)>;
+
+    ~Templates();
+    Templates(const Templates&) = delete;
+    Templates& operator=(const Templates&) = delete;
+
+    // Parse all the .html files in dir.
+    static E<std::unique_ptr<Templates>> load(const std::filesystem::path& dir,
+                                              Setup setup);
+
+    // Render the template with the file name.
+    E<std::string> render(const std::string& name,
+                          const nlohmann::json& data) const;
+    // Changes whenever the content of the templates changes.
+    std::string version() const;
+    // The latest modification time of the template files.
+    Time lastModified() const;
+    // Parse the files again. On error the current templates are kept.
+    E<void> reload();
+    // Reload when files in the directory change, until this is
+    // destroyed. This uses inotify(7).
+    E<void> watch();
+
+private:
+    struct Compiled
+    {
+        explicit Compiled(const std::string& dir) : env(dir) {}
+
+        // Rendering does not modify the environment, so the templates
+        // are never changed after parsing.
+        inja::Environment env;
+        std::unordered_map<std::string, inja::Template> templates;
+        std::string version;
+        Time last_modified;
+    };
+
+    Templates(const std::filesystem::path& dir, Setup setup)
+            : dir(dir), setup(std::move(setup)) {}
+
+    E<std::shared_ptr<Compiled>> compile() const;
+    std::shared_ptr<Compiled> current() const;
+    void watchLoop(std::stop_token stop);
+
+    const std::filesystem::path dir;
+    const Setup setup;
+    mutable std::mutex lock;
+    std::shared_ptr<Compiled> compiled;
+    int inotify_fd = -1;
+    std::jthread watcher;
+};
@@ -0,0 +1,83 @@
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+#include <gtest/gtest.h>
+#include <inja.hpp>
+#include <nlohmann/json.hpp>
+
+#include "templates.hpp"
+#include "test_utils.hpp"
+
+namespace {
+
+void writeFile(const std::filesystem::path& path, const std::string& content)
+{
+    std::ofstream f(path);
+    f << content;
+}
+
+class TemplatesTest : public testing::Test
+{
+protected:
+    void SetUp() override
+    {
+        dir = std::filesystem::temp_directory_path() /
+            testing::UnitTest::GetInstance()->current_test_info()->name();
+        std::filesystem::remove_all(dir);
+        std::filesystem::create_directories(dir);
+    }
+
+    void TearDown() override
+    {
+        std::filesystem::remove_all(dir);
+    }
+
+    std::filesystem::path dir;
+};
+
+} // namespace
+
+TEST_F(TemplatesTest, CanRenderWithIncludesAndCallbacks)
+{
+    writeFile(dir / "head.html", "<title>{{ title }}</title>");
+    writeFile(dir / "page.html",
+              "{% include \"head.html\" %}{{ shout(name) }}");
+    ASSIGN_OR_FAIL(auto templates, Templates::load(
+        dir, [](inja::Environment& env)
+        {
+            env.add_callback("shout", 1, [](const inja::Arguments& args)
+            {
+                return args.at(0)->get<std::string>() + "!";
+            });
+        }));
+
+    nlohmann::json data{{"title", "aaa"}, {"name", "bbb"}};
+    ASSIGN_OR_FAIL(std::string html, templates->render("page.html", data));
+    EXPECT_EQ(html, "<title>aaa</title>bbb!");
+    EXPECT_FALSE(templates->render("nonexistent.html", data).has_value());
+}
+
+TEST_F(TemplatesTest, ParseErrorFailsLoading)
+{
+    writeFile(dir / "page.html", "{% if %}");
+    EXPECT_FALSE(Templates::load(dir, nullptr).has_value());
+}
+
+TEST_F(TemplatesTest, KeepsOldTemplatesIfReloadingFails)
+{
+    writeFile(dir / "page.html", "aaa");
+    ASSIGN_OR_FAIL(auto templates, Templates::load(dir, nullptr));
+    std::string version = templates->version();
+
+    writeFile(dir / "page.html", "bbb");
+    ASSERT_TRUE(isExpected(templates->reload()));
+    EXPECT_NE(templates->version(), version);
+    ASSIGN_OR_FAIL(std::string html, templates->render("page.html", {}));
+    EXPECT_EQ(html, "bbb");
+
+    writeFile(dir / "page.html", "{% if %}");
+    EXPECT_FALSE(templates->reload().has_value());
+    ASSIGN_OR_FAIL(html, templates->render("page.html", {}));
+    EXPECT_EQ(html, "bbb");
+}
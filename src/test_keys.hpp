@@ -0,0 +1,104 @@
+#pragma once
+
+#include <string>
+#include <memory>
+
+#include <nlohmann/json.hpp>
+#include <openssl/bn.h>
+#include <openssl/core_names.h>
+#include <openssl/ecdsa.h>
+#include <openssl/evp.h>
+#include <openssl/rsa.h>
+
+#include "jwt.hpp"
+#include "utils.hpp"
+
+// A key pair to sign JWTs in tests.
+class TestKey
+{
+public:
+    static TestKey rsa()
+    {
+        return TestKey(EVPKey(EVP_RSA_gen(2048)), false);
+    }
+
+    static TestKey ec()
+    {
+        return TestKey(EVPKey(EVP_EC_gen("P-256")), true);
+    }
+
+    // The public key as a JWK.
+    nlohmann::json jwk(const std::string& kid) const
+    {
+        if(is_ec)
+        {
+            return {{"kty", "EC"}, {"crv", "P-256"}, {"kid", kid},
+                    {"use", "sig"},
+                    {"x", base64URLEncode(bnParam(OSSL_PKEY_PARAM_EC_PUB_X, 32))},
+                    {"y", base64URLEncode(bnParam(OSSL_PKEY_PARAM_EC_PUB_Y, 32))}};
+        }
+        return {{"kty", "RSA"}, {"kid", kid}, {"use", "sig"},
+                {"n", base64URLEncode(bnParam(OSSL_PKEY_PARAM_RSA_N, 0))},
+                {"e", base64URLEncode(bnParam(OSSL_PKEY_PARAM_RSA_E, 0))}};
+    }
+
+    // Make a signed JWT with the claims.
+    std::string sign(const std::string& kid, const nlohmann::json& claims) const
+    {
+        nlohmann::json header{{"alg", is_ec ? "ES256" : "RS256"},
+                              {"typ", "JWT"}, {"kid", kid}};
+        std::string input = base64URLEncode(header.dump()) + "." +
+            base64URLEncode(claims.dump());
+
+        EVP_MD_CTX* ctx = EVP_MD_CTX_new();
+        EVP_DigestSignInit(ctx, nullptr, EVP_sha256(), nullptr, key.get());
+        size_t size = 0;
+        EVP_DigestSign(ctx, nullptr, &size,
+                       reinterpret_cast<const unsigned char*>(input.data()),
+                       input.size());
+        std::string sig(size, '\0');
+        EVP_DigestSign(ctx, reinterpret_cast<unsigned char*>(sig.data()), &size,
+                       reinterpret_cast<const unsigned char*>(input.data()),
+                       input.size());
+        EVP_MD_CTX_free(ctx);
+        sig.resize(size);
+
+        if(is_ec)
+        {
+            // DER to raw “r || s”.
+            const unsigned char* p =
+                reinterpret_cast<const unsigned char*>(sig.data());
+            ECDSA_SIG* ecdsa = d2i_ECDSA_SIG(nullptr, &p, sig.size());
+            std::string raw(64, '\0');
+            BN_bn2binpad(ECDSA_SIG_get0_r(ecdsa),
+                         reinterpret_cast<unsigned char*>(raw.data()), 32);
+            BN_bn2binpad(ECDSA_SIG_get0_s(ecdsa),
+                         reinterpret_cast<unsigned char*>(raw.data()) + 32, 32);
+            ECDSA_SIG_free(ecdsa);
+            sig = std::move(raw);
+        }
+        return input + "." + base64URLEncode(sig);
+    }
+
+private:
+    TestKey(EVPKey k, bool ec) : key(std::move(k)), is_ec(ec) {}
+
+    // Get a big number parameter of the key. Pad to size bytes if
+    // size is not 0.
+    std::string bnParam(const char* name, int size) const
+    {
+        BIGNUM* bn = nullptr;
+        EVP_PKEY_get_bn_param(key.get(), name, &bn);
+        if(size == 0)
+        {
+            size = BN_num_bytes(bn);
+        }
+        std::string bytes(size, '\0');
+        BN_bn2binpad(bn, reinterpret_cast<unsigned char*>(bytes.data()), size);
+        BN_free(bn);
+        return bytes;
+    }
+
+    EVPKey key;
+    bool is_ec;
+};
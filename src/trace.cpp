@@ -0,0 +1,126 @@
+#include <chrono>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+#include "trace.hpp"
+
+namespace
+{
+
+// Traces with more spans than this are probably looping over
+// something, and the rest of the spans would not tell much more.
+constexpr size_t MAX_SPANS = 256;
+
+struct TraceBuffer
+{
+    bool active = false;
+    std::chrono::steady_clock::time_point begin;
+    std::vector<SpanRecord> spans;
+    int depth = 0;
+    size_t dropped = 0;
+};
+
+thread_local TraceBuffer buffer;
+
+double toMs(std::chrono::nanoseconds d)
+{
+    return std::chrono::duration<double, std::milli>(d).count();
+}
+
+} // namespace
+
+RequestTrace::RequestTrace(std::chrono::nanoseconds threshold)
+        : threshold(threshold)
+{
+    if(threshold.count() <= 0 || buffer.active)
+    {
+        return;
+    }
+    active = true;
+    buffer.active = true;
+    // Keeps the capacity from earlier requests.
+    buffer.spans.clear();
+    buffer.depth = 0;
+    buffer.dropped = 0;
+    buffer.begin = std::chrono::steady_clock::now();
+}
+
+RequestTrace::~RequestTrace()
+{
+    if(active)
+    {
+        buffer.active = false;
+    }
+}
+
+bool RequestTrace::finish()
+{
+    if(!active)
+    {
+        return false;
+    }
+    active = false;
+    buffer.active = false;
+    total = std::chrono::steady_clock::now() - buffer.begin;
+    if(total < threshold)
+    {
+        return false;
+    }
+    slow_spans = buffer.spans;
+    dropped = buffer.dropped;
+    return true;
+}
+
+nlohmann::json RequestTrace::toJSON() const
+{
+    nlohmann::json spans_json = nlohmann::json::array();
+    for(const SpanRecord& span: slow_spans)
+    {
+        spans_json.push_back({
+            {"name", span.name},
+            {"depth", span.depth},
+            {"begin_ms", toMs(span.begin)},
+            {"duration_ms", toMs(span.duration)},
+        });
+    }
+    nlohmann::json result = {
+        {"duration_ms", toMs(total)},
+        {"spans", std::move(spans_json)},
+    };
+    if(dropped > 0)
+    {
+        result["dropped_spans"] = dropped;
+    }
+    return result;
+}
+
+Span::Span(const char* name)
+{
+    if(!buffer.active)
+    {
+        return;
+    }
+    if(buffer.spans.size() >= MAX_SPANS)
+    {
+        buffer.dropped++;
+        return;
+    }
+    index = buffer.spans.size();
+    buffer.spans.push_back({name, buffer.depth, std::chrono::steady_clock::now()
+                            - buffer.begin, {}});
+    buffer.depth++;
+}
+
+Span::~Span()
+{
+    // The trace could have finished inside the span.
+    if(index == NO_RECORD || !buffer.active)
+    {
+        return;
+    }
+    buffer.depth--;
+    SpanRecord& span = buffer.spans[index];
+    span.duration = std::chrono::steady_clock::now() - buffer.begin -
+        span.begin;
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+// Lightweight tracing of requests. A RequestTrace marks the request
+// being handled by the current thread, and Spans inside it record
+// nested timed stages into a buffer owned by the thread, which is
+// reused from request to request. If the request turns out to be
+// slow, the spans are kept for logging; otherwise they are thrown
+// away. Outside of a trace a Span does nothing.
+
+struct SpanRecord
+{
+    // Should point to a string literal.
+    const char* name;
+    // 0 for the outermost spans.
+    int depth;
+    // Since the beginning of the trace.
+    std::chrono::nanoseconds begin;
+    std::chrono::nanoseconds duration;
+};
+
+class RequestTrace
+{
+public:
+    // Start tracing on the current thread. A request is slow if it
+    // takes at least threshold. A zero threshold disables tracing, and
+    // so does an enclosing trace on the same thread.
+    explicit RequestTrace(std::chrono::nanoseconds threshold);
+    // Stop tracing if finish() has not been called.
+    ~RequestTrace();
+    RequestTrace(const RequestTrace&) = delete;
+    RequestTrace& operator=(const RequestTrace&) = delete;
+
+    // Stop tracing, and return whether the request is slow.
+    bool finish();
+    std::chrono::nanoseconds duration() const { return total; }
+    // The spans of a slow request, after finish(). Otherwise empty.
+    const std::vector<SpanRecord>& spans() const { return slow_spans; }
+    // Number of spans not recorded because there were too many.
+    size_t droppedSpans() const { return dropped; }
+    // E.g. {"duration_ms": 812.3, "spans": [{"name": "getWeeklies",
+    // "depth": 0, "begin_ms": 0.1, "duration_ms": 790.2}, ...]}.
+    nlohmann::json toJSON() const;
+
+private:
+    const std::chrono::nanoseconds threshold;
+    bool active = false;
+    std::chrono::nanoseconds total{0};
+    std::vector<SpanRecord> slow_spans;
+    size_t dropped = 0;
+};
+
+// Time the enclosing scope as a stage of the current trace.
+class Span
+{
+public:
+    explicit Span(const char* name);
+    ~Span();
+    Span(const Span&) = delete;
+    Span& operator=(const Span&) = delete;
+
+private:
+    static constexpr size_t NO_RECORD = static_cast<size_t>(-1);
+    // Index in the buffer of the thread.
+    size_t index = NO_RECORD;
+};
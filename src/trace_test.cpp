@@ -0,0 +1,74 @@
+#include <chrono>
+#include <string>
+#include <thread>
+
+#include <gtest/gtest.h>
+#include <nlohmann/json.hpp>
+
+#include "trace.hpp"
+
+TEST(Trace, SlowRequestsKeepNestedSpans)
+{
+    RequestTrace trace(std::chrono::nanoseconds(1));
+    {
+        Span outer("outer");
+        {
+            Span inner("inner");
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        }
+        Span sibling("sibling");
+    }
+    ASSERT_TRUE(trace.finish());
+    ASSERT_EQ(trace.spans().size(), 3);
+    EXPECT_EQ(std::string(trace.spans()[0].name), "outer");
+    EXPECT_EQ(trace.spans()[0].depth, 0);
+    EXPECT_EQ(std::string(trace.spans()[1].name), "inner");
+    EXPECT_EQ(trace.spans()[1].depth, 1);
+    EXPECT_EQ(trace.spans()[2].depth, 1);
+    EXPECT_GE(trace.spans()[1].duration, std::chrono::milliseconds(2));
+    EXPECT_GE(trace.spans()[0].duration, trace.spans()[1].duration);
+    EXPECT_GE(trace.duration(), trace.spans()[0].duration);
+
+    nlohmann::json json = trace.toJSON();
+    EXPECT_EQ(json["spans"].size(), 3);
+    EXPECT_EQ(json["spans"][1]["name"], "inner");
+}
+
+TEST(Trace, FastRequestsAreNotKept)
+{
+    RequestTrace trace(std::chrono::hours(1));
+    {
+        Span span("span");
+    }
+    EXPECT_FALSE(trace.finish());
+    EXPECT_TRUE(trace.spans().empty());
+}
+
+TEST(Trace, SpansOutsideTracesAreIgnored)
+{
+    {
+        Span span("span");
+    }
+    // Disabled.
+    RequestTrace disabled(std::chrono::nanoseconds(0));
+    {
+        Span span("span");
+    }
+    EXPECT_FALSE(disabled.finish());
+
+    RequestTrace trace(std::chrono::nanoseconds(1));
+    ASSERT_TRUE(trace.finish());
+    EXPECT_TRUE(trace.spans().empty());
+}
+
+TEST(Trace, TooManySpansAreDropped)
+{
+    RequestTrace trace(std::chrono::nanoseconds(1));
+    for(int i = 0; i < 1000; i++)
+    {
+        Span span("span");
+    }
+    ASSERT_TRUE(trace.finish());
+    EXPECT_EQ(trace.spans().size() + trace.droppedSpans(), 1000);
+    EXPECT_GT(trace.droppedSpans(), 0);
+}
@@ -1,12 +1,20 @@
 #pragma once
 
+#include <algorithm>
 #include <chrono>
+#include <cstdint>
+#include <format>
+#include <fstream>
+#include <iomanip>
+#include <locale>
+#include <sstream>
 #include <string>
 #include <string_view>
 #include <filesystem>
 
 #include <nlohmann/json.hpp>
 #include <curl/curl.h>
+#include <openssl/evp.h>
 
 #include "error.hpp"
 
@@ -47,6 +55,71 @@ inline std::string urlEncode(std::string_view s)
     return url;
 }
 
+// Return the raw SHA-256 digest of the data.
+inline std::string sha256(std::string_view data)
+{
+    unsigned char digest[EVP_MAX_MD_SIZE];
+    unsigned int size = 0;
+    EVP_Digest(data.data(), data.size(), digest, &size, EVP_sha256(), nullptr);
+    return std::string(reinterpret_cast<const char*>(digest), size);
+}
+
+constexpr std::string_view BASE64_URL_ALPHABET =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
+
+// Base64 with the URL-safe alphabet and without padding, as used in
+// JWTs (RFC 7515) and in URLs of content hashes.
+inline std::string base64URLEncode(std::string_view data)
+{
+    std::string result;
+    result.reserve((data.size() * 4 + 2) / 3);
+    uint32_t buffer = 0;
+    int bits = 0;
+    for(char c: data)
+    {
+        buffer = (buffer << 8) | static_cast<unsigned char>(c);
+        bits += 8;
+        while(bits >= 6)
+        {
+            bits -= 6;
+            result.push_back(BASE64_URL_ALPHABET[(buffer >> bits) & 0x3f]);
+        }
+    }
+    if(bits > 0)
+    {
+        result.push_back(BASE64_URL_ALPHABET[(buffer << (6 - bits)) & 0x3f]);
+    }
+    return result;
+}
+
+inline E<std::string> base64URLDecode(std::string_view data)
+{
+    std::string result;
+    result.reserve(data.size() * 3 / 4);
+    uint32_t buffer = 0;
+    int bits = 0;
+    for(char c: data)
+    {
+        if(c == '=')
+        {
+            break;
+        }
+        size_t value = BASE64_URL_ALPHABET.find(c);
+        if(value == std::string_view::npos)
+        {
+            return std::unexpected(runtimeError("Invalid base64url data"));
+        }
+        buffer = (buffer << 6) | value;
+        bits += 6;
+        if(bits >= 8)
+        {
+            bits -= 8;
+            result.push_back(static_cast<char>((buffer >> bits) & 0xff));
+        }
+    }
+    return result;
+}
+
 inline int64_t timeToSeconds(const Time& t)
 {
     return std::chrono::duration_cast<std::chrono::seconds>(
@@ -68,6 +141,13 @@ inline int daysSinceNewYear(const Time& t)
             std::chrono::sys_days(new_year).time_since_epoch()).count();
 }
 
+// Return 00:00 UTC on the Monday of the week of t.
+inline Time weekBegin(const Time& t)
+{
+    auto day = std::chrono::floor<std::chrono::days>(t);
+    return day - (std::chrono::weekday(day) - std::chrono::Monday);
+}
+
 inline E<Time> strToDate(const std::string& s)
 {
     std::tm t;
@@ -87,3 +167,96 @@ inline E<Time> strToDate(const std::string& s)
     }
     return std::chrono::sys_days(date);
 }
+
+// Format the time as an HTTP date (RFC 9110), e.g. “Sun, 06 Nov 1994
+// 08:49:37 GMT”.
+inline std::string timeToHTTPDate(const Time& t)
+{
+    return std::format("{:%a, %d %b %Y %H:%M:%S} GMT",
+                       std::chrono::floor<std::chrono::seconds>(t));
+}
+
+inline E<Time> httpDateToTime(const std::string& s)
+{
+    std::tm t{};
+    std::istringstream ss(s);
+    ss.imbue(std::locale::classic());
+    ss >> std::get_time(&t, "%a, %d %b %Y %H:%M:%S GMT");
+    if(ss.fail())
+    {
+        return std::unexpected(runtimeError("Invalid HTTP date"));
+    }
+    std::chrono::year_month_day date(
+        std::chrono::year(t.tm_year + 1900),
+        std::chrono::month(t.tm_mon + 1),
+        std::chrono::day(t.tm_mday));
+    if(!date.ok())
+    {
+        return std::unexpected(runtimeError("Invalid HTTP date"));
+    }
+    return std::chrono::sys_days(date) + std::chrono::hours(t.tm_hour) +
+        std::chrono::minutes(t.tm_min) + std::chrono::seconds(t.tm_sec);
+}
+
+// Read the whole file.
+inline E<std::string> readFile(const std::filesystem::path& path)
+{
+    std::ifstream f(path, std::ios::binary);
+    std::ostringstream content;
+    content << f.rdbuf();
+    if(f.bad() || f.fail())
+    {
+        return std::unexpected(runtimeError(
+            std::format("Failed to read file {}", path.string())));
+    }
+    return content.str();
+}
+
+// Whether the name could be a user. Usernames are a segment of the
+// URLs of weeklies, e.g. /weekly/USER, so they are not empty, and
+// have no slashes or control characters.
+inline bool isValidUsername(std::string_view name)
+{
+    return !name.empty() &&
+        std::none_of(std::begin(name), std::end(name), [](char c)
+        {
+            return c == '/' || (static_cast<unsigned char>(c) < 0x20) ||
+                c == 0x7f;
+        });
+}
+
+// Format the time in UTC as in RFC 3339, e.g. “1994-11-06T08:49:37Z”.
+inline std::string timeToRFC3339(const Time& t)
+{
+    return std::format("{:%FT%TZ}",
+                       std::chrono::floor<std::chrono::seconds>(t));
+}
+
+// Parse a time in UTC in the format of timeToRFC3339().
+inline E<Time> rfc3339ToTime(const std::string& s)
+{
+    // std::get_time() stops quietly at the end of the input, so check
+    // that nothing is missing.
+    if(s.size() != std::string_view("1994-11-06T08:49:37Z").size())
+    {
+        return std::unexpected(runtimeError("Invalid time"));
+    }
+    std::tm t{};
+    std::istringstream ss(s);
+    ss.imbue(std::locale::classic());
+    ss >> std::get_time(&t, "%Y-%m-%dT%H:%M:%SZ");
+    if(ss.fail())
+    {
+        return std::unexpected(runtimeError("Invalid time"));
+    }
+    std::chrono::year_month_day date(
+        std::chrono::year(t.tm_year + 1900),
+        std::chrono::month(t.tm_mon + 1),
+        std::chrono::day(t.tm_mday));
+    if(!date.ok())
+    {
+        return std::unexpected(runtimeError("Invalid time"));
+    }
+    return std::chrono::sys_days(date) + std::chrono::hours(t.tm_hour) +
+        std::chrono::minutes(t.tm_min) + std::chrono::seconds(t.tm_sec);
+}
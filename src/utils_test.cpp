@@ -1,7 +1,10 @@
 #include <chrono>
+#include <filesystem>
+#include <string>
 
 #include <gtest/gtest.h>
 
+#include "test_utils.hpp"
 #include "utils.hpp"
 
 TEST(Utils, CanCalculateDaysSinceNewYear)
@@ -10,3 +13,67 @@ TEST(Utils, CanCalculateDaysSinceNewYear)
         std::chrono::year(2000), std::chrono::January, std::chrono::day(3)));
     EXPECT_EQ(daysSinceNewYear(t), 2);
 }
+
+TEST(Utils, CanCalculateWeekBegin)
+{
+    // 2000-01-03 is a Monday.
+    Time monday = std::chrono::sys_days(std::chrono::January / 3 / 2000);
+    EXPECT_EQ(weekBegin(monday), monday);
+    EXPECT_EQ(weekBegin(monday + std::chrono::hours(1)), monday);
+    EXPECT_EQ(weekBegin(monday + std::chrono::days(6) + std::chrono::hours(23)),
+              monday);
+    EXPECT_EQ(weekBegin(monday - std::chrono::seconds(1)),
+              monday - std::chrono::weeks(1));
+}
+
+TEST(Utils, CanConvertHTTPDate)
+{
+    Time t = std::chrono::sys_days(std::chrono::November / 6 / 1994) +
+        std::chrono::hours(8) + std::chrono::minutes(49) +
+        std::chrono::seconds(37);
+    EXPECT_EQ(timeToHTTPDate(t), "Sun, 06 Nov 1994 08:49:37 GMT");
+    ASSIGN_OR_FAIL(Time parsed, httpDateToTime("Sun, 06 Nov 1994 08:49:37 GMT"));
+    EXPECT_EQ(parsed, t);
+    EXPECT_FALSE(httpDateToTime("1994-11-06").has_value());
+}
+
+TEST(Utils, CanConvertRFC3339)
+{
+    Time t = std::chrono::sys_days(std::chrono::November / 6 / 1994) +
+        std::chrono::hours(8) + std::chrono::minutes(49) +
+        std::chrono::seconds(37);
+    EXPECT_EQ(timeToRFC3339(t), "1994-11-06T08:49:37Z");
+    ASSIGN_OR_FAIL(Time parsed, rfc3339ToTime("1994-11-06T08:49:37Z"));
+    EXPECT_EQ(parsed, t);
+    EXPECT_FALSE(rfc3339ToTime("1994-11-06").has_value());
+}
+
+TEST(Utils, CanValidateUsernames)
+{
+    EXPECT_TRUE(isValidUsername("mw"));
+    EXPECT_TRUE(isValidUsername("名前"));
+    EXPECT_FALSE(isValidUsername(""));
+    EXPECT_FALSE(isValidUsername("a/b"));
+    EXPECT_FALSE(isValidUsername("a\nb"));
+}
+
+TEST(Utils, CanReadFiles)
+{
+    std::filesystem::path dir(NSWEEKLY_SOURCE_DIR);
+    ASSIGN_OR_FAIL(std::string content, readFile(dir / "COPYING.txt"));
+    EXPECT_FALSE(content.empty());
+    EXPECT_FALSE(readFile(dir / "no-such-file").has_value());
+}
+
+TEST(Utils, Base64URLRoundTrip)
+{
+    using namespace std::string_literals;
+    for(const std::string& s: {""s, "a"s, "ab"s, "abc"s, "abcd"s,
+                               "\xff\xfe\x00\x01"s})
+    {
+        ASSIGN_OR_FAIL(std::string decoded, base64URLDecode(base64URLEncode(s)));
+        EXPECT_EQ(decoded, s);
+    }
+    EXPECT_EQ(base64URLEncode("\xfb\xff"), "-_8");
+    EXPECT_FALSE(base64URLDecode("a+b/").has_value());
+}
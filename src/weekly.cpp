@@ -1,9 +1,15 @@
 #include <expected>
+#include <format>
+#include <memory>
+#include <string>
+#include <string_view>
 
 #include <cmark.h>
 #include <spdlog/spdlog.h>
 
 #include "error.hpp"
+#include "metrics.hpp"
+#include "trace.hpp"
 #include "weekly.hpp"
 
 E<std::string> renderMarkdown(const std::string& src)
@@ -29,8 +35,23 @@ bool WeeklyPost::isValidFormatInt(int i)
     return false;
 }
 
+std::string_view WeeklyPost::formatName(Format format)
+{
+    switch(format)
+    {
+    case MARKDOWN:
+        return "markdown";
+    }
+    return "";
+}
+
 E<std::string> WeeklyPost::render() const
 {
+    Span span("WeeklyPost::render");
+    static Histogram& latency = Metrics::global().histogram(
+        "nsweekly_weekly_render_duration_seconds",
+        "Time of rendering weeklies to HTML.");
+    ScopedTimer timer(latency);
     switch(format)
     {
     case MARKDOWN:
@@ -40,3 +61,30 @@ E<std::string> WeeklyPost::render() const
             "Somebody forgot to add a switch case for a weekly format!"));
     }
 }
+
+std::string RenderCache::key(const std::string& author, const Time& week_begin)
+{
+    return std::format("{}/{}", timeToSeconds(week_begin), author);
+}
+
+E<std::string> RenderCache::render(const WeeklyPost& post)
+{
+    std::string k = key(post.author, post.week_begin);
+    if(std::optional<Entry> entry = cache.get(k);
+       entry.has_value() && entry->update_time == post.update_time)
+    {
+        hit_count.fetch_add(1, std::memory_order_relaxed);
+        return *entry->html;
+    }
+    miss_count.fetch_add(1, std::memory_order_relaxed);
+    ASSIGN_OR_RETURN(std::string html, post.render());
+    size_t size = ENTRY_BYTES + k.size() + html.size();
+    cache.put(k, {post.update_time,
+                  std::make_shared<const std::string>(html)}, size);
+    return html;
+}
+
+void RenderCache::invalidate(const std::string& author, const Time& week_begin)
+{
+    cache.erase(key(author, week_begin));
+}
@@ -1,5 +1,12 @@
 #pragma once
 
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include "cache.hpp"
 #include "error.hpp"
 #include "utils.hpp"
 
@@ -20,6 +27,49 @@ public:
     std::string author;
 
     static bool isValidFormatInt(int i);
+    // The name of the format in APIs, e.g. “markdown”.
+    static std::string_view formatName(Format format);
     // Render the post to HTML.
     E<std::string> render() const;
 };
+
+// Rendered HTML of weekly posts, keyed by author and week. An entry
+// is only used if the post has not been updated since it was
+// rendered. The capacity is in bytes of HTML.
+class RenderCache
+{
+public:
+    // Roughly the memory of an entry besides its HTML and key. This
+    // counts toward the capacity, so that posts that render to nothing
+    // cannot grow the cache without bound.
+    static constexpr size_t ENTRY_BYTES = 256;
+
+    explicit RenderCache(size_t capacity_bytes) : cache(capacity_bytes) {}
+
+    // Render the post, or return the cached HTML of it.
+    E<std::string> render(const WeeklyPost& post);
+    void invalidate(const std::string& author, const Time& week_begin);
+
+    // An entry of an outdated post counts as a miss.
+    uint64_t hits() const { return hit_count.load(std::memory_order_relaxed); }
+    uint64_t misses() const
+    {
+        return miss_count.load(std::memory_order_relaxed);
+    }
+    size_t bytes() const { return cache.cost(); }
+    // Number of cached posts.
+    size_t size() const { return cache.size(); }
+
+private:
+    struct Entry
+    {
+        Time update_time;
+        std::shared_ptr<const std::string> html;
+    };
+
+    static std::string key(const std::string& author, const Time& week_begin);
+
+    LRUCache<std::string, Entry> cache;
+    std::atomic<uint64_t> hit_count = 0;
+    std::atomic<uint64_t> miss_count = 0;
+};
@@ -0,0 +1,59 @@
+#include <chrono>
+#include <format>
+#include <string>
+
+#include <gtest/gtest.h>
+
+#include "test_utils.hpp"
+#include "utils.hpp"
+#include "weekly.hpp"
+
+TEST(Weekly, RenderCacheRendersAgainAfterUpdate)
+{
+    RenderCache cache(64 * 1024);
+    WeeklyPost p;
+    p.format = WeeklyPost::MARKDOWN;
+    p.author = "mw";
+    p.week_begin = std::chrono::sys_days(std::chrono::January / 1 / 2024);
+    p.update_time = p.week_begin + std::chrono::hours(1);
+    p.raw_content = "aaa";
+
+    ASSIGN_OR_FAIL(std::string html, cache.render(p));
+    ASSIGN_OR_FAIL(std::string expected, p.render());
+    EXPECT_EQ(html, expected);
+    ASSIGN_OR_FAIL(html, cache.render(p));
+    EXPECT_EQ(html, expected);
+    EXPECT_EQ(cache.hits(), 1);
+    std::string key = std::format("{}/mw", timeToSeconds(p.week_begin));
+    EXPECT_EQ(cache.bytes(),
+              RenderCache::ENTRY_BYTES + key.size() + expected.size());
+
+    // The post is updated.
+    p.update_time += std::chrono::hours(1);
+    p.raw_content = "bbb";
+    ASSIGN_OR_FAIL(html, cache.render(p));
+    ASSIGN_OR_FAIL(expected, p.render());
+    EXPECT_EQ(html, expected);
+    EXPECT_EQ(cache.hits(), 1);
+
+    cache.invalidate("mw", p.week_begin);
+    EXPECT_EQ(cache.bytes(), 0);
+}
+
+TEST(Weekly, RenderCacheStaysBoundedWithEmptyPosts)
+{
+    const size_t capacity = 64 * 1024;
+    RenderCache cache(capacity);
+    WeeklyPost p;
+    p.format = WeeklyPost::MARKDOWN;
+    p.author = "mw";
+    p.week_begin = std::chrono::sys_days(std::chrono::January / 1 / 2024);
+    for(int i = 0; i < 10000; i++)
+    {
+        ASSERT_TRUE(isExpected(cache.render(p)));
+        p.week_begin += std::chrono::weeks(1);
+    }
+    EXPECT_GT(cache.bytes(), 0);
+    EXPECT_LE(cache.bytes(), capacity);
+    EXPECT_LE(cache.size() * RenderCache::ENTRY_BYTES, capacity);
+}